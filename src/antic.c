@@ -23,6 +23,7 @@
 */
 
 #include "config.h"
+#include <stddef.h>
 #include <string.h>
 #if HAVE_STDINT_H
 # include <stdint.h>
@@ -34,6 +35,9 @@
 #include "gtia.h"
 #include "log.h"
 #include "memory.h"
+#ifdef MONITOR_PROFILE
+#include "monitor.h"
+#endif
 #include "platform.h"
 #include "pokey.h"
 #include "util.h"
@@ -429,13 +433,19 @@ unsigned int ANTIC_screenline_cpu_clock = 0;
 		draw_antic_ptr = draw_antic_table[GTIA_PRIOR >> 6][anticmode];\
 		gtia_bug_active = FALSE;\
 	}}while(0)
+#ifdef MONITOR_PROFILE
+#define PROFILE_EOL do{if (MONITOR_cycle_profile) MONITOR_CycleProfileEndLine();}while(0)
+#else
+#define PROFILE_EOL do{}while(0)
+#endif
 #define GOEOL_CYCLE_EXACT  CPU_GO(ANTIC_antic2cpu_ptr[ANTIC_LINE_C]); \
 	ANTIC_xpos = ANTIC_cpu2antic_ptr[ANTIC_xpos]; \
+	PROFILE_EOL; \
 	ANTIC_xpos -= ANTIC_LINE_C; \
 	ANTIC_screenline_cpu_clock += ANTIC_LINE_C; \
 	ANTIC_ypos++; \
 	GTIA_UpdatePmplColls();
-#define GOEOL CPU_GO(ANTIC_LINE_C); ANTIC_xpos -= ANTIC_LINE_C; ANTIC_screenline_cpu_clock += ANTIC_LINE_C; UPDATE_DMACTL; ANTIC_ypos++; UPDATE_GTIA_BUG
+#define GOEOL CPU_GO(ANTIC_LINE_C); PROFILE_EOL; ANTIC_xpos -= ANTIC_LINE_C; ANTIC_screenline_cpu_clock += ANTIC_LINE_C; UPDATE_DMACTL; ANTIC_ypos++; UPDATE_GTIA_BUG
 #define OVERSCREEN_LINE	ANTIC_xpos += ANTIC_DMAR; GOEOL
 
 int ANTIC_xpos = 0;
@@ -647,6 +657,44 @@ UWORD ANTIC_cl[128];
 
 #endif /* WORDS_UNALIGNED_OK */
 
+/* Modes with four 2-bit pixels per byte (2, E, F) without players/missiles.
+   Each half of the byte is drawn with one long, looked up in a table built
+   at the start of the line from the pixel lookup WORD (indexed by pixel
+   values in bits 0xc0). This is not vectorised: SSE2 has no byte shuffle
+   to replace the two lookups per byte, so vector code could only merge
+   the stores, and the whole line is a small part of the frame time. */
+
+#ifdef WORDS_UNALIGNED_OK
+
+static ULONG nibble_lookup[16];
+#ifdef WORDS_BIGENDIAN
+#define NIBBLE_LONG(left, right) (((ULONG) (left) << 16) | (right))
+#else
+#define NIBBLE_LONG(left, right) (((ULONG) (right) << 16) | (left))
+#endif
+#define INIT_NIBBLE_LOOKUP(word) { \
+		int n; \
+		for (n = 0; n < 16; n++) \
+			nibble_lookup[n] = NIBBLE_LONG(word((n & 0x0c) << 4), word((n & 0x03) << 6)); \
+	}
+#define DRAW_NIBBLES(data, word) { \
+		WRITE_VIDEO_LONG_UNALIGNED((ULONG *) ptr, nibble_lookup[(data) >> 4]); \
+		WRITE_VIDEO_LONG_UNALIGNED(((ULONG *) ptr) + 1, nibble_lookup[(data) & 0x0f]); \
+		ptr += 4; \
+	}
+
+#else
+
+#define INIT_NIBBLE_LOOKUP(word)
+#define DRAW_NIBBLES(data, word) { \
+		WRITE_VIDEO(ptr++, word((data) & 0xc0)); \
+		WRITE_VIDEO(ptr++, word(((data) & 0x30) << 2)); \
+		WRITE_VIDEO(ptr++, word(((data) & 0x0c) << 4)); \
+		WRITE_VIDEO(ptr++, word(((data) & 0x03) << 6)); \
+	}
+
+#endif /* WORDS_UNALIGNED_OK */
+
 #define DRAW_ARTIF_NEW {\
 		WRITE_VIDEO(ptr++, art_lookup_new[(screendata_tally & 0x03f000) >> 12]); \
 		WRITE_VIDEO(ptr++, art_lookup_new[(screendata_tally & 0x00fc00) >> 10]); \
@@ -1478,25 +1526,17 @@ static void draw_an_gtia_bug(const ULONG *t_pm_scanline_ptr)
 
 static void draw_antic_2(int nchars, const UBYTE *antic_memptr, UWORD *ptr, const ULONG *t_pm_scanline_ptr)
 {
-	INIT_BACKGROUND_6
 	INIT_ANTIC_2
 	INIT_HIRES
+	INIT_NIBBLE_LOOKUP(hires_norm)
 
 	CHAR_LOOP_BEGIN
 		UBYTE screendata = *antic_memptr++;
 		int chdata;
 
 		GET_CHDATA_ANTIC_2
-		if (IS_ZERO_ULONG(t_pm_scanline_ptr)) {
-			if (chdata) {
-				WRITE_VIDEO(ptr++, hires_norm(chdata & 0xc0));
-				WRITE_VIDEO(ptr++, hires_norm(chdata & 0x30));
-				WRITE_VIDEO(ptr++, hires_norm(chdata & 0x0c));
-				WRITE_VIDEO(ptr++, hires_norm((chdata & 0x03) << 2));
-			}
-			else
-				DRAW_BACKGROUND(C_PF2)
-		}
+		if (IS_ZERO_ULONG(t_pm_scanline_ptr))
+			DRAW_NIBBLES(chdata, hires_norm)
 		else
 			DO_PMG_HIRES(chdata)
 		t_pm_scanline_ptr++;
@@ -2208,26 +2248,20 @@ static void draw_antic_c(int nchars, const UBYTE *antic_memptr, UWORD *ptr, cons
 	do_border();
 }
 
+#define LOOKUP2(x) lookup2[x]
+
 static void draw_antic_e(int nchars, const UBYTE *antic_memptr, UWORD *ptr, const ULONG *t_pm_scanline_ptr)
 {
-	INIT_BACKGROUND_8
 	lookup2[0x00] = ANTIC_cl[C_BAK];
 	lookup2[0x40] = lookup2[0x10] = lookup2[0x04] = lookup2[0x01] = ANTIC_cl[C_PF0];
 	lookup2[0x80] = lookup2[0x20] = lookup2[0x08] = lookup2[0x02] = ANTIC_cl[C_PF1];
 	lookup2[0xc0] = lookup2[0x30] = lookup2[0x0c] = lookup2[0x03] = ANTIC_cl[C_PF2];
+	INIT_NIBBLE_LOOKUP(LOOKUP2)
 
 	CHAR_LOOP_BEGIN
 		UBYTE screendata = *antic_memptr++;
-		if (IS_ZERO_ULONG(t_pm_scanline_ptr)) {
-			if (screendata) {
-				WRITE_VIDEO(ptr++, lookup2[screendata & 0xc0]);
-				WRITE_VIDEO(ptr++, lookup2[screendata & 0x30]);
-				WRITE_VIDEO(ptr++, lookup2[screendata & 0x0c]);
-				WRITE_VIDEO(ptr++, lookup2[screendata & 0x03]);
-			}
-			else
-				DRAW_BACKGROUND(C_BAK)
-		}
+		if (IS_ZERO_ULONG(t_pm_scanline_ptr))
+			DRAW_NIBBLES(screendata, LOOKUP2)
 		else {
 			const UBYTE *c_pm_scanline_ptr = (const UBYTE *) t_pm_scanline_ptr;
 			int pm_pixel;
@@ -2321,21 +2355,13 @@ static void draw_antic_e_gtia11 (int nchars, const UBYTE *antic_memptr, UWORD *p
 
 static void draw_antic_f(int nchars, const UBYTE *antic_memptr, UWORD *ptr, const ULONG *t_pm_scanline_ptr)
 {
-	INIT_BACKGROUND_6
 	INIT_HIRES
+	INIT_NIBBLE_LOOKUP(hires_norm)
 
 	CHAR_LOOP_BEGIN
 		int screendata = *antic_memptr++;
-		if (IS_ZERO_ULONG(t_pm_scanline_ptr)) {
-			if (screendata) {
-				WRITE_VIDEO(ptr++, hires_norm(screendata & 0xc0));
-				WRITE_VIDEO(ptr++, hires_norm(screendata & 0x30));
-				WRITE_VIDEO(ptr++, hires_norm(screendata & 0x0c));
-				WRITE_VIDEO(ptr++, hires_norm((screendata & 0x03) << 2));
-			}
-			else
-				DRAW_BACKGROUND(C_PF2)
-		}
+		if (IS_ZERO_ULONG(t_pm_scanline_ptr))
+			DRAW_NIBBLES(screendata, hires_norm)
 		else
 			DO_PMG_HIRES(screendata)
 		t_pm_scanline_ptr++;
@@ -2842,6 +2868,125 @@ static void antic_load(void)
 int ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
 #endif
 
+/* Unchanged scanlines ----------------------------------------------------
+
+   Changed lines are flagged in Screen_dirty_lines, so that the display code
+   can copy just those.
+
+   Without NEW_CYCLE_EXACT a line without players and missiles is drawn in one
+   go, from the state at the start of its playfield. That state is kept for
+   each line of the screen, and a line whose state equals the one it was last
+   drawn from is not drawn again. A line that is drawn is compared with what
+   was there before.
+
+   With NEW_CYCLE_EXACT a line is drawn in pieces as the registers change,
+   and drawing it also does ANTIC's DMA, so every line is drawn and flagged
+   without comparing. */
+
+/* row of Screen_atari at scrn_ptr */
+#define SCRN_LINE ((int) (scrn_ptr - (UWORD *) Screen_atari) / (Screen_WIDTH / 2))
+
+#ifdef NEW_CYCLE_EXACT
+
+#define LINE_DRAW_BEGIN
+#define LINE_DRAW_END Screen_dirty_lines[SCRN_LINE >> 3] |= 1 << (SCRN_LINE & 7)
+
+#else /* NEW_CYCLE_EXACT */
+
+static UBYTE line_before[Screen_WIDTH];
+
+#define LINE_DRAW_BEGIN memcpy(line_before, scrn_ptr, Screen_WIDTH)
+#define LINE_DRAW_END \
+	if (memcmp(line_before, scrn_ptr, Screen_WIDTH) != 0) \
+		Screen_dirty_lines[SCRN_LINE >> 3] |= 1 << (SCRN_LINE & 7)
+
+typedef struct {
+	draw_antic_function draw;	/* NULL for a line without playfield */
+	void (*draw_0)(void);
+	UWORD colours[0x0e + 6];
+	UBYTE regs[12];
+	UBYTE memory[sizeof(antic_memory)];
+	UBYTE chdata[sizeof(antic_memory)];	/* font data of each character */
+} line_input;
+
+/* zeroed records never match, as draw_0 is always set */
+static line_input line_inputs[Screen_HEIGHT];
+
+/* Returns TRUE if the current line would be drawn with DRAW exactly as it
+   was in the previous frame. Otherwise remembers what the line is drawn from
+   and returns FALSE. */
+static int line_unchanged(draw_antic_function draw)
+{
+	static line_input cur;
+	line_input *rec = &line_inputs[SCRN_LINE];
+	size_t size;
+	int i;
+
+#ifndef BITPL_SCR
+	/* lines with players and missiles have to be drawn to detect collisions */
+	if (GTIA_pm_dirty
+#ifndef NO_SIMPLE_PAL_BLENDING
+	 || ANTIC_pal_blending
+#endif
+	 || (draw != NULL && draw != draw_antic_table[GTIA_PRIOR >> 6][anticmode]))
+#endif
+	{
+		rec->draw_0 = NULL;
+		return FALSE;
+	}
+
+	cur.draw = draw;
+	cur.draw_0 = draw_antic_0_ptr;
+	for (i = 0; i < 0x0e; i++)
+		cur.colours[i] = ANTIC_cl[i];
+	cur.colours[i++] = ANTIC_cl[C_HI2];
+	cur.colours[i++] = ANTIC_cl[C_HI3];
+	cur.colours[i++] = ANTIC_cl[C_PF0];
+	cur.colours[i++] = ANTIC_cl[C_PF1];
+	cur.colours[i++] = ANTIC_cl[C_PF2];
+	cur.colours[i] = ANTIC_cl[C_PF3];
+	cur.regs[0] = GTIA_PRIOR;
+	size = offsetof(line_input, regs) + 1;
+	if (draw != NULL) {
+		cur.regs[1] = anticmode;
+		cur.regs[2] = md;
+		cur.regs[3] = dctr;
+		cur.regs[4] = invert_mask;
+		cur.regs[5] = blank_mask;
+		cur.regs[6] = ANTIC_DMACTL;
+		cur.regs[7] = ANTIC_HSCROL;
+		cur.regs[8] = (UBYTE) ANTIC_artif_mode;
+		cur.regs[9] = (UBYTE) ANTIC_artif_new;
+		memcpy(cur.memory, antic_memory, sizeof(antic_memory));
+		size = offsetof(line_input, chdata);
+		if (anticmode <= 7) {
+			int row = anticmode <= 4 ? dctr : anticmode == 6 ? dctr & 7 : dctr >> 1;
+			int chmask = anticmode <= 5 ? 0x7f : 0x3f;
+#ifdef PAGED_MEM
+			UWORD t_chbase = anticmode <= 5 ? (row ^ chbase_20) & 0xfc07 : row ^ chbase_20;
+#define LINE_CHDATA(c) MEMORY_dGetByte(t_chbase + ((UWORD) ((c) & chmask) << 3))
+#else
+			const UBYTE *chptr;
+			if (ANTIC_xe_ptr != NULL && chbase_20 < 0x8000 && chbase_20 >= 0x4000)
+				chptr = ANTIC_xe_ptr + (anticmode <= 5 ? (row ^ chbase_20) & 0x3c07 : (row ^ chbase_20) - 0x4000);
+			else
+				chptr = MEMORY_mem + (anticmode <= 5 ? (row ^ chbase_20) & 0xfc07 : row ^ chbase_20);
+#define LINE_CHDATA(c) chptr[((c) & chmask) << 3]
+#endif
+			for (i = 0; i < (int) sizeof(antic_memory); i++)
+				cur.chdata[i] = LINE_CHDATA(antic_memory[i]);
+#undef LINE_CHDATA
+			size = sizeof(line_input);
+		}
+	}
+	if (memcmp(&cur, rec, size) == 0)
+		return TRUE;
+	memcpy(rec, &cur, size);
+	return FALSE;
+}
+
+#endif /* NEW_CYCLE_EXACT */
+
 #ifdef USE_CURSES
 static int scanlines_to_curses_display = 0;
 #endif
@@ -3011,6 +3156,7 @@ void ANTIC_Frame(int draw_display)
 #ifdef NEW_CYCLE_EXACT
 		/* begin drawing here */
 		if (draw_display) {
+			LINE_DRAW_BEGIN;
 			ANTIC_cur_screen_pos = LBORDER_START;
 			ANTIC_xpos = ANTIC_antic2cpu_ptr[ANTIC_xpos]; /* convert antic to cpu(need for WSYNC) */
 			if (dctr == lastline) {
@@ -3067,6 +3213,7 @@ void ANTIC_Frame(int draw_display)
 				static int toggle;\
 				if (toggle == 1) {\
 					FILL_VIDEO(scrn_ptr + LBORDER_START, 0x0f0f, (RBORDER_END - LBORDER_START) * 2);\
+					Screen_LinesDirty(SCRN_LINE, 1);\
 				}\
 				toggle = !toggle;\
 			}}while(0)
@@ -3079,6 +3226,7 @@ void ANTIC_Frame(int draw_display)
 		if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
 			GOEOL_CYCLE_EXACT;
 			draw_partial_scanline(ANTIC_cur_screen_pos, RBORDER_END);
+			LINE_DRAW_END;
 			UPDATE_DMACTL;
 			UPDATE_GTIA_BUG;
 			ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
@@ -3093,6 +3241,7 @@ void ANTIC_Frame(int draw_display)
 
 		GOEOL_CYCLE_EXACT;
 		draw_partial_scanline(ANTIC_cur_screen_pos, RBORDER_END);
+		LINE_DRAW_END;
 		UPDATE_DMACTL;
 		UPDATE_GTIA_BUG;
 		ANTIC_cur_screen_pos = ANTIC_NOT_DRAWING;
@@ -3107,7 +3256,11 @@ void ANTIC_Frame(int draw_display)
 		ANTIC_xpos += ANTIC_DMAR;
 
 		if (anticmode < 2 || (ANTIC_DMACTL & 3) == 0) {
-			draw_antic_0_ptr();
+			if (!line_unchanged(NULL)) {
+				LINE_DRAW_BEGIN;
+				draw_antic_0_ptr();
+				LINE_DRAW_END;
+			}
 			GOEOL;
 			YPOS_BREAK_FLICKER;
 			scrn_ptr += Screen_WIDTH / 2;
@@ -3134,10 +3287,16 @@ void ANTIC_Frame(int draw_display)
 				ANTIC_xpos -= extra_cycles[md];
 		}
 
-		draw_antic_ptr(chars_displayed[md],
-			antic_memory + ANTIC_margin + ch_offset[md],
-			scrn_ptr + x_min[md],
-			(ULONG *) &GTIA_pm_scanline[x_min[md]]);
+		if (!line_unchanged(draw_antic_ptr)) {
+			LINE_DRAW_BEGIN;
+			draw_antic_ptr(chars_displayed[md],
+				antic_memory + ANTIC_margin + ch_offset[md],
+				scrn_ptr + x_min[md],
+				(ULONG *) &GTIA_pm_scanline[x_min[md]]);
+			LINE_DRAW_END;
+		}
+		else if (anticmode <= 7)
+			ANTIC_xpos += font_cycles[md]; /* normally added by the font modes */
 
 		GOEOL;
 #endif /* NEW_CYCLE_EXACT */
@@ -3175,6 +3334,7 @@ void ANTIC_Frame(int draw_display)
 			} while (--k);
 			ptr -= 2 * (LCHOP + RCHOP); /* Move one line up */
 		} while (--ypos > 8); /* Stop after line 9 */
+		memset(Screen_dirty_lines, 0xff, sizeof(Screen_dirty_lines));
 	}
 #endif /* NO_SIMPLE_PAL_BLENDING */
 
@@ -3500,6 +3660,20 @@ void draw_partial_scanline(int l, int r)
 
 #endif /* !defined(BASIC) && !defined(CURSES_BASIC) */
 
+void ANTIC_InvalidateLines(int first, int count)
+{
+#if !defined(BASIC) && !defined(CURSES_BASIC) && !defined(NEW_CYCLE_EXACT)
+	if (first < 0) {
+		count += first;
+		first = 0;
+	}
+	if (first + count > Screen_HEIGHT)
+		count = Screen_HEIGHT - first;
+	if (count > 0)
+		memset(&line_inputs[first], 0, count * sizeof(line_input));
+#endif
+}
+
 /* ANTIC registers --------------------------------------------------------- */
 
 UBYTE ANTIC_GetByte(UWORD addr, int no_side_effects)
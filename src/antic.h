@@ -80,6 +80,11 @@ void ANTIC_PutByte(UWORD addr, UBYTE byte);
 UBYTE ANTIC_GetDLByte(UWORD *paddr);
 UWORD ANTIC_GetDLWord(UWORD *paddr);
 
+/* Forgets what lines FIRST..FIRST+COUNT-1 of Screen_atari were drawn from,
+   so that they are drawn in the next frame even if unchanged. Called when
+   something else has drawn over them. */
+void ANTIC_InvalidateLines(int first, int count);
+
 /* always call ANTIC_UpdateArtifacting after changing ANTIC_artif_mode */
 void ANTIC_UpdateArtifacting(void);
 
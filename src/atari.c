@@ -81,6 +81,9 @@
 #include "pia.h"
 #include "platform.h"
 #include "pokey.h"
+#ifdef REWIND
+#include "rewind.h"
+#endif
 #include "rtime.h"
 #include "pbi.h"
 #include "sio.h"
@@ -180,6 +183,12 @@ int Atari800_auto_frameskip = FALSE;
 static double benchmark_start_time;
 #endif
 
+#if defined(EVENT_RECORDING) && (defined(AUDIO_RECORDING) || defined(VIDEO_RECORDING)) && !defined(BASIC) && !defined(LIBATARI800)
+#define RENDER_TO_FILE
+/* Output file of -render, or NULL when not rendering. */
+static const char *render_filename = NULL;
+#endif
+
 #ifdef CTRL_C_HANDLER
 volatile sig_atomic_t sigint_flag = FALSE;
 
@@ -685,6 +694,17 @@ int Atari800_Initialise(int *argc, char *argv[])
 				else
 					a_m = TRUE;
 			}
+#ifdef RENDER_TO_FILE
+			else if (strcmp(argv[i], "-render") == 0) {
+				if (i_a) {
+					render_filename = argv[++i];
+#ifdef SOUND
+					Sound_offline = TRUE;
+#endif
+				}
+				else a_m = TRUE;
+			}
+#endif /* RENDER_TO_FILE */
 			else if (strcmp(argv[i], "-autosave-config") == 0)
 				CFG_save_on_exit = TRUE;
 			else if (strcmp(argv[i], "-no-autosave-config") == 0)
@@ -731,6 +751,10 @@ int Atari800_Initialise(int *argc, char *argv[])
 #ifndef BASIC
 					Log_print("\t-state <file>    Load saved-state file");
 					Log_print("\t-refresh <rate>  Specify screen refresh rate");
+#endif
+#ifdef RENDER_TO_FILE
+					Log_print("\t-render <file>   Replay -playback input as fast as possible, record");
+					Log_print("\t                 audio/video to <file> and exit");
 #endif
 					Log_print("\t-nopatch         Don't patch SIO routine in OS");
 					Log_print("\t-nopatchall      Don't patch OS at all, H: device won't work");
@@ -845,6 +869,9 @@ int Atari800_Initialise(int *argc, char *argv[])
 		|| !GTIA_Initialise(argc, argv)
 		|| !PIA_Initialise(argc, argv)
 		|| !POKEY_Initialise(argc, argv)
+#ifdef REWIND
+		|| !REWIND_Initialise(argc, argv)
+#endif
 	) {
 		Atari800_ErrExit();
 		return FALSE;
@@ -981,6 +1008,26 @@ int Atari800_Initialise(int *argc, char *argv[])
 	}
 #endif /* SOUND */
 
+#ifdef RENDER_TO_FILE
+	if (render_filename != NULL) {
+		if (!INPUT_Playingback()) {
+			Log_print("-render needs an input recording given with -playback");
+			Atari800_ErrExit();
+			return FALSE;
+		}
+		/* Every emulated frame goes to the file exactly as emulated: no
+		   skipped frames and no host-time dependent overlays. */
+		Atari800_refresh_rate = 1;
+		Atari800_auto_frameskip = FALSE;
+		Screen_show_atari_speed = FALSE;
+		if (!File_Export_StartRecording(render_filename)) {
+			Log_print("Cannot start rendering to %s", render_filename);
+			Atari800_ErrExit();
+			return FALSE;
+		}
+	}
+#endif /* RENDER_TO_FILE */
+
 	return TRUE;
 }
 
@@ -1063,6 +1110,9 @@ int Atari800_Exit(int run_monitor)
 #endif
 #ifdef POKEYREC
 		POKEYREC_Exit();
+#endif
+#ifdef REWIND
+		REWIND_Exit();
 #endif
 		Devices_Exit();
 #ifdef R_IO_DEVICE
@@ -1349,6 +1399,13 @@ void Atari800_Frame(void)
 		PBI_BB_Menu();
 #endif
 		break;
+#ifdef REWIND
+	case AKEY_REWIND:
+		/* go back two frames, so that with the frame emulated below
+		   the emulation runs backwards while the key is held */
+		REWIND_Back(2);
+		break;
+#endif
 	default:
 		break;
 	}
@@ -1361,6 +1418,7 @@ void Atari800_Frame(void)
 	VOTRAXSND_Frame(); /* for the Votrax */
 #endif
 	Devices_Frame();
+	SIO_Frame();
 #ifndef BASIC
 	INPUT_Frame();
 #endif
@@ -1411,6 +1469,9 @@ void Atari800_Frame(void)
 	Screen_DrawMultimediaStats();
 #endif
 	Atari800_nframes++;
+#ifdef REWIND
+	REWIND_Frame();
+#endif
 #ifndef LIBATARI800
 #ifdef BENCHMARK
 	if (Atari800_nframes >= BENCHMARK) {
@@ -1421,10 +1482,25 @@ void Atari800_Frame(void)
 	}
 #else
 
+#ifdef RENDER_TO_FILE
+	if (render_filename != NULL && !INPUT_Playingback()) {
+		/* the input recording has ended (with -playbacknoexit) */
+		Atari800_Exit(FALSE);
+		exit(0);
+	}
+#endif
+
 #ifdef ALTERNATE_SYNC_WITH_HOST
 	if (refresh_counter == 0)
 #endif
-		if (Atari800_turbo && Atari800_turbo_speed == 0) {
+		if ((Atari800_turbo && Atari800_turbo_speed == 0)
+#ifdef EVENT_RECORDING
+			|| INPUT_Seeking()
+#endif
+#ifdef RENDER_TO_FILE
+			|| render_filename != NULL
+#endif
+			) {
 			/* No need to draw Atari frames with frequency higher than display
 			   refresh rate. */
 			static double last_display_screen_time = 0.0;
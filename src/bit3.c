@@ -56,7 +56,7 @@ int BIT3_palette[2] = {
 
 static void update_d6(void)
 {
-	memcpy(MEMORY_mem + 0xd600, bit3_rom + (rom_bank_select<<8), 0x100);
+	MEMORY_dCopyToMem(bit3_rom + (rom_bank_select<<8), 0xd600, 0x100);
 }
 
 int BIT3_Initialise(int *argc, char *argv[])
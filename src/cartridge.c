@@ -30,6 +30,7 @@
 #include "atari.h"
 #include "binload.h" /* BINLOAD_loading_basic */
 #include "cartridge.h"
+#include "imgcache.h"
 #include "memory.h"
 #ifdef IDE
 #  include "ide.h"
@@ -506,6 +507,7 @@ static void MapActiveCart(void)
 #else
 			MEMORY_readmap[0xbf] = CARTRIDGE_5200SuperCartGetByte;
 			MEMORY_writemap[0xbf] = CARTRIDGE_5200SuperCartPutByte;
+			MEMORY_MapsChanged();
 #endif
 			break;
 		case CARTRIDGE_5200_32:
@@ -529,6 +531,7 @@ static void MapActiveCart(void)
 			MEMORY_readmap[0x5f] = CARTRIDGE_BountyBob2GetByte;
 			MEMORY_writemap[0x4f] = CARTRIDGE_BountyBob1PutByte;
 			MEMORY_writemap[0x5f] = CARTRIDGE_BountyBob2PutByte;
+			MEMORY_MapsChanged();
 #endif
 			break;
 		case CARTRIDGE_5200_40_ALT:
@@ -544,6 +547,7 @@ static void MapActiveCart(void)
 			MEMORY_readmap[0x5f] = CARTRIDGE_BountyBob2GetByte;
 			MEMORY_writemap[0x4f] = CARTRIDGE_BountyBob1PutByte;
 			MEMORY_writemap[0x5f] = CARTRIDGE_BountyBob2PutByte;
+			MEMORY_MapsChanged();
 #endif
 			break;
 		case CARTRIDGE_5200_NS_16:
@@ -709,6 +713,7 @@ static void MapActiveCart(void)
 			MEMORY_readmap[0x9f] = CARTRIDGE_BountyBob2GetByte;
 			MEMORY_writemap[0x8f] = CARTRIDGE_BountyBob1PutByte;
 			MEMORY_writemap[0x9f] = CARTRIDGE_BountyBob2PutByte;
+			MEMORY_MapsChanged();
 #endif
 			/* No need to call SwitchBank(), return. */
 			return;
@@ -1577,16 +1582,67 @@ static void PreprocessCart(CARTRIDGE_image_t *cart)
 				(byte & 0x40 ? map->data[6] : 0) |
 				(byte & 0x80 ? map->data[7] : 0);
 		}
-		free(cart->image);
+		IMGCACHE_Release(cart->image);
 		cart->image = new_image;
 	}
 }
 
+/* Returns TRUE if the emulated cartridge writes to its image. */
+static int ImageWritable(int type)
+{
+	switch (type) {
+	case CARTRIDGE_RAMCART_64:
+	case CARTRIDGE_RAMCART_128:
+	case CARTRIDGE_DOUBLE_RAMCART_256:
+	case CARTRIDGE_RAMCART_1M:
+	case CARTRIDGE_RAMCART_2M:
+	case CARTRIDGE_RAMCART_4M:
+	case CARTRIDGE_RAMCART_8M:
+	case CARTRIDGE_RAMCART_16M:
+	case CARTRIDGE_RAMCART_32M:
+	case CARTRIDGE_SIDICAR_32:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* Shares the image of a ROM cartridge through the image cache, so a
+   cartridge inserted again, or in another libatari800 context, doesn't get
+   another copy of the same data. RAM cartridges get their own copy. */
+static void CacheImage(CARTRIDGE_image_t *cart)
+{
+	ULONG length = (ULONG) cart->size << 10;
+	UBYTE *shared;
+
+	if (cart->image == NULL)
+		return;
+	if (ImageWritable(cart->type)) {
+		if (IMGCACHE_IsCached(cart->image)) {
+			UBYTE *copy = (UBYTE *) Util_malloc(length);
+			memcpy(copy, cart->image, length);
+			IMGCACHE_Release(cart->image);
+			cart->image = copy;
+		}
+		return;
+	}
+	if (IMGCACHE_IsCached(cart->image))
+		return;
+	shared = IMGCACHE_Find(cart->image, length, &length);
+	if (shared != NULL) {
+		free(cart->image);
+		cart->image = shared;
+	}
+	else
+		IMGCACHE_Add(cart->image, length, cart->image, length);
+}
+
 /* Initialises the cartridge CART after mounting. Called by CARTRIDGE_Insert,
    or CARTRIDGE_Insert_Second and CARTRIDGE_SetType. */
 static void InitCartridge(CARTRIDGE_image_t *cart)
 {
 	PreprocessCart(cart);
+	CacheImage(cart);
 	ResetCartState(cart);
 	if (cart == &CARTRIDGE_main) {
 		/* Check if we should automatically switch between computer/5200. */
@@ -1655,21 +1711,10 @@ int CARTRIDGE_WriteImage(char *filename, int type, UBYTE *image, int size, int r
 static void RemoveCart(CARTRIDGE_image_t *cart)
 {
 	if (cart->image != NULL) {
-		switch (cart->type) {
-		case CARTRIDGE_RAMCART_64:
-		case CARTRIDGE_RAMCART_128:
-		case CARTRIDGE_DOUBLE_RAMCART_256:
-		case CARTRIDGE_RAMCART_1M:
-		case CARTRIDGE_RAMCART_2M:
-		case CARTRIDGE_RAMCART_4M:
-		case CARTRIDGE_RAMCART_8M:
-		case CARTRIDGE_RAMCART_16M:
-		case CARTRIDGE_RAMCART_32M:
-		case CARTRIDGE_SIDICAR_32:
+		if (ImageWritable(cart->type))
 			CARTRIDGE_WriteImage(cart->filename, cart->type, cart->image, cart->size << 10, cart->raw, -1);
-		}
 
-		free(cart->image);
+		IMGCACHE_Release(cart->image);
 		cart->image = NULL;
 	}
 	if (cart->type != CARTRIDGE_NONE) {
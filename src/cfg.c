@@ -85,9 +85,6 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 	FILE *fp;
 	const char *fname = rtconfig_filename;
 	char string[256];
-#ifndef BASIC
-	int was_obsolete_dir = FALSE;
-#endif
 
 #ifdef SUPPORTS_PLATFORM_CONFIGINIT
 	PLATFORM_ConfigInit();
@@ -126,6 +123,18 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 		Log_print("Using Atari800 config file: %s\nCreated by %s", fname, string);
 	}
 
+	CFG_ReadConfigFrom(fp);
+	fclose(fp);
+	return TRUE;
+}
+
+void CFG_ReadConfigFrom(FILE *fp)
+{
+	char string[256];
+#ifndef BASIC
+	int was_obsolete_dir = FALSE;
+#endif
+
 	while (fgets(string, sizeof(string), fp)) {
 		char *ptr;
 		Util_chomp(string);
@@ -354,7 +363,6 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 		}
 	}
 
-	fclose(fp);
 #ifndef BASIC
 	if (was_obsolete_dir) {
 		Log_print(
@@ -363,16 +371,11 @@ int CFG_LoadConfig(const char *alternate_config_filename)
 			"and SAVED_FILES_DIR in your Atari800 configuration file.");
 	}
 #endif
-	return TRUE;
 }
 
 int CFG_WriteConfig(void)
 {
 	FILE *fp;
-	int i;
-	static const char * const machine_type_string[Atari800_MACHINE_SIZE] = {
-		"400/800", "XL/XE", "5200"
-	};
 
 	fp = fopen(rtconfig_filename, "w");
 	if (fp == NULL) {
@@ -383,6 +386,18 @@ int CFG_WriteConfig(void)
 	Log_print("Writing config file: %s", rtconfig_filename);
 
 	fprintf(fp, "%s\n", Atari800_TITLE);
+	CFG_WriteConfigTo(fp);
+	fclose(fp);
+	return TRUE;
+}
+
+void CFG_WriteConfigTo(FILE *fp)
+{
+	int i;
+	static const char * const machine_type_string[Atari800_MACHINE_SIZE] = {
+		"400/800", "XL/XE", "5200"
+	};
+
 	SYSROM_WriteConfig(fp);
 #ifndef BASIC
 	for (i = 0; i < UI_n_atari_files_dir; i++)
@@ -485,8 +500,6 @@ int CFG_WriteConfig(void)
 #ifdef SUPPORTS_PLATFORM_CONFIGSAVE
 	PLATFORM_ConfigSave(fp);
 #endif
-	fclose(fp);
-	return TRUE;
 }
 
 int CFG_MatchTextParameter(char const *param, char const * const cfg_strings[], int cfg_strings_size)
@@ -1,12 +1,21 @@
 #ifndef CFG_H_
 #define CFG_H_
 
+#include <stdio.h>
+
 /* Load Atari800 text configuration file. */
 int CFG_LoadConfig(const char *alternate_config_filename);
 
 /* Writes Atari800 text configuration file. */
 int CFG_WriteConfig(void);
 
+/* Reads the settings lines of a configuration file from FP, which must be
+   past the title line. */
+void CFG_ReadConfigFrom(FILE *fp);
+
+/* Writes the current settings to FP, without the title line. */
+void CFG_WriteConfigTo(FILE *fp);
+
 /* Controls whether the configuration file will be saved on emulator exit. */
 extern int CFG_save_on_exit;
 
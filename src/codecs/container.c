@@ -312,7 +312,9 @@ int CONTAINER_AddAudioSamples(const UBYTE *buf, int num_samples)
 #endif
 
 #ifdef VIDEO_RECORDING
-int CONTAINER_AddVideoFrame(void)
+/* Adds the frame in SCREEN, which has the layout of Screen_atari, to the
+   video stream. */
+int CONTAINER_AddVideoFrame(UBYTE *screen)
 {
 	int size;
 	int result;
@@ -336,7 +338,7 @@ int CONTAINER_AddVideoFrame(void)
 		is_keyframe = TRUE;
 	}
 
-	size = video_codec->frame((UBYTE *)Screen_atari, is_keyframe, video_buffer, video_buffer_size);
+	size = video_codec->frame(screen, is_keyframe, video_buffer, video_buffer_size);
 	if (size < 0) {
 		/* failed creating video frame; force close of file */
 		Log_print("video codec %s failed encoding frame", video_codec->codec_id);
@@ -363,6 +365,29 @@ int CONTAINER_AddVideoFrame(void)
 
 	return result;
 }
+
+/* Adds an empty frame to the video stream, which players show by holding the
+   previous frame. Used for frames that were dropped while recording, so the
+   video keeps in step with the audio. */
+int CONTAINER_AddDroppedVideoFrame(void)
+{
+	int result;
+
+	if (!fp || !video_codec) return 0;
+
+	result = container->video_frame(fp, video_buffer, 0, FALSE);
+	if (result) {
+		video_frame_count++;
+		smallest_video_frame = 0;
+
+		result = container->size_check(ftell(fp));
+		if (!result) {
+			Log_print("%s maximum file size reached, closing file", container->container_id);
+		}
+	}
+
+	return result;
+}
 #endif
 
 /* Closes the current container, flushing any buffered audio data and updating
@@ -49,7 +49,8 @@ int CONTAINER_Open(const char *filename);
 int CONTAINER_AddAudioSamples(const UBYTE *buf, int num_samples);
 #endif
 #ifdef VIDEO_RECORDING
-int CONTAINER_AddVideoFrame(void);
+int CONTAINER_AddVideoFrame(UBYTE *screen);
+int CONTAINER_AddDroppedVideoFrame(void);
 #endif
 int CONTAINER_Close(int file_ok);
 
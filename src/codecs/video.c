@@ -22,8 +22,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef RECORDING_THREAD
+#include <pthread.h>
+#endif
 #include "screen.h"
 #include "colours.h"
 #include "cfg.h"
@@ -57,6 +61,10 @@ static VIDEO_CODEC_t *requested_video_codec = NULL;
 #define MAX_KEYFRAME_INTERVAL 500
 int video_codec_keyframe_interval = 0;
 
+/* Number of threads the codecs may use to encode each frame */
+#define MAX_VIDEO_CODEC_THREADS 16
+int video_codec_threads = 1;
+
 
 static VIDEO_CODEC_t *known_video_codecs[] = {
 	&Video_Codec_MRLE,
@@ -149,12 +157,45 @@ int CODECS_VIDEO_Initialise(int *argc, char *argv[])
 			}
 			else a_m = TRUE;
 		}
+#ifdef RECORDING_THREAD
+		else if (strcmp(argv[i], "-vthreads") == 0) {
+			if (i_a) {
+				video_codec_threads = Util_sscandec(argv[++i]);
+				if (video_codec_threads < 1 || video_codec_threads > MAX_VIDEO_CODEC_THREADS) {
+					Log_print("Invalid number of video codec threads, must be between 1 and %d.", MAX_VIDEO_CODEC_THREADS);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+#endif
+#ifdef VIDEO_CODEC_ZMBV
+		else if (strcmp(argv[i], "-zmbv-search") == 0) {
+			if (i_a) {
+				char *mode = argv[++i];
+				if (strcmp(mode, "full") == 0)
+					ZMBV_fast_search = FALSE;
+				else if (strcmp(mode, "fast") == 0)
+					ZMBV_fast_search = TRUE;
+				else
+					a_i = TRUE;
+			}
+			else a_m = TRUE;
+		}
+#endif
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				char buf[256];
 				Log_print(video_codec_args(buf));
 				Log_print("\t                 Select video codec (default: auto)");
 				Log_print("\t-keyint <num>    Set video keyframe interval to one keyframe every num frames");
+#ifdef RECORDING_THREAD
+				Log_print("\t-vthreads <num>  Use num threads to encode each video frame (default 1)");
+#endif
+#ifdef VIDEO_CODEC_ZMBV
+				Log_print("\t-zmbv-search full|fast");
+				Log_print("\t                 Select ZMBV motion search (default: full)");
+#endif
 			}
 			argv[j++] = argv[i];
 		}
@@ -191,6 +232,23 @@ int CODECS_VIDEO_ReadConfig(char *string, char *ptr)
 			video_codec_keyframe_interval = num;
 		else return FALSE;
 	}
+#ifdef RECORDING_THREAD
+	else if (strcmp(string, "VIDEO_CODEC_THREADS") == 0) {
+		int num = Util_sscandec(ptr);
+		if (num >= 1 && num <= MAX_VIDEO_CODEC_THREADS)
+			video_codec_threads = num;
+		else return FALSE;
+	}
+#endif
+#ifdef VIDEO_CODEC_ZMBV
+	else if (strcmp(string, "VIDEO_CODEC_ZMBV_SEARCH") == 0) {
+		if (Util_stricmp(ptr, "full") == 0)
+			ZMBV_fast_search = FALSE;
+		else if (Util_stricmp(ptr, "fast") == 0)
+			ZMBV_fast_search = TRUE;
+		else return FALSE;
+	}
+#endif
 	else return FALSE;
 	return TRUE;
 }
@@ -204,8 +262,96 @@ void CODECS_VIDEO_WriteConfig(FILE *fp)
 		fprintf(fp, "VIDEO_CODEC=%s\n", requested_video_codec->codec_id);
 	}
 	fprintf(fp, "VIDEO_CODEC_KEYFRAME_INTERVAL=%d\n", video_codec_keyframe_interval);
+#ifdef RECORDING_THREAD
+	fprintf(fp, "VIDEO_CODEC_THREADS=%d\n", video_codec_threads);
+#endif
+#ifdef VIDEO_CODEC_ZMBV
+	fprintf(fp, "VIDEO_CODEC_ZMBV_SEARCH=%s\n", ZMBV_fast_search ? "FAST" : "FULL");
+#endif
+}
+
+
+#ifdef RECORDING_THREAD
+/* Bands 1 and up of a frame are encoded by band worker threads, which are
+   started with the codec and wait between frames; band 0 is encoded by the
+   thread that calls CODECS_VIDEO_RunBands. */
+static pthread_t band_threads[MAX_VIDEO_CODEC_THREADS];
+static int band_numbers[MAX_VIDEO_CODEC_THREADS];
+static int num_band_threads = 0;  /* workers for bands 1 to num_band_threads */
+static pthread_mutex_t band_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t band_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t band_done = PTHREAD_COND_INITIALIZER;
+static VIDEO_CODEC_BandFunc band_func;
+static void *band_arg;
+static int band_count;            /* bands of the current frame */
+static ULONG band_frame;          /* incremented for every frame */
+static int bands_pending;         /* workers not done with the current frame */
+static int band_stop;             /* workers exit */
+
+static void *BandThread(void *arg)
+{
+	int band = *(int *)arg;
+	ULONG frame = 0;
+
+	for (;;) {
+		VIDEO_CODEC_BandFunc func;
+		void *func_arg;
+		int bands;
+
+		pthread_mutex_lock(&band_mutex);
+		while (band_frame == frame && !band_stop)
+			pthread_cond_wait(&band_start, &band_mutex);
+		if (band_stop) {
+			pthread_mutex_unlock(&band_mutex);
+			break;
+		}
+		frame = band_frame;
+		func = band_func;
+		func_arg = band_arg;
+		bands = band_count;
+		pthread_mutex_unlock(&band_mutex);
+
+		/* workers without a band in this frame wait for the next one */
+		if (band < bands) {
+			func(band, bands, func_arg);
+			pthread_mutex_lock(&band_mutex);
+			if (--bands_pending == 0)
+				pthread_cond_signal(&band_done);
+			pthread_mutex_unlock(&band_mutex);
+		}
+	}
+	return NULL;
 }
 
+static void StartBandThreads(void)
+{
+	int i;
+
+	band_frame = 0;
+	band_stop = FALSE;
+	for (i = 1; i < video_codec_threads; i++) {
+		band_numbers[i] = i;
+		if (pthread_create(&band_threads[i], NULL, BandThread, &band_numbers[i]) != 0) {
+			Log_print("Can't start video codec threads, using %d", i);
+			break;
+		}
+	}
+	num_band_threads = i - 1;
+}
+
+static void StopBandThreads(void)
+{
+	int i;
+
+	pthread_mutex_lock(&band_mutex);
+	band_stop = TRUE;
+	pthread_cond_broadcast(&band_start);
+	pthread_mutex_unlock(&band_mutex);
+	for (i = 1; i <= num_band_threads; i++)
+		pthread_join(band_threads[i], NULL);
+	num_band_threads = 0;
+}
+#endif /* RECORDING_THREAD */
 
 int CODECS_VIDEO_Init(void)
 {
@@ -229,12 +375,18 @@ int CODECS_VIDEO_Init(void)
 		return 0;
 	}
 	video_buffer = (UBYTE *)Util_malloc(video_buffer_size);
+#ifdef RECORDING_THREAD
+	StartBandThreads();
+#endif
 
 	return 1;
 }
 
 void CODECS_VIDEO_End(void)
 {
+#ifdef RECORDING_THREAD
+	StopBandThreads();
+#endif
 	video_codec->end();
 	if (video_buffer) {
 		free(video_buffer);
@@ -243,3 +395,40 @@ void CODECS_VIDEO_End(void)
 	}
 	video_codec = NULL;
 }
+
+int CODECS_VIDEO_Bands(int rows)
+{
+	return rows < video_codec_threads ? rows : video_codec_threads;
+}
+
+void CODECS_VIDEO_RunBands(int bands, VIDEO_CODEC_BandFunc func, void *arg)
+{
+	int i;
+#ifdef RECORDING_THREAD
+	int workers = bands - 1 < num_band_threads ? bands - 1 : num_band_threads;
+
+	if (workers > 0) {
+		pthread_mutex_lock(&band_mutex);
+		band_func = func;
+		band_arg = arg;
+		band_count = bands;
+		bands_pending = workers;
+		band_frame++;
+		pthread_cond_broadcast(&band_start);
+		pthread_mutex_unlock(&band_mutex);
+	}
+	/* the first band, and those without a worker, are done in this thread */
+	func(0, bands, arg);
+	for (i = workers + 1; i < bands; i++)
+		func(i, bands, arg);
+	if (workers > 0) {
+		pthread_mutex_lock(&band_mutex);
+		while (bands_pending > 0)
+			pthread_cond_wait(&band_done, &band_mutex);
+		pthread_mutex_unlock(&band_mutex);
+	}
+#else
+	for (i = 0; i < bands; i++)
+		func(i, bands, arg);
+#endif
+}
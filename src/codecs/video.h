@@ -32,6 +32,11 @@ extern VIDEO_CODEC_t *video_codec;
 extern int video_buffer_size;
 extern UBYTE *video_buffer;
 extern int video_codec_keyframe_interval;
+extern int video_codec_threads;
+
+/* Function doing the part of the work on a frame that belongs to horizontal
+   band BAND of BANDS. */
+typedef void (*VIDEO_CODEC_BandFunc)(int band, int bands, void *arg);
 
 int CODECS_VIDEO_Initialise(int *argc, char *argv[]);
 int CODECS_VIDEO_ReadConfig(char *string, char *ptr);
@@ -39,5 +44,13 @@ void CODECS_VIDEO_WriteConfig(FILE *fp);
 int CODECS_VIDEO_Init(void);
 void CODECS_VIDEO_End(void);
 
+/* Returns the number of bands to split a frame of ROWS rows (of lines or
+   blocks) into, one for each thread that may work on it. */
+int CODECS_VIDEO_Bands(int rows);
+/* Calls FUNC(band, BANDS, ARG) for every band, each in a thread of its own,
+   and returns when all are done. The threads are started by
+   CODECS_VIDEO_Init and end with CODECS_VIDEO_End. */
+void CODECS_VIDEO_RunBands(int bands, VIDEO_CODEC_BandFunc func, void *arg);
+
 #endif /* CODECS_VIDEO_H_ */
 
@@ -38,6 +38,23 @@ static int video_top_margin;
 static int video_width;
 static int video_height;
 
+/* When several threads encode a frame, each band of lines is encoded into
+   band_buffer, at the offset of its first line times band_line_size, and the
+   bands are then joined into the output buffer. */
+typedef struct {
+	int size;        /* bytes encoded */
+	int lead;        /* blank lines before the first changed line */
+	int first_line;  /* index of the first changed line, or -1 */
+	int first_size;  /* bytes encoded for the first changed line */
+	int dy;          /* blank lines at the end of the band */
+} band_info_t;
+
+#define MAX_BANDS 16
+static int band_line_size;
+static UBYTE *band_buffer = NULL;
+static band_info_t band_info[MAX_BANDS];
+static const UBYTE *band_source;
+
 /* This file implements the Microsoft Run Length Encoding video codec, fourcc
    code of 'mrle'.
 
@@ -277,6 +294,94 @@ static int compress_line_delta(UBYTE *buf, const UBYTE *ptr, UBYTE *ref, int *dy
 	return buf - buf_start;
 }
 
+/* Returns the address of the line with index LINE (counting from the bottom,
+   in the order lines are encoded) in SCREEN. */
+static UBYTE *line_address(UBYTE *screen, int line)
+{
+	return screen + ((video_top_margin + video_height - 1 - line) * Screen_WIDTH) + video_left_margin;
+}
+
+static void encode_keyframe_band(int band, int bands, void *arg)
+{
+	int line0 = video_height * band / bands;
+	int line1 = video_height * (band + 1) / bands;
+	UBYTE *buf = band_buffer + line0 * band_line_size;
+	int line;
+
+	band_info[band].size = 0;
+	for (line = line0; line < line1; line++)
+		band_info[band].size += compress_line(buf + band_info[band].size, line_address((UBYTE *)band_source, line));
+}
+
+static void encode_interframe_band(int band, int bands, void *arg)
+{
+	int line0 = video_height * band / bands;
+	int line1 = video_height * (band + 1) / bands;
+	UBYTE *buf = band_buffer + line0 * band_line_size;
+	band_info_t *info = &band_info[band];
+	int line;
+	int dy = 0;
+
+	info->size = 0;
+	info->first_line = -1;
+	for (line = line0; line < line1; line++) {
+		int lead = dy;
+		int size = compress_line_delta(buf + info->size, line_address((UBYTE *)band_source, line), line_address(reference_screen, line), &dy);
+		if (size > 0 && info->first_line < 0) {
+			info->first_line = line;
+			info->lead = lead;
+			info->first_size = size;
+		}
+		info->size += size;
+	}
+	info->dy = dy;
+}
+
+/* Encodes the lines of SOURCE in bands, in as many threads, and joins the
+   bands into BUF. The first changed line of a band is encoded again when
+   blank lines above it in earlier bands have to be skipped, so the result is
+   the same as encoding the lines one after another.
+
+   RETURNS: number of encoded bytes */
+static int create_frame_in_bands(UBYTE *buf, const UBYTE *source, int keyframe, int bands) {
+	UBYTE *buf_start = buf;
+	int dy = 0;
+	int band;
+
+	band_source = source;
+	CODECS_VIDEO_RunBands(bands, keyframe ? encode_keyframe_band : encode_interframe_band, NULL);
+
+	for (band = 0; band < bands; band++) {
+		band_info_t *info = &band_info[band];
+		UBYTE *band_buf = band_buffer + (video_height * band / bands) * band_line_size;
+
+		if (keyframe || dy == 0) {
+			memcpy(buf, band_buf, info->size);
+			buf += info->size;
+		}
+		else if (info->first_line >= 0) {
+			int line_dy = dy + info->lead;
+			buf += compress_line_delta(buf, line_address((UBYTE *)source, info->first_line), line_address(reference_screen, info->first_line), &line_dy);
+			memcpy(buf, band_buf + info->first_size, info->size - info->first_size);
+			buf += info->size - info->first_size;
+		}
+		if (!keyframe) {
+			if (info->first_line >= 0)
+				dy = info->dy;
+			else
+				dy += info->dy;
+		}
+	}
+
+	if (keyframe || buf > buf_start) {
+		/* mark end of bitmap */
+		*buf++ = 0;
+		*buf++ = 1;
+	}
+
+	return buf - buf_start;
+}
+
 /* MRLE_CreateInterframe compares the current screen to the reference screen and
    fills the output buffer with the MRLE encoded differences. It also updates
    the reference screen to hold the current screen.
@@ -328,16 +433,27 @@ static int MRLE_Init(int width, int height, int left_margin, int top_margin)
 	   marker for each line plus the end of bitmap marker. */
 	size = ((((int)(ceil(width / 254)) * 2) + width + 2) * height) + 2;
 
+	/* skips and padding can make a changed line a bit longer than that, so
+	   leave each band plenty of room */
+	band_line_size = 2 * width + 16;
+
 	reference_screen_size = Screen_WIDTH * Screen_HEIGHT;
 	reference_screen = (UBYTE *)Util_malloc(reference_screen_size);
+	band_buffer = (UBYTE *)Util_malloc(band_line_size * height);
 
 	return size;
 }
 
 static int MRLE_CreateFrame(UBYTE *source, int keyframe, UBYTE *buf, int bufsize) {
 	int size;
+	int bands = CODECS_VIDEO_Bands(video_height);
 
-	if (keyframe) {
+	if (bands > MAX_BANDS)
+		bands = MAX_BANDS;
+	if (bands > 1) {
+		size = create_frame_in_bands(buf, source, keyframe, bands);
+	}
+	else if (keyframe) {
 		size = create_keyframe(buf, bufsize, source);
 	}
 	else {
@@ -354,6 +470,8 @@ static int MRLE_End(void)
 {
 	free(reference_screen);
 	reference_screen = NULL;
+	free(band_buffer);
+	band_buffer = NULL;
 	reference_screen_size = 0;
 
 	return 1;
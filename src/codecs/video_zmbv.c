@@ -32,9 +32,17 @@
    - if compression level is zero, raw uncompressed data is stored rather than
      the zlib stream with compression level 0 data
    - motion estimation range is fixed to a value suited to Atari graphics
+   - candidate motion vectors are first compared by counting the differing
+     bytes, which skips the entropy score of candidates that can't win
+   - an optional fast motion search follows a small diamond pattern from the
+     predicted vectors instead of trying the whole range
+   - motion estimation can be split into horizontal bands run in parallel;
+     the vectors at the top of each band are then corrected so that the
+     output is the same as when estimating the whole frame in one go
 */  
 
 
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include "codecs/video_zmbv.h"
@@ -87,6 +95,46 @@ static z_stream zstream;
 #endif
 static int score_tab[ZMBV_BLOCK * ZMBV_BLOCK * 4 + 1];
 
+/* Motion vectors of the blocks of the frame being encoded */
+typedef struct {
+	int mx, my;
+	int xored;
+} block_motion_t;
+
+static block_motion_t *motion;
+static int blocks_x, blocks_y;
+static UBYTE *motion_src;
+static UBYTE *motion_prev;
+static UBYTE *band_changed;
+
+int ZMBV_fast_search = FALSE;
+
+/* Counts the bytes that differ between two blocks, four at a time. */
+static int block_diff(UBYTE *src, int stride, UBYTE *src2, int stride2, int bw, int bh)
+{
+	int count = 0;
+	int i, j;
+
+	for(j = 0; j < bh; j++){
+		for(i = 0; i + 4 <= bw; i += 4){
+			ULONG a, b, t;
+			memcpy(&a, src + i, 4);
+			memcpy(&b, src2 + i, 4);
+			t = a ^ b;
+			if(t){
+				/* set the top bit of every non-zero byte, then add them up */
+				t = (t | ((t & 0x7f7f7f7f) + 0x7f7f7f7f)) & 0x80808080;
+				count += (int)(((t >> 7) * 0x01010101) >> 24);
+			}
+		}
+		for(; i < bw; i++)
+			count += src[i] != src2[i];
+		src += stride;
+		src2 += stride2;
+	}
+	return count;
+}
+
 
 static int block_cmp(UBYTE *src, int stride, UBYTE *src2, int stride2, int bw, int bh, int *xored)
 {
@@ -117,9 +165,46 @@ static int block_cmp(UBYTE *src, int stride, UBYTE *src2, int stride2, int bw, i
 	return sum;
 }
 
-static int motion_estimation(UBYTE *src, int sstride, UBYTE *prev, int pstride, int x, int y, int *mx, int *my, int *xored)
+/* Scores the candidate block SRC2 like block_cmp, but returns BEST without
+   building the histogram if the candidate can't score lower than BEST.
+   With d of the n bytes differing, the score is at least that of d equal
+   non-zero bytes, score_tab[n - d] + score_tab[d], less up to one for each
+   of the d bins that the rounding of score_tab may lose. */
+static int block_score(UBYTE *src, int stride, UBYTE *src2, int stride2, int bw, int bh, int best, int *xored)
+{
+	int d = block_diff(src, stride, src2, stride2, bw, bh);
+
+	if(!d){
+		*xored = 0;
+		return 0;
+	}
+	if(score_tab[bw * bh - d] + score_tab[d] - d >= best)
+		return best;
+	return block_cmp(src, stride, src2, stride2, bw, bh, xored);
+}
+
+/* Tries motion vector (DX,DY) and makes it the current one if it scores lower
+   than *BV. Returns TRUE if it did. */
+static int try_mv(UBYTE *src, int sstride, UBYTE *prev, int pstride, int bw, int bh, int dx, int dy, int *bv, int *mx, int *my, int *xored)
+{
+	int txored, tv;
+
+	tv = block_score(src, sstride, prev + dx + dy * pstride, pstride, bw, bh, *bv, &txored);
+	if(tv < *bv){
+		*bv = tv;
+		*mx = dx;
+		*my = dy;
+		*xored = txored;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Finds the motion vector for the block at (X,Y). *MX,*MY hold the vector of
+   the block on the left on entry; AX,AY that of the block above. */
+static int motion_estimation(UBYTE *src, int sstride, UBYTE *prev, int pstride, int x, int y, int *mx, int *my, int ax, int ay, int *xored)
 {
-	int dx, dy, txored, tv, bv, bw, bh;
+	int dx, dy, bv, bw, bh;
 	int mx0, my0;
 
 	mx0 = *mx;
@@ -128,19 +213,38 @@ static int motion_estimation(UBYTE *src, int sstride, UBYTE *prev, int pstride,
 	bh = FFMIN(ZMBV_BLOCK, video_height - y);
 
 	/* Try (0,0) */
-	bv = block_cmp(src, sstride, prev, pstride, bw, bh, xored);
+	bv = block_score(src, sstride, prev, pstride, bw, bh, INT_MAX, xored);
 	*mx = *my = 0;
 	if(!bv) return 0;
 
 	/* Try previous block's MV (if not 0,0) */
 	if (mx0 || my0){
-		tv = block_cmp(src, sstride, prev + mx0 + my0 * pstride, pstride, bw, bh, &txored);
-		if(tv < bv){
-			bv = tv;
-			*mx = mx0;
-			*my = my0;
-			*xored = txored;
-			if(!bv) return 0;
+		if(try_mv(src, sstride, prev, pstride, bw, bh, mx0, my0, &bv, mx, my, xored) && !bv)
+			return 0;
+	}
+
+	if(ZMBV_fast_search){
+		/* Also try the MV of the block above, then walk downhill in steps of
+		   one pixel from the best vector so far */
+		if((ax || ay) && (ax != mx0 || ay != my0)){
+			if(try_mv(src, sstride, prev, pstride, bw, bh, ax, ay, &bv, mx, my, xored) && !bv)
+				return 0;
+		}
+		for(;;){
+			static const int diamond[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
+			int cx = *mx;
+			int cy = *my;
+			int k;
+
+			for(k = 0; k < 4; k++){
+				dx = cx + diamond[k][0];
+				dy = cy + diamond[k][1];
+				if(dx < -lrange || dx > urange || dy < -lrange || dy > urange) continue;
+				if(try_mv(src, sstride, prev, pstride, bw, bh, dx, dy, &bv, mx, my, xored) && !bv)
+					return 0;
+			}
+			if(*mx == cx && *my == cy)
+				return bv;
 		}
 	}
 
@@ -149,19 +253,78 @@ static int motion_estimation(UBYTE *src, int sstride, UBYTE *prev, int pstride,
 		for(dx = -lrange; dx <= urange; dx++){
 			if(!dx && !dy) continue; /* we already tested this block */
 			if(dx == mx0 && dy == my0) continue; /* this one too */
-			tv = block_cmp(src, sstride, prev + dx + dy * pstride, pstride, bw, bh, &txored);
-			if(tv < bv){
-				 bv = tv;
-				 *mx = dx;
-				 *my = dy;
-				 *xored = txored;
-				 if(!bv) return 0;
-			 }
-		 }
+			if(try_mv(src, sstride, prev, pstride, bw, bh, dx, dy, &bv, mx, my, xored) && !bv)
+				return 0;
+		}
 	}
 	return bv;
 }
 
+/* Finds the motion vector of block (BX,BY), predicting it from the vectors
+   LEFT and ABOVE (which may be NULL) of the neighbouring blocks. */
+static void estimate_block(int bx, int by, const block_motion_t *left, const block_motion_t *above)
+{
+	block_motion_t *m = &motion[by * blocks_x + bx];
+	int x = bx * ZMBV_BLOCK;
+	int y = by * ZMBV_BLOCK;
+
+	m->mx = left == NULL ? 0 : left->mx;
+	m->my = left == NULL ? 0 : left->my;
+	motion_estimation(motion_src + y * Screen_WIDTH + x, Screen_WIDTH, motion_prev + y * pstride + x, pstride, x, y,
+	                  &m->mx, &m->my, above == NULL ? 0 : above->mx, above == NULL ? 0 : above->my, &m->xored);
+}
+
+/* Estimates the motion of the blocks in one band of block rows. The first
+   block of the band is predicted as if it were the first of the frame. */
+static void estimate_band(int band, int bands, void *arg)
+{
+	int by0 = blocks_y * band / bands;
+	int by1 = blocks_y * (band + 1) / bands;
+	int bx, by;
+
+	for(by = by0; by < by1; by++){
+		for(bx = 0; bx < blocks_x; bx++){
+			int i = by * blocks_x + bx;
+			estimate_block(bx, by, i > by0 * blocks_x ? &motion[i - 1] : NULL, by > by0 ? &motion[i - blocks_x] : NULL);
+		}
+	}
+}
+
+/* Re-estimates the blocks of the band starting at block row BY0 that were
+   predicted from other vectors than in a single pass over the frame: first
+   the blocks whose left or upper neighbour is in the band above, then the
+   ones after them whose predictors changed as a result, until a row of
+   blocks comes out the same as before. */
+static void fix_band_start(int by0, int by1)
+{
+	block_motion_t *m = &motion[by0 * blocks_x];
+	int left_changed;
+	int bx, by;
+
+	/* what estimate_band used instead of the vectors from the band above */
+	left_changed = m[-1].mx || m[-1].my;
+	for(bx = 0; bx < blocks_x; bx++)
+		band_changed[bx] = ZMBV_fast_search && (m[bx - blocks_x].mx || m[bx - blocks_x].my);
+
+	for(by = by0; by < by1; by++){
+		int any_changed = FALSE;
+		for(bx = 0; bx < blocks_x; bx++, m++){
+			if(left_changed || band_changed[bx]){
+				int mx = m->mx;
+				int my = m->my;
+				estimate_block(bx, by, m - 1, m - blocks_x);
+				band_changed[bx] = m->mx != mx || m->my != my;
+				any_changed |= band_changed[bx];
+			}
+			else
+				band_changed[bx] = FALSE;
+			left_changed = band_changed[bx];
+		}
+		if(!any_changed)
+			break;
+	}
+}
+
 static int ZMBV_CreateFrame(UBYTE *source, int keyframe, UBYTE *buf, int bufsize)
 {
 	UBYTE *src;
@@ -169,7 +332,6 @@ static int ZMBV_CreateFrame(UBYTE *source, int keyframe, UBYTE *buf, int bufsize
 	UBYTE *work;
 	int fl;
 	int work_size = 0;
-	int bw, bh;
 	int i, j;
 	int size;
 
@@ -210,31 +372,34 @@ static int ZMBV_CreateFrame(UBYTE *source, int keyframe, UBYTE *buf, int bufsize
 			work_size += video_width;
 		}
 	}else{
-		int x, y, bh2, bw2, xored;
-		UBYTE *tsrc;
-		UBYTE *tprev;
 		UBYTE *mv;
-		int mx = 0, my = 0;
+		block_motion_t *m;
+		int x, y, bh2, bw2;
+		int bands;
 
-		bw = (video_width + ZMBV_BLOCK - 1) / ZMBV_BLOCK;
-		bh = (video_height + ZMBV_BLOCK - 1) / ZMBV_BLOCK;
 		mv = work + work_size;
-		memset(work + work_size, 0, (bw * bh * 2 + 3) & ~3);
-		work_size += (bw * bh * 2 + 3) & ~3;
+		work_size += (blocks_x * blocks_y * 2 + 3) & ~3;
+		memset(mv, 0, work + work_size - mv);
+
+		motion_src = src;
+		motion_prev = prev;
+		bands = CODECS_VIDEO_Bands(blocks_y);
+		CODECS_VIDEO_RunBands(bands, estimate_band, NULL);
+		for(i = 1; i < bands; i++)
+			fix_band_start(blocks_y * i / bands, blocks_y * (i + 1) / bands);
+
 		/* for now just XOR'ing */
+		m = motion;
 		for(y = 0; y < video_height; y += ZMBV_BLOCK) {
 			bh2 = FFMIN(video_height - y, ZMBV_BLOCK);
-			for(x = 0; x < video_width; x += ZMBV_BLOCK, mv += 2) {
-				bw2 = FFMIN(video_width - x, ZMBV_BLOCK);
+			for(x = 0; x < video_width; x += ZMBV_BLOCK, mv += 2, m++) {
+				UBYTE *tsrc = src + x;
+				UBYTE *tprev = prev + x + m->mx + m->my * pstride;
 
-				tsrc = src + x;
-				tprev = prev + x;
-
-				motion_estimation(tsrc, Screen_WIDTH, tprev, pstride, x, y, &mx, &my, &xored);
-				mv[0] = (mx * 2) | !!xored;
-				mv[1] = my * 2;
-				tprev += mx + my * pstride;
-				if(xored){
+				bw2 = FFMIN(video_width - x, ZMBV_BLOCK);
+				mv[0] = (m->mx * 2) | !!m->xored;
+				mv[1] = m->my * 2;
+				if(m->xored){
 					for(j = 0; j < bh2; j++){
 						for(i = 0; i < bw2; i++)
 							work[work_size++] = tsrc[i] ^ tprev[i];
@@ -286,6 +451,8 @@ static int ZMBV_CreateFrame(UBYTE *source, int keyframe, UBYTE *buf, int bufsize
 static int ZMBV_End(void)
 {
 	free(prev_buf);
+	free(motion);
+	free(band_changed);
 #ifdef HAVE_LIBZ
 	if (zlib_init_ok) {
 		free(work_buf);
@@ -327,6 +494,11 @@ static int ZMBV_Init(int width, int height, int left_margin, int top_margin)
 	/* Motion estimation range: maximum distance is -64..63 */
 	lrange = urange = 2;
 
+	blocks_x = (video_width + ZMBV_BLOCK - 1) / ZMBV_BLOCK;
+	blocks_y = (video_height + ZMBV_BLOCK - 1) / ZMBV_BLOCK;
+	motion = (block_motion_t *)Util_malloc(blocks_x * blocks_y * sizeof(block_motion_t));
+	band_changed = (UBYTE *)Util_malloc(blocks_x);
+
 	work_size = video_width * video_height + 1024 +
 		((video_width + ZMBV_BLOCK - 1) / ZMBV_BLOCK) * ((video_height + ZMBV_BLOCK - 1) / ZMBV_BLOCK) * 2 + 4;
 
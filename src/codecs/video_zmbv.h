@@ -6,5 +6,9 @@
 
 extern VIDEO_CODEC_t Video_Codec_ZMBV;
 
+/* TRUE to search motion vectors near the predicted ones only, which is much
+   faster but may compress slightly worse than searching the whole range. */
+extern int ZMBV_fast_search;
+
 #endif /* CODECS_VIDEO_ZMBV_H_ */
 
@@ -28,6 +28,7 @@
 
 	Define CPU65C02 if you don't want 6502 JMP() bug emulation.
 	Define CYCLES_PER_OPCODE to update ANTIC_xpos in each opcode's emulation.
+	Define DECODE_CACHE to keep the instructions pre-decoded (needs PAGED_ATTRIB).
 	Define MONITOR_BREAK if you want code breakpoints and execution history.
 	Define MONITOR_BREAKPOINTS if you want user-defined breakpoints.
 	Define MONITOR_PROFILE if you want 6502 opcode profiling.
@@ -68,6 +69,9 @@
 #include "esc.h"
 #include "memory.h"
 #include "monitor.h"
+#ifdef MONITOR_TRACE
+#include "cputrace.h"
+#endif
 #ifndef BASIC
 #include "statesav.h"
 #ifndef __PLUS
@@ -124,6 +128,19 @@ UBYTE CPU_delayed_nmi;
 /* If PREFETCH_CODE is defined, 2 bytes after the opcode are always fetched. */
 /* #define PREFETCH_CODE */
 
+/* If DECODE_CACHE is defined, the opcode, its cycles, its handler and the 2
+   bytes after it are kept in MEMORY_decode_map for each address the code runs
+   from, and fetched from there as long as the memory doesn't change. */
+#ifdef DECODE_CACHE
+#if defined(PC_PTR) || defined(FALCON_CPUASM)
+#error DECODE_CACHE does not work with PC_PTR or FALCON_CPUASM
+#endif
+/* The CPU stores directly only into zero page and the stack, which are
+   never decoded. */
+#undef MEMORY_dPutByte
+#define MEMORY_dPutByte(x, y)	(MEMORY_mem[x] = y)
+#endif
+
 
 /* 6502 stack handling */
 #define PL                  MEMORY_dGetByte(0x0100 + ++S)
@@ -232,8 +249,8 @@ void CPU_PutStatus(void)
 #else
 #define zGetWord(x) MEMORY_dGetWord(x)
 #endif
-#ifdef PREFETCH_CODE
-#if defined(WORDS_BIGENDIAN) || !defined(WORDS_UNALIGNED_OK)
+#if defined(PREFETCH_CODE) || defined(DECODE_CACHE)
+#if defined(PREFETCH_CODE) && (defined(WORDS_BIGENDIAN) || !defined(WORDS_UNALIGNED_OK))
 #warning PREFETCH_CODE is efficient only on little-endian machines with WORDS_UNALIGNED_OK
 #endif
 #define OP_BYTE     ((UBYTE) addr)
@@ -247,7 +264,7 @@ void CPU_PutStatus(void)
 #define INDIRECT_Y  PC++; addr &= 0xff; addr = zGetWord(addr) + Y
 #define ZPAGE_X     PC++; addr = (UBYTE) (addr + X)
 #define ZPAGE_Y     PC++; addr = (UBYTE) (addr + Y)
-#else /* PREFETCH_CODE */
+#else /* defined(PREFETCH_CODE) || defined(DECODE_CACHE) */
 #define OP_BYTE     PEEK_CODE_BYTE()
 #define OP_WORD     PEEK_CODE_WORD()
 #define IMMEDIATE   GET_CODE_BYTE()
@@ -259,7 +276,7 @@ void CPU_PutStatus(void)
 #define INDIRECT_Y  addr = GET_CODE_BYTE(); addr = zGetWord(addr) + Y
 #define ZPAGE_X     addr = (UBYTE) (GET_CODE_BYTE() + X)
 #define ZPAGE_Y     addr = (UBYTE) (GET_CODE_BYTE() + Y)
-#endif /* PREFETCH_CODE */
+#endif /* defined(PREFETCH_CODE) || defined(DECODE_CACHE) */
 
 /* Instructions */
 #define AND(t_data) Z = N = A &= t_data
@@ -381,6 +398,10 @@ void CPU_NMI(void)
 	CPU_regS = S;
 	ANTIC_xpos += 7; /* handling an interrupt by 6502 takes 7 cycles */
 	INC_RET_NESTING;
+#ifdef MONITOR_PROFILE
+	if (MONITOR_cycle_profile)
+		MONITOR_CycleProfileInterrupt(7, S, CPU_regPC);
+#endif
 }
 
 /* avoid copy&pasting whole CPUCHECKIRQ */
@@ -392,18 +413,41 @@ void CPU_NMI(void)
 #define CPUCHECKIRQ_RESTORE_S	CPU_regS = S
 #endif
 
-/* Check pending IRQ, helps in (not only) Lucasfilm games */
-#define CPUCHECKIRQ \
+#if defined(MONITOR_PROFILE) && !defined(FALCON_CPUASM)
+/* Charges the cycles of the instruction taking the interrupt to the code
+   that executed it, before the interrupt frame is pushed. */
+#define CPUCHECKIRQ_PROFILE_INSN \
+		if (MONITOR_cycle_profile) { \
+			MONITOR_CycleProfileInsn(old_insn, ANTIC_xpos - profile_xpos, S, GET_PC()); \
+			profile_xpos = ANTIC_xpos; \
+		}
+#define CPUCHECKIRQ_PROFILE(cycles) \
+		if (MONITOR_cycle_profile) \
+			MONITOR_CycleProfileInterrupt(cycles, S, GET_PC());
+#else
+#define CPUCHECKIRQ_PROFILE_INSN
+#define CPUCHECKIRQ_PROFILE(cycles)
+#endif
+#define CPUCHECKIRQ_PROFILE_NONE
+
+/* Check pending IRQ, helps in (not only) Lucasfilm games.
+   PROFILE_INSN is done before the interrupt frame is pushed. CYCLES is what
+   the cycle profiler charges for taking the interrupt: inside an instruction
+   the 7 cycles are counted at the end of the instruction. */
+#define CPUCHECKIRQ_TAKE(profile_insn, cycles) \
 	if (CPU_IRQ && !(CPU_regP & CPU_I_FLAG) && ANTIC_xpos < ANTIC_xpos_limit) { \
 		CPUCHECKIRQ_SAVE_S; \
+		profile_insn \
 		PHPC; \
 		PHPB0; \
 		CPU_SetI; \
 		SET_PC(MEMORY_dGetWordAligned(0xfffe)); \
+		CPUCHECKIRQ_PROFILE(cycles) \
 		CPUCHECKIRQ_RESTORE_S; \
 		ANTIC_xpos += 7; \
 		INC_RET_NESTING; \
 	}
+#define CPUCHECKIRQ CPUCHECKIRQ_TAKE(CPUCHECKIRQ_PROFILE_INSN, 0)
 
 #ifndef FALCON_CPUASM
 
@@ -560,6 +604,11 @@ void CPU_GO(int limit)
 	UWORD addr;
 	UBYTE data;
 #define insn data
+#ifdef DECODE_CACHE
+	const MEMORY_decoded_t *decoded;
+	/* for the instructions that aren't kept */
+	static MEMORY_decoded_t decoded_once;
+#endif
 
 #else /* FALCON_CPUASM */
 
@@ -578,6 +627,9 @@ void CPU_GO(int limit)
    2. The timing of the IRQs are not that critical. */
 
 	if (ANTIC_wsync_halt) {
+#ifdef MONITOR_PROFILE
+		int halt_xpos = ANTIC_xpos;
+#endif
 
 #ifdef NEW_CYCLE_EXACT
 		if (ANTIC_DRAWING_SCREEN) {
@@ -608,19 +660,26 @@ void CPU_GO(int limit)
 #endif /* NEW_CYCLE_EXACT */
 
 		ANTIC_wsync_halt = 0;
+#ifdef MONITOR_PROFILE
+		if (MONITOR_cycle_profile)
+			MONITOR_CycleProfileWait(ANTIC_xpos - halt_xpos);
+#endif
 	}
 	ANTIC_xpos_limit = limit;			/* needed for WSYNC store inside ANTIC */
 
 	UPDATE_LOCAL_REGS;
 
-	CPUCHECKIRQ;
+	CPUCHECKIRQ_TAKE(CPUCHECKIRQ_PROFILE_NONE, 7);
 
 #ifndef FALCON_CPUASM
 	while (ANTIC_xpos < ANTIC_xpos_limit) {
 		CPU_delayed_nmi = 0;
 #ifdef MONITOR_PROFILE
 		int old_xpos = ANTIC_xpos;
+		/* start of the cycles not charged to the cycle profiler yet */
+		int profile_xpos = ANTIC_xpos;
 		UWORD old_PC = GET_PC();
+		UBYTE old_insn;
 #endif
 
 
@@ -657,6 +716,15 @@ void CPU_GO(int limit)
 				(Z == 0) ? 'Z' : '-',
 				(C != 0) ? 'C' : '-');
 		}
+		if (CPUTRACE_active) {
+			CPUTRACE_Add(GET_PC(), A, X, Y, S, (UBYTE) ((N & 0x80) +
+#ifndef NO_V_FLAG_VARIABLE
+				(V ? 0x40 : 0) + (CPU_regP & 0x0c)
+#else
+				(CPU_regP & 0x4c)
+#endif
+				+ ((Z == 0) ? 0x02 : 0) + C + 0x30));
+		}
 #endif
 
 #ifdef MONITOR_BREAK
@@ -681,17 +749,50 @@ void CPU_GO(int limit)
 		MEMORY_mem[0x10000] = MEMORY_mem[0];
 #endif
 
+#ifdef DECODE_CACHE
+		decoded = MEMORY_decode_map[PC >> 8];
+		if (decoded == NULL || decoded[PC & 0xff].cycles == 0) {
+			MEMORY_decoded_t *entry = &decoded_once;
+			if (decoded == NULL && !MEMORY_decode_off[PC >> 8])
+				decoded = MEMORY_DecodePage(PC >> 8);
+			/* the operand of an instruction at 0xfe or 0xff may be in the
+			   next page, whose stores are not seen by this one */
+			if (decoded != NULL && (PC & 0xff) < 0xfe)
+				entry = MEMORY_decode_map[PC >> 8] + (PC & 0xff);
+			entry->code = MEMORY_dGetByte(PC);
+			entry->operand = MEMORY_dGetWord(PC + 1);
+			entry->cycles = (UBYTE) cycles[entry->code];
+#ifndef NO_GOTO
+			entry->handler = opcode[entry->code];
+#endif
+			decoded = entry;
+		}
+		else
+			decoded += PC & 0xff;
+		insn = decoded->code;
+		PC++;
+#else /* DECODE_CACHE */
 		insn = GET_CODE_BYTE();
+#endif /* DECODE_CACHE */
 
 #ifdef MONITOR_BREAKPOINTS
 #ifdef MONITOR_BREAK
-		if (MONITOR_breakpoint_table_size > 0 && MONITOR_breakpoints_enabled && !MONITOR_break_step)
+		if (MONITOR_breakpoint_checks != 0 && !MONITOR_break_step)
 #else
-		if (MONITOR_breakpoint_table_size > 0 && MONITOR_breakpoints_enabled)
+		if (MONITOR_breakpoint_checks != 0)
 #endif
 		{
 			UBYTE optype = MONITOR_optype6502[insn];
 			int i;
+			/* the bitmaps compiled by MONITOR_CompileBreakpoints tell
+			   whether the table needs to be checked for this instruction */
+			int check = MONITOR_breakpoint_checks & MONITOR_BREAKPOINT_CHECK_ALWAYS;
+			if (!check && (MONITOR_breakpoint_checks & MONITOR_BREAKPOINT_CHECK_PC)) {
+				UWORD pc = (UWORD) (GET_PC() - 1);
+				check = MONITOR_BREAKPOINT_MAP_TEST(MONITOR_breakpoint_pc_map, pc);
+			}
+			if (!check && ((MONITOR_breakpoint_checks & MONITOR_BREAKPOINT_CHECK_ACCESS) == 0 || (optype & 12) == 0))
+				goto no_breakpoint;
 			switch (optype >> 4) {
 			case 1:
 				addr = PEEK_CODE_WORD();
@@ -724,6 +825,14 @@ void CPU_GO(int limit)
 				addr = 0;
 				break;
 			}
+			if (!check) {
+				if ((optype & 4) != 0 && MONITOR_BREAKPOINT_MAP_TEST(MONITOR_breakpoint_read_map, addr))
+					check = TRUE;
+				else if ((optype & 8) != 0 && MONITOR_BREAKPOINT_MAP_TEST(MONITOR_breakpoint_write_map, addr))
+					check = TRUE;
+				else
+					goto no_breakpoint;
+			}
 			for (i = 0; i < MONITOR_breakpoint_table_size; i++) {
 				int cond;
 				int value, m_addr;
@@ -852,21 +961,30 @@ void CPU_GO(int limit)
 #endif /* MONITOR_BREAKPOINTS */
 
 #ifndef CYCLES_PER_OPCODE
+#ifdef DECODE_CACHE
+		ANTIC_xpos += decoded->cycles;
+#else
 		ANTIC_xpos += cycles[insn];
 #endif
+#endif
 
 #ifdef MONITOR_PROFILE
 		CPU_instruction_count[insn]++;
 		MONITOR_coverage[old_PC = PC - 1].count++;
+		old_insn = insn;
 		MONITOR_coverage_insns++;
 #endif
 
-#ifdef PREFETCH_CODE
+#ifdef DECODE_CACHE
+		addr = decoded->operand;
+#elif defined(PREFETCH_CODE)
 		addr = PEEK_CODE_WORD();
 #endif
 
 #ifdef NO_GOTO
 		switch (insn) {
+#elif defined(DECODE_CACHE)
+		goto *decoded->handler;
 #else
 		goto *opcode[insn];
 #endif
@@ -2432,6 +2550,16 @@ void CPU_GO(int limit)
 			int cyc = ANTIC_xpos - old_xpos;
 			MONITOR_coverage[old_PC].cycles += cyc;
 			MONITOR_coverage_cycles += cyc;
+			if (MONITOR_cycle_profile) {
+				cyc = ANTIC_xpos - profile_xpos;
+				/* a write to WSYNC skips to the end of this CPU_GO call */
+				if (ANTIC_wsync_halt && cyc > cycles[old_insn]) {
+					MONITOR_CycleProfileInsn(old_insn, cycles[old_insn], S, GET_PC());
+					MONITOR_CycleProfileWait(cyc - cycles[old_insn]);
+				}
+				else
+					MONITOR_CycleProfileInsn(old_insn, cyc, S, GET_PC());
+			}
 		}
 #endif
 
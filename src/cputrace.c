@@ -0,0 +1,245 @@
+/*
+ * cputrace.c - binary trace of the executed 6502 instructions
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "antic.h"
+#include "atari.h"
+#include "cputrace.h"
+#include "log.h"
+#include "memory.h"
+#include "util.h"
+
+/* A trace file is the 8 bytes "A8TRACE1" followed by RECORD_SIZE byte
+   records:
+   0-1   PC (little endian)
+   2-4   opcode and the two bytes after it
+   5-9   A, X, Y, S, P
+   10-11 ANTIC_ypos (little endian)
+   12-13 ANTIC_XPOS (little endian)
+   14-15 reserved, 0
+
+   The records are collected in a ring of RING_RECORDS records. With
+   MONITOR_TRACE_THREAD a writer thread writes them to the file while the
+   emulation goes on; the emulation only waits when the ring is full. The
+   ring has a single producer (CPU_GO) and a single consumer (the writer),
+   each of which only moves its own position, so adding a record needs no
+   lock. The positions run freely and are reduced modulo RING_RECORDS (a
+   power of 2) to index the ring. The writer waits on a condition variable
+   while the ring is empty, and is woken every WAKE_RECORDS records and when
+   the trace is closed; the emulation waits on another one while the ring is
+   full. Without the thread the ring is written out whenever it fills up. */
+
+#define TRACE_MAGIC "A8TRACE1"
+#define RECORD_SIZE 16
+#define RING_RECORDS (1 << 20)
+#define WAKE_RECORDS (1 << 12)
+
+#if defined(MONITOR_TRACE_THREAD) && defined(__ATOMIC_ACQUIRE)
+#define TRACE_THREAD
+#include <pthread.h>
+#define TRACE_LOAD(pos)          __atomic_load_n(&(pos), __ATOMIC_ACQUIRE)
+#define TRACE_STORE(pos, value)  __atomic_store_n(&(pos), (value), __ATOMIC_RELEASE)
+#else
+#define TRACE_LOAD(pos)          (pos)
+#define TRACE_STORE(pos, value)  ((pos) = (value))
+#endif
+
+int CPUTRACE_active = FALSE;
+
+static FILE *trace_file = NULL;
+static UBYTE *ring = NULL;
+static unsigned int write_pos;
+static unsigned int read_pos;
+/* read_pos as last seen by the producer; there's at least this much space */
+static unsigned int known_read_pos;
+
+#ifdef TRACE_THREAD
+static pthread_t writer_thread;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t records_added = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t records_written = PTHREAD_COND_INITIALIZER;
+static int stop_writer;
+#endif
+
+/* Writes the records between READ and WRITE, up to the end of the ring.
+   Returns the new read position. */
+static unsigned int WriteRecords(unsigned int read, unsigned int write)
+{
+	unsigned int index = read & (RING_RECORDS - 1);
+	unsigned int count = write - read;
+	if (count > RING_RECORDS - index)
+		count = RING_RECORDS - index;
+	if (fwrite(ring + index * RECORD_SIZE, RECORD_SIZE, count, trace_file) != count)
+		Log_print("Error writing the trace file");
+	return read + count;
+}
+
+#ifdef TRACE_THREAD
+static void *WriterThread(void *arg)
+{
+	for (;;) {
+		unsigned int write;
+
+		pthread_mutex_lock(&trace_mutex);
+		while ((write = TRACE_LOAD(write_pos)) == read_pos && !stop_writer)
+			pthread_cond_wait(&records_added, &trace_mutex);
+		pthread_mutex_unlock(&trace_mutex);
+		/* the producer stops adding records before it sets stop_writer */
+		if (write == read_pos)
+			break;
+		TRACE_STORE(read_pos, WriteRecords(read_pos, write));
+
+		pthread_mutex_lock(&trace_mutex);
+		pthread_cond_signal(&records_written);
+		pthread_mutex_unlock(&trace_mutex);
+	}
+	return NULL;
+}
+#endif /* TRACE_THREAD */
+
+int CPUTRACE_Open(const char *filename)
+{
+	CPUTRACE_Close();
+	trace_file = fopen(filename, "wb");
+	if (trace_file == NULL)
+		return FALSE;
+	fwrite(TRACE_MAGIC, 1, 8, trace_file);
+	if (ring == NULL)
+		ring = (UBYTE *) Util_malloc(RING_RECORDS * RECORD_SIZE);
+	write_pos = read_pos = known_read_pos = 0;
+#ifdef TRACE_THREAD
+	stop_writer = FALSE;
+	if (pthread_create(&writer_thread, NULL, WriterThread, NULL) != 0) {
+		Log_print("Cannot start the trace writer thread");
+		fclose(trace_file);
+		trace_file = NULL;
+		return FALSE;
+	}
+#endif
+	CPUTRACE_active = TRUE;
+	return TRUE;
+}
+
+void CPUTRACE_Close(void)
+{
+	if (trace_file == NULL)
+		return;
+	CPUTRACE_active = FALSE;
+#ifdef TRACE_THREAD
+	pthread_mutex_lock(&trace_mutex);
+	stop_writer = TRUE;
+	pthread_cond_signal(&records_added);
+	pthread_mutex_unlock(&trace_mutex);
+	pthread_join(writer_thread, NULL);
+#else
+	while (read_pos != write_pos)
+		read_pos = WriteRecords(read_pos, write_pos);
+#endif
+	fclose(trace_file);
+	trace_file = NULL;
+	free(ring);
+	ring = NULL;
+}
+
+void CPUTRACE_Add(UWORD pc, UBYTE a, UBYTE x, UBYTE y, UBYTE s, UBYTE p)
+{
+	UBYTE *r;
+	int xpos = ANTIC_XPOS;
+
+	if (write_pos - known_read_pos == RING_RECORDS) {
+#ifdef TRACE_THREAD
+		pthread_mutex_lock(&trace_mutex);
+		while ((known_read_pos = TRACE_LOAD(read_pos)) == write_pos - RING_RECORDS)
+			pthread_cond_wait(&records_written, &trace_mutex);
+		pthread_mutex_unlock(&trace_mutex);
+#else
+		while (read_pos != write_pos)
+			read_pos = WriteRecords(read_pos, write_pos);
+		known_read_pos = read_pos;
+#endif
+	}
+	r = ring + (write_pos & (RING_RECORDS - 1)) * RECORD_SIZE;
+	r[0] = (UBYTE) pc;
+	r[1] = (UBYTE) (pc >> 8);
+	r[2] = MEMORY_SafeGetByte(pc);
+	r[3] = MEMORY_SafeGetByte((UWORD) (pc + 1));
+	r[4] = MEMORY_SafeGetByte((UWORD) (pc + 2));
+	r[5] = a;
+	r[6] = x;
+	r[7] = y;
+	r[8] = s;
+	r[9] = p;
+	r[10] = (UBYTE) ANTIC_ypos;
+	r[11] = (UBYTE) (ANTIC_ypos >> 8);
+	r[12] = (UBYTE) xpos;
+	r[13] = (UBYTE) (xpos >> 8);
+	r[14] = r[15] = 0;
+	TRACE_STORE(write_pos, write_pos + 1);
+#ifdef TRACE_THREAD
+	if ((write_pos & (WAKE_RECORDS - 1)) == 0) {
+		pthread_mutex_lock(&trace_mutex);
+		pthread_cond_signal(&records_added);
+		pthread_mutex_unlock(&trace_mutex);
+	}
+#endif
+}
+
+FILE *CPUTRACE_OpenRead(const char *filename)
+{
+	char magic[8];
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return NULL;
+	if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+int CPUTRACE_Read(FILE *fp, CPUTRACE_record *record)
+{
+	UBYTE r[RECORD_SIZE];
+	if (fread(r, 1, RECORD_SIZE, fp) != RECORD_SIZE)
+		return FALSE;
+	record->pc = r[0] | (r[1] << 8);
+	record->insn[0] = r[2];
+	record->insn[1] = r[3];
+	record->insn[2] = r[4];
+	record->a = r[5];
+	record->x = r[6];
+	record->y = r[7];
+	record->s = r[8];
+	record->p = r[9];
+	record->ypos = r[10] | (r[11] << 8);
+	record->xpos = r[12] | (r[13] << 8);
+	return TRUE;
+}
+
+/*
+vim:ts=4:sw=4:
+*/
@@ -0,0 +1,45 @@
+#ifndef CPUTRACE_H_
+#define CPUTRACE_H_
+
+#include "config.h"
+#include <stdio.h>
+
+#include "atari.h"
+
+/* Binary 6502 trace. While it is active, CPU_GO appends a record of every
+   executed instruction to a ring in memory, which is written to the trace
+   file in the background. The monitor's TRACEDECODE command turns a binary
+   trace into the text written by TRACE. */
+
+/* One executed instruction. P is the processor status as pushed by PHP. */
+typedef struct {
+	UWORD pc;
+	UBYTE insn[3];   /* opcode and the two bytes after it */
+	UBYTE a;
+	UBYTE x;
+	UBYTE y;
+	UBYTE s;
+	UBYTE p;
+	int ypos;
+	int xpos;
+} CPUTRACE_record;
+
+/* TRUE while a binary trace is being written. */
+extern int CPUTRACE_active;
+
+/* Starts writing a binary trace to FILENAME. Returns FALSE on error. */
+int CPUTRACE_Open(const char *filename);
+/* Writes out the rest of the trace and closes the file. */
+void CPUTRACE_Close(void);
+
+/* Records the instruction at PC about to be executed. */
+void CPUTRACE_Add(UWORD pc, UBYTE a, UBYTE x, UBYTE y, UBYTE s, UBYTE p);
+
+/* Opens a binary trace for reading. Returns NULL if FILENAME can't be opened
+   or is not a binary trace. */
+FILE *CPUTRACE_OpenRead(const char *filename);
+/* Reads the next record of a trace opened with CPUTRACE_OpenRead into
+   RECORD. Returns FALSE at the end of the file. */
+int CPUTRACE_Read(FILE *fp, CPUTRACE_record *record);
+
+#endif /* CPUTRACE_H_ */
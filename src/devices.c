@@ -996,6 +996,37 @@ static void Devices_H_Close(void)
 	CPU_ClrN;
 }
 
+/* CIO carries out GET CHARACTERS and PUT CHARACTERS by calling the handler
+   for every byte, using ICBALZ/ICBAHZ as the buffer pointer and
+   ICBLLZ/ICBLHZ as the count of bytes left. When the H: handler is called
+   from such a loop, it moves all but the last byte of the buffer itself and
+   advances the pointer and the count past them; CIO's loop then handles the
+   last byte as usual and sets ICBLL/ICBLH and the status. This returns the
+   number of bytes that can be moved that way, or 0 if the handler wasn't
+   called for a block transfer. */
+static int Devices_H_BurstLength(int command)
+{
+	UWORD addr = MEMORY_dGetWordAligned(Devices_ICBALZ);
+	int length = MEMORY_dGetWordAligned(Devices_ICBLLZ);
+	if ((MEMORY_dGetByte(Devices_ICCOMZ) & 0xfe) != command
+	 || MEMORY_dGetByte(Devices_IOCB0 + (h_iocb << 4) + Devices_ICCOM) != MEMORY_dGetByte(Devices_ICCOMZ)
+	 || length < 2)
+		return 0;
+	length--;
+	/* don't wrap around the end of memory */
+	if (length > 0x10000 - addr)
+		length = 0x10000 - addr;
+	return length;
+}
+
+static void Devices_H_BurstDone(int length)
+{
+	MEMORY_dPutWordAligned(Devices_ICBALZ, (UWORD) (MEMORY_dGetWordAligned(Devices_ICBALZ) + length));
+	MEMORY_dPutWordAligned(Devices_ICBLLZ, (UWORD) (MEMORY_dGetWordAligned(Devices_ICBLLZ) - length));
+}
+
+static UBYTE h_burst_buffer[0x10000];
+
 static void Devices_H_Read(void)
 {
 	if (devbug)
@@ -1010,6 +1041,16 @@ static void Devices_H_Read(void)
 			h_lastbyte[h_iocb] = fgetc(h_fp[h_iocb]);
 			h_lastop[h_iocb] = 'r';
 		}
+		if (!h_textmode[h_iocb] && h_lastbyte[h_iocb] != EOF) {
+			int length = Devices_H_BurstLength(0x06);
+			if (length > 0) {
+				h_burst_buffer[0] = (UBYTE) h_lastbyte[h_iocb];
+				length = 1 + fread(h_burst_buffer + 1, 1, length - 1, h_fp[h_iocb]);
+				MEMORY_CopyToMem(h_burst_buffer, MEMORY_dGetWordAligned(Devices_ICBALZ), length);
+				Devices_H_BurstDone(length);
+				h_lastbyte[h_iocb] = fgetc(h_fp[h_iocb]);
+			}
+		}
 		ch = h_lastbyte[h_iocb];
 		if (ch != EOF) {
 			if (h_textmode[h_iocb]) {
@@ -1077,6 +1118,22 @@ static void Devices_H_Write(void)
 		if (ch == 0x9b && h_textmode[h_iocb])
 			ch = '\n';
 		fputc(ch, h_fp[h_iocb]);
+		/* CPU_regA is the first byte of the buffer; the rest but the last
+		   one follow */
+		{
+			int length = Devices_H_BurstLength(0x0a) - 1;
+			if (length > 0) {
+				MEMORY_CopyFromMem((UWORD) (MEMORY_dGetWordAligned(Devices_ICBALZ) + 1), h_burst_buffer, length);
+				if (h_textmode[h_iocb]) {
+					int i;
+					for (i = 0; i < length; i++)
+						if (h_burst_buffer[i] == 0x9b)
+							h_burst_buffer[i] = '\n';
+				}
+				fwrite(h_burst_buffer, 1, length, h_fp[h_iocb]);
+				Devices_H_BurstDone(length);
+			}
+		}
 		CPU_regY = 1;
 		CPU_ClrN;
 	}
@@ -22,8 +22,13 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef RECORDING_THREAD
+#include <pthread.h>
+#endif
 #include "file_export.h"
 #include "screen.h"
 #include "colours.h"
@@ -39,6 +44,7 @@
 #include "codecs/container.h"
 
 #ifdef AUDIO_RECORDING
+#include "pokeysnd.h"
 #include "codecs/audio.h"
 #endif
 
@@ -75,6 +81,44 @@ static int video_no_last = -1;
 static int video_no_max = 0;
 #endif /* VIDEO_RECORDING */
 
+#ifdef RECORDING_THREAD
+/* Recorded audio and video are copied into a queue and encoded by a thread of
+   their own, so compressing and writing them doesn't hold up the emulation.
+   Each item in the queue is either a copy of Screen_atari or a block of audio
+   samples, and the encoder passes them to the container in the order they
+   were produced. There are two items per queued frame of emulation. When the
+   queue is full the emulator waits for the encoder, or, if
+   FILE_EXPORT_drop_frames is set, drops the video frame. Dropped frames are
+   stored as empty frames repeating the previous one, so the video stays in
+   step with the audio; audio is never dropped. */
+#define MAX_QUEUE_LENGTH 100
+int FILE_EXPORT_queue_length = 16;
+int FILE_EXPORT_drop_frames = FALSE;
+
+enum { QUEUE_VIDEO, QUEUE_AUDIO };
+
+typedef struct {
+	int type;
+	UBYTE *data;
+	int data_size;      /* bytes allocated for data */
+	int num_samples;    /* for audio */
+	int dropped_before; /* video frames dropped just before this one */
+} queue_item_t;
+
+static queue_item_t *queue = NULL;    /* NULL when encoding in the emulator thread */
+static int queue_slots;
+static int queue_head;                /* next item for the encoder */
+static int queue_count;               /* items waiting for the encoder */
+static int queue_stop;                /* encoder exits when the queue is empty */
+static int encoder_failed;
+static int dropped_frames;            /* dropped since the last queued video frame */
+static int total_dropped_frames;
+static pthread_t encoder_thread;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+#endif /* RECORDING_THREAD */
+
 #endif /* defined(AUDIO_RECORDING) || defined(VIDEO_RECORDING) */
 
 
@@ -115,6 +159,22 @@ int File_Export_Initialise(int *argc, char *argv[])
 				video_no_max = Util_filenamepattern(argv[++i], video_filename_format, FILENAME_MAX, DEFAULT_VIDEO_FILENAME_FORMAT);
 			else a_m = TRUE;
 		}
+#endif
+#ifdef RECORDING_THREAD
+		else if (strcmp(argv[i], "-record-queue") == 0) {
+			if (i_a) {
+				FILE_EXPORT_queue_length = Util_sscandec(argv[++i]);
+				if (FILE_EXPORT_queue_length < 0 || FILE_EXPORT_queue_length > MAX_QUEUE_LENGTH) {
+					Log_print("Invalid recording queue length - must be between 0 and %d", MAX_QUEUE_LENGTH);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-record-drop") == 0)
+			FILE_EXPORT_drop_frames = TRUE;
+		else if (strcmp(argv[i], "-record-wait") == 0)
+			FILE_EXPORT_drop_frames = FALSE;
 #endif
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
@@ -127,6 +187,13 @@ int File_Export_Initialise(int *argc, char *argv[])
 #endif
 #ifdef VIDEO_RECORDING
 				Log_print("\t-vname <p>       Set filename pattern for video recording");
+#endif
+#ifdef RECORDING_THREAD
+				Log_print("\t-record-queue <n>");
+				Log_print("\t                 Encode recordings in a separate thread, queueing up to n");
+				Log_print("\t                 frames (0-%d, 0 encodes in the emulation thread, default 16)", MAX_QUEUE_LENGTH);
+				Log_print("\t-record-drop     Drop video frames while the recording queue is full");
+				Log_print("\t-record-wait     Wait while the recording queue is full (default)");
 #endif
 			}
 			argv[j++] = argv[i];
@@ -164,6 +231,20 @@ int File_Export_ReadConfig(char *string, char *ptr)
 		else return FALSE;
 	}
 #endif
+#ifdef RECORDING_THREAD
+	else if (strcmp(string, "RECORDING_QUEUE_LENGTH") == 0) {
+		int num = Util_sscandec(ptr);
+		if (num >= 0 && num <= MAX_QUEUE_LENGTH)
+			FILE_EXPORT_queue_length = num;
+		else return FALSE;
+	}
+	else if (strcmp(string, "RECORDING_DROP_FRAMES") == 0) {
+		int num = Util_sscanbool(ptr);
+		if (num >= 0)
+			FILE_EXPORT_drop_frames = num;
+		else return FALSE;
+	}
+#endif
 #ifdef VIDEO_RECORDING
 	else if (CODECS_VIDEO_ReadConfig(string, ptr)) {
 	}
@@ -181,6 +262,10 @@ void File_Export_WriteConfig(FILE *fp)
 #if defined(HAVE_LIBPNG) || defined(HAVE_LIBZ)
 	fprintf(fp, "COMPRESSION_LEVEL=%d\n", FILE_EXPORT_compression_level);
 #endif
+#ifdef RECORDING_THREAD
+	fprintf(fp, "RECORDING_QUEUE_LENGTH=%d\n", FILE_EXPORT_queue_length);
+	fprintf(fp, "RECORDING_DROP_FRAMES=%d\n", FILE_EXPORT_drop_frames);
+#endif
 #ifdef VIDEO_RECORDING
 	CODECS_VIDEO_WriteConfig(fp);
 #endif
@@ -224,6 +309,162 @@ void File_Export_SetErrorMessageArg(const char *format, const char *arg)
 	File_Export_SetErrorMessage(msg);
 }
 
+#ifdef RECORDING_THREAD
+static int EncodeItem(queue_item_t *item)
+{
+	switch (item->type) {
+#ifdef VIDEO_RECORDING
+	case QUEUE_VIDEO:
+		for (; item->dropped_before > 0; item->dropped_before--) {
+			if (!CONTAINER_AddDroppedVideoFrame())
+				return FALSE;
+		}
+		return CONTAINER_AddVideoFrame(item->data);
+#endif
+#ifdef AUDIO_RECORDING
+	case QUEUE_AUDIO:
+		return CONTAINER_AddAudioSamples(item->data, item->num_samples);
+#endif
+	}
+	return TRUE;
+}
+
+static void *EncoderThread(void *arg)
+{
+	for (;;) {
+		queue_item_t *item;
+		int failed;
+
+		pthread_mutex_lock(&queue_mutex);
+		while (queue_count == 0 && !queue_stop)
+			pthread_cond_wait(&queue_not_empty, &queue_mutex);
+		if (queue_count == 0) {
+			pthread_mutex_unlock(&queue_mutex);
+			break;
+		}
+		item = &queue[queue_head];
+		failed = encoder_failed;
+		pthread_mutex_unlock(&queue_mutex);
+
+		/* After an error the rest of the queue is skipped, so the emulator
+		   never waits for ever; it closes the file when it sees the error. */
+		if (!failed && !EncodeItem(item))
+			failed = TRUE;
+
+		pthread_mutex_lock(&queue_mutex);
+		encoder_failed = failed;
+		queue_head = (queue_head + 1) % queue_slots;
+		queue_count--;
+		pthread_cond_signal(&queue_not_full);
+		pthread_mutex_unlock(&queue_mutex);
+	}
+	return NULL;
+}
+
+/* Copies SIZE bytes of DATA into the queue for the encoder thread. Waits while
+   the queue is full, unless the item is a video frame and frames may be
+   dropped. RETURNS: FALSE if the encoder has failed, TRUE otherwise. */
+static int QueueItem(int type, const UBYTE *data, int size, int num_samples)
+{
+	queue_item_t *item;
+
+	pthread_mutex_lock(&queue_mutex);
+	while (queue_count == queue_slots && !encoder_failed) {
+		if (type == QUEUE_VIDEO && FILE_EXPORT_drop_frames) {
+			pthread_mutex_unlock(&queue_mutex);
+			dropped_frames++;
+			total_dropped_frames++;
+			return TRUE;
+		}
+		pthread_cond_wait(&queue_not_full, &queue_mutex);
+	}
+	if (encoder_failed) {
+		pthread_mutex_unlock(&queue_mutex);
+		return FALSE;
+	}
+	/* the encoder doesn't touch the free slots */
+	item = &queue[(queue_head + queue_count) % queue_slots];
+	pthread_mutex_unlock(&queue_mutex);
+
+	if (item->data_size < size) {
+		item->data = (UBYTE *)Util_realloc(item->data, size);
+		item->data_size = size;
+	}
+	memcpy(item->data, data, size);
+	item->type = type;
+	item->num_samples = num_samples;
+	if (type == QUEUE_VIDEO) {
+		item->dropped_before = dropped_frames;
+		dropped_frames = 0;
+	}
+
+	pthread_mutex_lock(&queue_mutex);
+	queue_count++;
+	pthread_cond_signal(&queue_not_empty);
+	pthread_mutex_unlock(&queue_mutex);
+	return TRUE;
+}
+
+static void StartEncoder(void)
+{
+	if (FILE_EXPORT_queue_length == 0)
+		return;
+	queue_slots = 2 * FILE_EXPORT_queue_length;
+	queue = (queue_item_t *)Util_malloc(queue_slots * sizeof(queue_item_t));
+	memset(queue, 0, queue_slots * sizeof(queue_item_t));
+	queue_head = 0;
+	queue_count = 0;
+	queue_stop = FALSE;
+	encoder_failed = FALSE;
+	dropped_frames = 0;
+	total_dropped_frames = 0;
+	if (pthread_create(&encoder_thread, NULL, EncoderThread, NULL) != 0) {
+		Log_print("Can't start recording thread, encoding in the emulation thread");
+		free(queue);
+		queue = NULL;
+	}
+}
+
+/* Waits until the encoder thread has written everything queued and ends it.
+   RETURNS: FALSE if the encoder failed, TRUE otherwise. */
+static int StopEncoder(void)
+{
+	int result;
+	int i;
+
+	pthread_mutex_lock(&queue_mutex);
+	queue_stop = TRUE;
+	pthread_cond_signal(&queue_not_empty);
+	pthread_mutex_unlock(&queue_mutex);
+	pthread_join(encoder_thread, NULL);
+
+	result = !encoder_failed;
+#ifdef VIDEO_RECORDING
+	/* frames dropped after the last queued one */
+	for (; result && dropped_frames > 0; dropped_frames--)
+		result = CONTAINER_AddDroppedVideoFrame();
+#endif
+	if (total_dropped_frames > 0)
+		Log_print("%d video frames dropped while recording", total_dropped_frames);
+
+	for (i = 0; i < queue_slots; i++)
+		free(queue[i].data);
+	free(queue);
+	queue = NULL;
+	return result;
+}
+#endif /* RECORDING_THREAD */
+
+/* Closes the file after an error writing to it. */
+static void CloseAfterError(void)
+{
+#ifdef RECORDING_THREAD
+	if (queue != NULL)
+		StopEncoder();
+#endif
+	CONTAINER_Close(FALSE);
+}
+
 /* File_Export_IsRecording simply returns true if any multimedia file is
    currently open and able to receive writes.
 
@@ -250,6 +491,10 @@ int File_Export_IsRecording(void)
    */
 int File_Export_StopRecording(void)
 {
+#ifdef RECORDING_THREAD
+	if (queue != NULL && !StopEncoder())
+		return CONTAINER_Close(FALSE);
+#endif
 	return CONTAINER_Close(TRUE);
 }
 
@@ -263,7 +508,12 @@ int File_Export_StartRecording(const char *filename)
 {
 	File_Export_StopRecording();
 
-	return CONTAINER_Open(filename);
+	if (!CONTAINER_Open(filename))
+		return FALSE;
+#ifdef RECORDING_THREAD
+	StartEncoder();
+#endif
+	return TRUE;
 }
 
 #ifdef AUDIO_RECORDING
@@ -296,9 +546,14 @@ int File_Export_WriteAudio(const UBYTE *samples, int num_samples)
 
 	if (!container) return 0;
 	if (!audio_codec || (audio_codec && !container->audio_frame)) return 1;
+#ifdef RECORDING_THREAD
+	if (queue != NULL)
+		result = QueueItem(QUEUE_AUDIO, samples, num_samples * (POKEYSND_snd_flags & POKEYSND_BIT16 ? 2 : 1), num_samples);
+	else
+#endif
 	result = CONTAINER_AddAudioSamples(samples, num_samples);
 	if (!result) {
-		CONTAINER_Close(FALSE);
+		CloseAfterError();
 	}
 
 	return result;
@@ -329,9 +584,14 @@ int File_Export_WriteVideo(void)
 
 	if (!container) return 0;
 	if (!video_codec || (video_codec && !container->video_frame)) return 1;
-	result = CONTAINER_AddVideoFrame();
+#ifdef RECORDING_THREAD
+	if (queue != NULL)
+		result = QueueItem(QUEUE_VIDEO, (UBYTE *)Screen_atari, Screen_WIDTH * Screen_HEIGHT, 0);
+	else
+#endif
+	result = CONTAINER_AddVideoFrame((UBYTE *)Screen_atari);
 	if (!result) {
-		CONTAINER_Close(FALSE);
+		CloseAfterError();
 	}
 
 	return result;
@@ -342,6 +602,8 @@ int File_Export_WriteVideo(void)
 /* File_Export_GetStats gets the elapsed time in seconds, the size in kilobytes,
    and the description of the currently recording file.
 
+   With the recording thread the figures lag a few frames behind.
+
    RETURNS: TRUE if a file is currently being written, FALSE if not
    */
 int File_Export_GetRecordingStats(int *seconds, int *size, char **media_type)
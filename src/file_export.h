@@ -18,6 +18,13 @@ void fputl(ULONG, FILE *fp);
 
 #if defined(AUDIO_RECORDING) || defined(VIDEO_RECORDING)
 extern char *FILE_EXPORT_error_message;
+#ifdef RECORDING_THREAD
+/* Number of frames queued for the recording thread, 0 to encode them in the
+   emulation thread. Takes effect when the next recording starts. */
+extern int FILE_EXPORT_queue_length;
+/* TRUE to drop video frames instead of waiting when the queue is full. */
+extern int FILE_EXPORT_drop_frames;
+#endif
 void File_Export_SetErrorMessage(const char *string);
 void File_Export_SetErrorMessageArg(const char *format, const char *arg);
 
@@ -0,0 +1,244 @@
+/*
+ * imgcache.c - sharing disk and cartridge images loaded from the same file
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "atari.h"
+#include "crc32.h"
+#include "imgcache.h"
+#include "util.h"
+
+/* Images are identified by the contents of their files, so mounting the
+   same file again (e.g. every time a libatari800 context restores its state)
+   finds the data loaded the first time, and a compressed image is
+   decompressed only once. Images of the same length are told apart by the
+   CRC32 of their files, computed the first time it is needed, and then
+   compared byte by byte; a compressed image keeps its file for that. An
+   image also remembers the name, size and modification time of the file it
+   was loaded from, so mounting that file again while it is unchanged
+   doesn't even read it. The data is shared read-only by all its
+   users; they copy it before writing. When an image is released by its last
+   user it stays in the cache, and the least recently used unused images are
+   freed when they take more than IMGCACHE_unused_kb. */
+
+typedef struct cache_entry {
+	struct cache_entry *next;
+	ULONG crc;
+	int crc_valid;     /* FALSE until crc is needed */
+	char *filename;    /* file the image was loaded from, or NULL */
+#ifdef HAVE_STAT
+	off_t file_size;   /* size and modification time of filename */
+	time_t file_mtime;
+#endif
+	UBYTE *file;       /* contents of the file, or data */
+	ULONG file_length;
+	UBYTE *data;
+	ULONG length;
+	int refs;
+	ULONG last_use;    /* value of use_counter when last released */
+} cache_entry;
+
+int IMGCACHE_unused_kb = 16384;
+
+static cache_entry *entries = NULL;
+static ULONG unused_size = 0;
+static ULONG use_counter = 0;
+
+/* Returns the memory used by the image of E. */
+static ULONG EntrySize(const cache_entry *e)
+{
+	return e->file != e->data ? e->length + e->file_length : e->length;
+}
+
+static void FreeEntry(cache_entry **link)
+{
+	cache_entry *e = *link;
+	*link = e->next;
+	unused_size -= EntrySize(e);
+	if (e->file != e->data)
+		free(e->file);
+	free(e->data);
+	free(e->filename);
+	free(e);
+}
+
+/* Frees the least recently used unused images until the rest fit in LIMIT
+   bytes. */
+static void Trim(ULONG limit)
+{
+	while (unused_size > limit) {
+		cache_entry **link;
+		cache_entry **oldest = NULL;
+		for (link = &entries; *link != NULL; link = &(*link)->next) {
+			if ((*link)->refs == 0 && (oldest == NULL || (*link)->last_use < (*oldest)->last_use))
+				oldest = link;
+		}
+		FreeEntry(oldest);
+	}
+}
+
+static cache_entry *FindData(const UBYTE *data)
+{
+	cache_entry *e;
+	for (e = entries; e != NULL; e = e->next) {
+		if (e->data == data)
+			return e;
+	}
+	return NULL;
+}
+
+static UBYTE *Use(cache_entry *e, ULONG *length)
+{
+	if (e->refs++ == 0)
+		unused_size -= EntrySize(e);
+	*length = e->length;
+	return e->data;
+}
+
+UBYTE *IMGCACHE_Find(const UBYTE *file, ULONG file_length, ULONG *length)
+{
+	ULONG crc = 0;
+	int crc_valid = FALSE;
+	cache_entry *e;
+	for (e = entries; e != NULL; e = e->next) {
+		if (e->file_length != file_length)
+			continue;
+		if (!crc_valid) {
+			crc = CRC32_Update(0xffffffff, file, file_length);
+			crc_valid = TRUE;
+		}
+		if (!e->crc_valid) {
+			e->crc = CRC32_Update(0xffffffff, e->file, e->file_length);
+			e->crc_valid = TRUE;
+		}
+		if (e->crc == crc && memcmp(e->file, file, file_length) == 0)
+			return Use(e, length);
+	}
+	return NULL;
+}
+
+#ifdef HAVE_STAT
+
+UBYTE *IMGCACHE_FindFile(const char *filename, ULONG *length, int *converted)
+{
+	struct stat status;
+	cache_entry *e;
+	if (stat(filename, &status) != 0)
+		return NULL;
+	for (e = entries; e != NULL; e = e->next) {
+		if (e->filename != NULL && strcmp(e->filename, filename) == 0
+		 && e->file_size == status.st_size && e->file_mtime == status.st_mtime) {
+			*converted = e->file != e->data;
+			return Use(e, length);
+		}
+	}
+	return NULL;
+}
+
+void IMGCACHE_SetFile(const UBYTE *data, const char *filename)
+{
+	struct stat status;
+	cache_entry *e = FindData(data);
+	if (e == NULL || stat(filename, &status) != 0)
+		return;
+	IMGCACHE_ForgetFile(filename);
+	free(e->filename);
+	e->filename = Util_strdup(filename);
+	e->file_size = status.st_size;
+	e->file_mtime = status.st_mtime;
+}
+
+#else /* HAVE_STAT */
+
+UBYTE *IMGCACHE_FindFile(const char *filename, ULONG *length, int *converted)
+{
+	return NULL;
+}
+
+void IMGCACHE_SetFile(const UBYTE *data, const char *filename)
+{
+}
+
+#endif /* HAVE_STAT */
+
+void IMGCACHE_ForgetFile(const char *filename)
+{
+	cache_entry *e;
+	for (e = entries; e != NULL; e = e->next) {
+		if (e->filename != NULL && strcmp(e->filename, filename) == 0) {
+			free(e->filename);
+			e->filename = NULL;
+		}
+	}
+}
+
+void IMGCACHE_Add(UBYTE *file, ULONG file_length, UBYTE *data, ULONG length)
+{
+	cache_entry *e = (cache_entry *) Util_malloc(sizeof(cache_entry));
+	e->crc_valid = FALSE;
+	e->filename = NULL;
+	e->file = file;
+	e->file_length = file_length;
+	e->data = data;
+	e->length = length;
+	e->refs = 1;
+	e->last_use = 0;
+	e->next = entries;
+	entries = e;
+}
+
+void IMGCACHE_Release(UBYTE *data)
+{
+	cache_entry *e;
+	if (data == NULL)
+		return;
+	e = FindData(data);
+	if (e == NULL) {
+		free(data);
+		return;
+	}
+	if (--e->refs == 0) {
+		e->last_use = ++use_counter;
+		unused_size += EntrySize(e);
+		Trim((ULONG) IMGCACHE_unused_kb * 1024);
+	}
+}
+
+int IMGCACHE_IsCached(const UBYTE *data)
+{
+	return data != NULL && FindData(data) != NULL;
+}
+
+void IMGCACHE_Clear(void)
+{
+	Trim(0);
+}
+
+/*
+vim:ts=4:sw=4:
+*/
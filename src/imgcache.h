@@ -0,0 +1,49 @@
+#ifndef IMGCACHE_H_
+#define IMGCACHE_H_
+
+#include "config.h"
+#include "atari.h"
+
+/* Maximum size in kilobytes of the images kept in the cache while nothing
+   uses them. */
+extern int IMGCACHE_unused_kb;
+
+/* Returns the data of the image whose file contains the FILE_LENGTH bytes at
+   FILE, and stores the length of the data at *LENGTH. Returns NULL if the
+   image is not in the cache. The data must not be modified, and must be
+   released with IMGCACHE_Release when not needed any more. */
+UBYTE *IMGCACHE_Find(const UBYTE *file, ULONG file_length, ULONG *length);
+
+/* Returns the data of the image loaded from the file FILENAME, like
+   IMGCACHE_Find, if the file has the same size and modification time as
+   when it was loaded; NULL otherwise. Stores at *CONVERTED whether the data
+   differs from the file (e.g. a decompressed image). */
+UBYTE *IMGCACHE_FindFile(const char *filename, ULONG *length, int *converted);
+
+/* Remembers that DATA, returned by IMGCACHE_Find or passed to IMGCACHE_Add,
+   holds the image of the file FILENAME as it is now. */
+void IMGCACHE_SetFile(const UBYTE *data, const char *filename);
+
+/* Must be called before the emulator writes to the file FILENAME, whose
+   modification time may then not change. */
+void IMGCACHE_ForgetFile(const char *filename);
+
+/* Adds DATA, LENGTH bytes allocated with Util_malloc, to the cache as the
+   image whose file contains the FILE_LENGTH bytes at FILE. FILE is either
+   DATA itself (an image used as stored in its file) or another buffer
+   allocated with Util_malloc. The cache takes over both; the caller keeps
+   using DATA as if returned by IMGCACHE_Find. */
+void IMGCACHE_Add(UBYTE *file, ULONG file_length, UBYTE *data, ULONG length);
+
+/* Releases DATA returned by IMGCACHE_Find or passed to IMGCACHE_Add.
+   A buffer that is not in the cache is freed. */
+void IMGCACHE_Release(UBYTE *data);
+
+/* Returns TRUE if DATA is shared through the cache, so it must be copied
+   before it is modified. */
+int IMGCACHE_IsCached(const UBYTE *data);
+
+/* Frees the images that are not in use. */
+void IMGCACHE_Clear(void);
+
+#endif /* IMGCACHE_H_ */
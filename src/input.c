@@ -46,6 +46,7 @@
 #endif
 #ifdef EVENT_RECORDING
 #include <zlib.h>
+#include "statesav.h"
 #endif
 
 int INPUT_key_code = AKEY_NONE;
@@ -120,17 +121,108 @@ static int max_scanline_counter;
 static int scanline_counter;
 
 #ifdef EVENT_RECORDING
-static gzFile recordfp = NULL; /*output file for input recording*/
-static gzFile playbackfp = NULL; /*input file for playback*/
+/* Event recordings (version 2) are binary files. They start with the 8 bytes
+   "A8EVENTS" and a version byte, followed by records. Each record is a type
+   byte, the number of frames since the previous record as a varint and the
+   data of the record:
+
+   EV_INPUT     a byte with one bit per input that changed and the new values
+                of those inputs, in the order of the bits (key code as signed
+                varint, the others as bytes; the 4 triggers are one byte)
+   EV_CHECK     ULONG adler32 of the screen, when it changed from the frame
+                before
+   EV_INT       signed varint given to INPUT_RecordInt
+   EV_KEYFRAME  ULONG length of the rest, KEYFRAME_HEADER_SIZE bytes of
+                Atari800_nframes, inputs, input latches, last adler32, sizes
+                of the state save and GTIA_consol_override, then the state
+                save compressed with zlib
+   EV_END       the frame count of the recording
+
+   After EV_END comes the index: ULONG frame count, ULONG number of
+   keyframes and for each keyframe its ULONG frame and ULONG file offset.
+   The file ends with the ULONG offset of the index and "A8IX". Varints are
+   little endian base 128, signed varints zigzag encoded, ULONGs little endian.
+   A file without the index (e.g. the emulator crashed) is indexed by scanning
+   it when it is played back.
+
+   Version 1 recordings were gzipped text with all the inputs and the adler32
+   of every frame. They can still be played back, but without seeking. */
+enum {
+	EV_INPUT = 1,
+	EV_CHECK,
+	EV_INT,
+	EV_KEYFRAME,
+	EV_END
+};
+#define EV_INPUT_KEY_CODE  0x01
+#define EV_INPUT_KEY_SHIFT 0x02
+#define EV_INPUT_KEY_CONSOL 0x04
+#define EV_INPUT_PORT0     0x08
+#define EV_INPUT_PORT1     0x10
+#define EV_INPUT_TRIG      0x20
+#define KEYFRAME_HEADER_SIZE 35
+#define EVENT_MAGIC "A8EVENTS"
+#define INDEX_MAGIC "A8IX"
+
+/* inputs of one frame, as recorded */
+typedef struct {
+	int key_code;
+	int key_shift;
+	int key_consol;
+	int port[2];
+	int trig[4];
+} event_input_t;
+
+typedef struct {
+	ULONG frame;
+	long offset;
+} keyframe_t;
+
+int INPUT_keyframe_seconds = 30;
+
+static FILE *recordfp = NULL; /*output file for input recording*/
+static FILE *playbackfp = NULL; /*input file for playback*/
+static gzFile playbacktextfp = NULL; /*input file for playback of version 1 recordings*/
 static int recording = FALSE;
 static int playingback = FALSE;
 static int playingback_exit_after = TRUE;
 static void update_adler32_of_screen(void);
 static unsigned int compute_adler32_of_screen(void);
+static int OpenPlayback(const char *filename);
+static void ClosePlayback(void);
+static void FinishRecording(void);
 static int recording_version;
 #define GZBUFSIZE 256
 static char gzbuf[GZBUFSIZE+1];
-#define EVENT_RECORDING_VERSION 1
+#define EVENT_RECORDING_VERSION 2
+
+/* inputs of the current frame */
+static event_input_t frame_input;
+
+static ULONG rec_frame;          /* number of the frame being recorded */
+static ULONG rec_last_frame;     /* frame of the last record written */
+static event_input_t rec_input;  /* inputs as of the last EV_INPUT */
+static ULONG rec_check;          /* adler32 as of the last EV_CHECK */
+static keyframe_t *rec_keys = NULL;
+static int rec_num_keys;
+static int rec_keys_capacity;
+
+static ULONG pb_frame;           /* number of the frame being played back */
+static int pb_next_type;         /* type of the next record */
+static ULONG pb_next_frame;      /* frame of the next record */
+static event_input_t pb_input;
+static ULONG pb_check;
+static ULONG pb_length;          /* number of frames in the recording */
+static keyframe_t *pb_keys = NULL;
+static int pb_num_keys;
+static int skip_check = FALSE;   /* the screen was not drawn from the recording */
+static long seek_target = -1;    /* frame to stop seeking at, or -1 */
+static int seek_pending = FALSE; /* the keyframe hasn't been loaded yet */
+
+/* uncompressed and compressed state saves of keyframes */
+static UBYTE *state_buf = NULL;
+static UBYTE *packed_buf = NULL;
+static uLongf packed_buf_size;
 #endif
 
 int INPUT_Initialise(int *argc, char *argv[])
@@ -195,45 +287,47 @@ int INPUT_Initialise(int *argc, char *argv[])
 		else if (strcmp(argv[i], "-record") == 0) {
 			if (i_a) {
 				char *recfilename = argv[++i];
-				if ((recordfp = gzopen(recfilename, "wb")) == NULL) {
+				if ((recordfp = fopen(recfilename, "wb")) == NULL) {
 					Log_print("Cannot open record file");
 					return FALSE;
 				}
 				else {
 					recording = TRUE;
-					gzprintf(recordfp, "Atari800 event recording, version: %d\n", EVENT_RECORDING_VERSION);
+					fwrite(EVENT_MAGIC, 1, 8, recordfp);
+					putc(EVENT_RECORDING_VERSION, recordfp);
+				}
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-recordkeyframes") == 0) {
+			if (i_a) {
+				INPUT_keyframe_seconds = Util_sscandec(argv[++i]);
+				if (INPUT_keyframe_seconds < 0) {
+					Log_print("Invalid keyframe interval, keyframes disabled");
+					INPUT_keyframe_seconds = 0;
 				}
 			}
 			else a_m = TRUE;
 		}
 		else if (strcmp(argv[i], "-playback") == 0) {
 			if (i_a) {
-				char *pbfilename = argv[++i];
-				if ((playbackfp = gzopen(pbfilename, "rb")) == NULL) {
-					Log_print("Cannot open playback file");
+				if (!OpenPlayback(argv[++i]))
 					return FALSE;
-				}
-				else {
-					playingback = TRUE;
-					gzgets(playbackfp, gzbuf, GZBUFSIZE);
-					if (sscanf(gzbuf, "Atari800 event recording, version: %d\n", &recording_version) != 1) {
-						Log_print("Invalid playback file");
-						playingback = FALSE;
-						gzclose(playbackfp);
-						return FALSE;
-					}
-					else if (recording_version > EVENT_RECORDING_VERSION) {
-						Log_print("Newer version of playback file than this version of Atari800 can handle");
-						playingback = FALSE;
-						gzclose(playbackfp);
-						return FALSE;
-					}
-				}
 			}
 			else a_m = TRUE;
 		} else if (strcmp(argv[i], "-playbacknoexit") == 0) {
 			playingback_exit_after = FALSE;
 		}
+		else if (strcmp(argv[i], "-playbackseek") == 0) {
+			if (i_a) {
+				int frame = Util_sscandec(argv[++i]);
+				if (!INPUT_PlaybackSeek(frame)) {
+					Log_print("Cannot seek to frame %d - give a valid frame after -playback", frame);
+					return FALSE;
+				}
+			}
+			else a_m = TRUE;
+		}
 #endif /* EVENT_RECORDING */
  		else if (strcmp(argv[i], "-directmouse") == 0) {
 			INPUT_direct_mouse = 1;
@@ -268,8 +362,13 @@ int INPUT_Initialise(int *argc, char *argv[])
 				Log_print("\t-multijoy        Emulate MultiJoy4 interface");
 				#ifdef EVENT_RECORDING
 					Log_print("\t-record <file>   Record input to <file>");
+					Log_print("\t-recordkeyframes <sec>");
+					Log_print("\t                 Store a keyframe for seeking every <sec> seconds");
+					Log_print("\t                 of the recording (0 = none, default 30)");
 					Log_print("\t-playback <file> Playback input from <file>");
 					Log_print("\t-playbacknoexit  Don't exit the emulator after playback finishes");
+					Log_print("\t-playbackseek <frame>");
+					Log_print("\t                 Start the playback at <frame>");
 				#endif /* EVENT_RECORDING */
 				
 			}
@@ -301,13 +400,17 @@ int INPUT_Initialise(int *argc, char *argv[])
 void INPUT_Exit(void) {
 #ifdef EVENT_RECORDING
 	if (recording) {
-		gzclose(recordfp);
+		FinishRecording();
 		recording = FALSE;
 	}
 	if (playingback) {
-		gzclose(playbackfp);
+		ClosePlayback();
 		playingback = FALSE;
 	}
+	free(state_buf);
+	state_buf = NULL;
+	free(packed_buf);
+	packed_buf = NULL;
 #endif
 }
 
@@ -422,13 +525,558 @@ static UBYTE mouse_step(void)
 	return r;
 }
 
+static int last_key_code = AKEY_NONE;
+static int last_key_break = 0;
+static UBYTE last_stick[4] = {INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE};
+static int last_mouse_buttons = 0;
+
+#ifdef LIBATARI800
+void INPUT_SaveLatches(INPUT_latches_t *latches)
+{
+	latches->last_key_code = last_key_code;
+	latches->last_key_break = last_key_break;
+	memcpy(latches->last_stick, last_stick, sizeof(last_stick));
+	latches->last_mouse_buttons = last_mouse_buttons;
+	latches->mouse_x = mouse_x;
+	latches->mouse_y = mouse_y;
+}
+
+void INPUT_LoadLatches(const INPUT_latches_t *latches)
+{
+	last_key_code = latches->last_key_code;
+	last_key_break = latches->last_key_break;
+	memcpy(last_stick, latches->last_stick, sizeof(last_stick));
+	last_mouse_buttons = latches->last_mouse_buttons;
+	mouse_x = latches->mouse_x;
+	mouse_y = latches->mouse_y;
+}
+#endif /* LIBATARI800 */
+
+#ifdef EVENT_RECORDING
+
+static void StoreULONG(UBYTE *p, ULONG value)
+{
+	p[0] = (UBYTE) value;
+	p[1] = (UBYTE) (value >> 8);
+	p[2] = (UBYTE) (value >> 16);
+	p[3] = (UBYTE) (value >> 24);
+}
+
+static ULONG LoadULONG(const UBYTE *p)
+{
+	return p[0] | (p[1] << 8) | ((ULONG) p[2] << 16) | ((ULONG) p[3] << 24);
+}
+
+static void PutULONG(FILE *fp, ULONG value)
+{
+	UBYTE buf[4];
+	StoreULONG(buf, value);
+	fwrite(buf, 1, 4, fp);
+}
+
+static ULONG GetULONG(FILE *fp)
+{
+	UBYTE buf[4];
+	if (fread(buf, 1, 4, fp) != 4)
+		return 0;
+	return LoadULONG(buf);
+}
+
+static void PutVarint(FILE *fp, ULONG value)
+{
+	while (value >= 0x80) {
+		putc((int) (value & 0x7f) | 0x80, fp);
+		value >>= 7;
+	}
+	putc((int) value, fp);
+}
+
+static ULONG GetVarint(FILE *fp)
+{
+	ULONG value = 0;
+	int shift = 0;
+	int c;
+	do {
+		c = getc(fp);
+		if (c == EOF)
+			break;
+		value |= (ULONG) (c & 0x7f) << shift;
+		shift += 7;
+	} while ((c & 0x80) && shift < 35);
+	return value;
+}
+
+static void PutSigned(FILE *fp, int value)
+{
+	PutVarint(fp, value < 0 ? ((ULONG) ~value << 1) | 1 : (ULONG) value << 1);
+}
+
+static int GetSigned(FILE *fp)
+{
+	ULONG value = GetVarint(fp);
+	return (value & 1) ? ~(int) (value >> 1) : (int) (value >> 1);
+}
+
+static int TrigBits(const event_input_t *input)
+{
+	return (input->trig[0] ? 1 : 0) | (input->trig[1] ? 2 : 0)
+	     | (input->trig[2] ? 4 : 0) | (input->trig[3] ? 8 : 0);
+}
+
+/* Fills the keyframe header in BUF. STATE_SIZE and PACKED_SIZE are the sizes
+   of the state save before and after compression. */
+static void StoreKeyframeHeader(UBYTE *buf, const event_input_t *input, ULONG check, ULONG state_size, ULONG packed_size)
+{
+	int i;
+	StoreULONG(buf, (ULONG) Atari800_nframes);
+	StoreULONG(buf + 4, (ULONG) input->key_code);
+	buf[8] = (UBYTE) input->key_shift;
+	buf[9] = (UBYTE) input->key_consol;
+	buf[10] = (UBYTE) input->port[0];
+	buf[11] = (UBYTE) input->port[1];
+	buf[12] = (UBYTE) TrigBits(input);
+	StoreULONG(buf + 13, (ULONG) last_key_code);
+	buf[17] = (UBYTE) last_key_break;
+	for (i = 0; i < 4; i++)
+		buf[18 + i] = last_stick[i];
+	StoreULONG(buf + 22, check);
+	StoreULONG(buf + 26, state_size);
+	StoreULONG(buf + 30, packed_size);
+	/* not in state saves, but keeps Option held while the OS boots */
+	buf[34] = (UBYTE) GTIA_consol_override;
+}
+
+static void AllocStateBuffers(void)
+{
+	if (state_buf == NULL) {
+		state_buf = (UBYTE *) Util_malloc(STATESAV_MAX_SIZE);
+		packed_buf_size = compressBound(STATESAV_MAX_SIZE);
+		packed_buf = (UBYTE *) Util_malloc(packed_buf_size);
+	}
+}
+
+static void RecordHeader(int type)
+{
+	putc(type, recordfp);
+	PutVarint(recordfp, rec_frame - rec_last_frame);
+	rec_last_frame = rec_frame;
+}
+
+static void RecordKeyframe(void)
+{
+	UBYTE header[KEYFRAME_HEADER_SIZE];
+	ULONG state_size;
+	uLongf packed_size;
+	long offset;
+
+	AllocStateBuffers();
+	state_size = StateSav_SaveAtariStateToMemory(state_buf);
+	packed_size = packed_buf_size;
+	if (state_size == 0 || compress2(packed_buf, &packed_size, state_buf, state_size, Z_BEST_SPEED) != Z_OK)
+		return;
+	offset = ftell(recordfp);
+	RecordHeader(EV_KEYFRAME);
+	PutULONG(recordfp, KEYFRAME_HEADER_SIZE + packed_size);
+	StoreKeyframeHeader(header, &rec_input, rec_check, state_size, packed_size);
+	fwrite(header, 1, KEYFRAME_HEADER_SIZE, recordfp);
+	fwrite(packed_buf, 1, packed_size, recordfp);
+
+	if (rec_num_keys == rec_keys_capacity) {
+		rec_keys_capacity = rec_keys_capacity == 0 ? 64 : rec_keys_capacity * 2;
+		rec_keys = (keyframe_t *) Util_realloc(rec_keys, rec_keys_capacity * sizeof(keyframe_t));
+	}
+	rec_keys[rec_num_keys].frame = rec_frame;
+	rec_keys[rec_num_keys].offset = offset;
+	rec_num_keys++;
+}
+
+/* Called at the start of each recorded frame. */
+static void RecordFrameStart(void)
+{
+	ULONG interval = (ULONG) INPUT_keyframe_seconds * (Atari800_tv_mode == Atari800_TV_PAL ? 50 : 60);
+	if (interval > 0 && rec_frame % interval == 0)
+		RecordKeyframe();
+}
+
+/* Called at the end of each recorded frame with the adler32 of the screen. */
+static void RecordFrameEnd(ULONG check)
+{
+	int mask = 0;
+	if (frame_input.key_code != rec_input.key_code)
+		mask |= EV_INPUT_KEY_CODE;
+	if (frame_input.key_shift != rec_input.key_shift)
+		mask |= EV_INPUT_KEY_SHIFT;
+	if (frame_input.key_consol != rec_input.key_consol)
+		mask |= EV_INPUT_KEY_CONSOL;
+	if (frame_input.port[0] != rec_input.port[0])
+		mask |= EV_INPUT_PORT0;
+	if (frame_input.port[1] != rec_input.port[1])
+		mask |= EV_INPUT_PORT1;
+	if (TrigBits(&frame_input) != TrigBits(&rec_input))
+		mask |= EV_INPUT_TRIG;
+	if (mask != 0) {
+		RecordHeader(EV_INPUT);
+		putc(mask, recordfp);
+		if (mask & EV_INPUT_KEY_CODE)
+			PutSigned(recordfp, frame_input.key_code);
+		if (mask & EV_INPUT_KEY_SHIFT)
+			putc(frame_input.key_shift, recordfp);
+		if (mask & EV_INPUT_KEY_CONSOL)
+			putc(frame_input.key_consol, recordfp);
+		if (mask & EV_INPUT_PORT0)
+			putc(frame_input.port[0] & 0xff, recordfp);
+		if (mask & EV_INPUT_PORT1)
+			putc(frame_input.port[1] & 0xff, recordfp);
+		if (mask & EV_INPUT_TRIG)
+			putc(TrigBits(&frame_input), recordfp);
+		rec_input = frame_input;
+	}
+	if (check != rec_check) {
+		RecordHeader(EV_CHECK);
+		PutULONG(recordfp, check);
+		rec_check = check;
+	}
+	rec_frame++;
+}
+
+static void FinishRecording(void)
+{
+	long index_offset;
+	int i;
+
+	RecordHeader(EV_END);
+	index_offset = ftell(recordfp);
+	PutULONG(recordfp, rec_frame);
+	PutULONG(recordfp, rec_num_keys);
+	for (i = 0; i < rec_num_keys; i++) {
+		PutULONG(recordfp, rec_keys[i].frame);
+		PutULONG(recordfp, (ULONG) rec_keys[i].offset);
+	}
+	PutULONG(recordfp, (ULONG) index_offset);
+	fwrite(INDEX_MAGIC, 1, 4, recordfp);
+	fclose(recordfp);
+	free(rec_keys);
+	rec_keys = NULL;
+	rec_num_keys = rec_keys_capacity = 0;
+}
+
+/* Reads the header of the next record. At the end of the file, returns
+   EV_END as if the recording ended with the last record read. */
+static void PlaybackNextRecord(void)
+{
+	int type = getc(playbackfp);
+	if (type == EOF) {
+		pb_next_type = EV_END;
+		return;
+	}
+	pb_next_type = type;
+	pb_next_frame += GetVarint(playbackfp);
+}
+
+/* Reads the data of an EV_INPUT record into INPUT. */
+static void PlaybackInputRecord(event_input_t *input)
+{
+	int mask = getc(playbackfp);
+	if (mask & EV_INPUT_KEY_CODE)
+		input->key_code = GetSigned(playbackfp);
+	if (mask & EV_INPUT_KEY_SHIFT)
+		input->key_shift = getc(playbackfp);
+	if (mask & EV_INPUT_KEY_CONSOL)
+		input->key_consol = getc(playbackfp);
+	if (mask & EV_INPUT_PORT0)
+		input->port[0] = getc(playbackfp);
+	if (mask & EV_INPUT_PORT1)
+		input->port[1] = getc(playbackfp);
+	if (mask & EV_INPUT_TRIG) {
+		int bits = getc(playbackfp);
+		int i;
+		for (i = 0; i < 4; i++)
+			input->trig[i] = (bits >> i) & 1;
+	}
+}
+
+/* Skips the data of a record of type TYPE. */
+static void PlaybackSkipRecord(int type)
+{
+	switch (type) {
+	case EV_INPUT:
+		{
+			event_input_t input;
+			PlaybackInputRecord(&input);
+		}
+		break;
+	case EV_CHECK:
+		fseek(playbackfp, 4, SEEK_CUR);
+		break;
+	case EV_INT:
+		GetVarint(playbackfp);
+		break;
+	case EV_KEYFRAME:
+		fseek(playbackfp, (long) GetULONG(playbackfp), SEEK_CUR);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Reads the index at the end of the file, or if there's none, builds it by
+   scanning the records. */
+static void PlaybackReadIndex(void)
+{
+	UBYTE trailer[8];
+	long records = ftell(playbackfp);
+	long trailer_offset;
+	ULONG num_keys = 0;
+	int indexed = FALSE;
+	int capacity = 0;
+
+	pb_num_keys = 0;
+	if (fseek(playbackfp, -8, SEEK_END) == 0 && (trailer_offset = ftell(playbackfp)) >= records
+	 && fread(trailer, 1, 8, playbackfp) == 8 && memcmp(trailer + 4, INDEX_MAGIC, 4) == 0) {
+		ULONG index_offset = LoadULONG(trailer);
+		/* the index holds the length, the number of keyframes and 8 bytes
+		   for every keyframe, all before the trailer */
+		if (index_offset >= (ULONG) records && index_offset + 8 <= (ULONG) trailer_offset
+		 && fseek(playbackfp, (long) index_offset, SEEK_SET) == 0) {
+			pb_length = GetULONG(playbackfp);
+			num_keys = GetULONG(playbackfp);
+			indexed = num_keys <= ((ULONG) trailer_offset - index_offset - 8) / 8;
+		}
+	}
+	if (indexed) {
+		int i;
+		pb_num_keys = (int) num_keys;
+		pb_keys = (keyframe_t *) Util_malloc((pb_num_keys + 1) * sizeof(keyframe_t));
+		for (i = 0; i < pb_num_keys; i++) {
+			pb_keys[i].frame = GetULONG(playbackfp);
+			pb_keys[i].offset = (long) GetULONG(playbackfp);
+		}
+	}
+	else {
+		fseek(playbackfp, records, SEEK_SET);
+		pb_next_frame = 0;
+		for (;;) {
+			long offset = ftell(playbackfp);
+			PlaybackNextRecord();
+			if (pb_next_type == EV_END)
+				break;
+			if (pb_next_type == EV_KEYFRAME) {
+				if (pb_num_keys == capacity) {
+					capacity = capacity == 0 ? 64 : capacity * 2;
+					pb_keys = (keyframe_t *) Util_realloc(pb_keys, capacity * sizeof(keyframe_t));
+				}
+				pb_keys[pb_num_keys].frame = pb_next_frame;
+				pb_keys[pb_num_keys].offset = offset;
+				pb_num_keys++;
+			}
+			PlaybackSkipRecord(pb_next_type);
+		}
+		pb_length = pb_next_frame;
+		Log_print("Playback file has no index - truncated recording?");
+	}
+	fseek(playbackfp, records, SEEK_SET);
+	pb_next_frame = 0;
+	PlaybackNextRecord();
+}
+
+static int OpenPlayback(const char *filename)
+{
+	char magic[9];
+	if ((playbackfp = fopen(filename, "rb")) == NULL) {
+		Log_print("Cannot open playback file");
+		return FALSE;
+	}
+	if (fread(magic, 1, 9, playbackfp) == 9 && memcmp(magic, EVENT_MAGIC, 8) == 0) {
+		recording_version = (UBYTE) magic[8];
+		if (recording_version > EVENT_RECORDING_VERSION) {
+			Log_print("Newer version of playback file than this version of Atari800 can handle");
+			fclose(playbackfp);
+			playbackfp = NULL;
+			return FALSE;
+		}
+		PlaybackReadIndex();
+		pb_frame = 0;
+		pb_check = 0;
+		playingback = TRUE;
+		return TRUE;
+	}
+	fclose(playbackfp);
+	playbackfp = NULL;
+
+	/* version 1 */
+	if ((playbacktextfp = gzopen(filename, "rb")) == NULL) {
+		Log_print("Cannot open playback file");
+		return FALSE;
+	}
+	gzgets(playbacktextfp, gzbuf, GZBUFSIZE);
+	if (sscanf(gzbuf, "Atari800 event recording, version: %d\n", &recording_version) != 1) {
+		Log_print("Invalid playback file");
+		gzclose(playbacktextfp);
+		playbacktextfp = NULL;
+		return FALSE;
+	}
+	playingback = TRUE;
+	return TRUE;
+}
+
+static void ClosePlayback(void)
+{
+	if (playbackfp != NULL) {
+		fclose(playbackfp);
+		playbackfp = NULL;
+	}
+	if (playbacktextfp != NULL) {
+		gzclose(playbacktextfp);
+		playbacktextfp = NULL;
+	}
+	free(pb_keys);
+	pb_keys = NULL;
+	pb_num_keys = 0;
+	seek_target = -1;
+}
+
+/* Returns the index of the last keyframe at or before FRAME, or -1. */
+static int FindKeyframe(ULONG frame)
+{
+	int i;
+	for (i = pb_num_keys - 1; i >= 0; i--) {
+		if (pb_keys[i].frame <= frame)
+			break;
+	}
+	return i;
+}
+
+/* Reads keyframe KEY into HEADER and state_buf. */
+static int PlaybackReadKeyframe(int key, UBYTE *header)
+{
+	ULONG state_size;
+	uLongf unpacked_size;
+	ULONG packed_size;
+
+	AllocStateBuffers();
+	if (fseek(playbackfp, pb_keys[key].offset, SEEK_SET) != 0
+	 || getc(playbackfp) != EV_KEYFRAME)
+		return FALSE;
+	GetVarint(playbackfp);
+	GetULONG(playbackfp);
+	if (fread(header, 1, KEYFRAME_HEADER_SIZE, playbackfp) != KEYFRAME_HEADER_SIZE)
+		return FALSE;
+	state_size = LoadULONG(header + 26);
+	packed_size = LoadULONG(header + 30);
+	unpacked_size = STATESAV_MAX_SIZE;
+	return packed_size <= packed_buf_size && state_size <= STATESAV_MAX_SIZE
+	    && fread(packed_buf, 1, packed_size, playbackfp) == packed_size
+	    && uncompress(state_buf, &unpacked_size, packed_buf, packed_size) == Z_OK
+	    && unpacked_size == state_size;
+}
+
+/* Continues the playback from keyframe KEY. Returns FALSE if the keyframe
+   can't be read, in which case the playback goes on from where it was, or
+   if its state can't be restored, in which case the playback stops. */
+static int PlaybackLoadKeyframe(int key)
+{
+	UBYTE header[KEYFRAME_HEADER_SIZE];
+	/* position of the data of the pb_next_type record */
+	long offset = ftell(playbackfp);
+	int i;
+
+	if (!PlaybackReadKeyframe(key, header)) {
+		/* pb_next_type and pb_next_frame are left unchanged */
+		fseek(playbackfp, offset, SEEK_SET);
+		return FALSE;
+	}
+	if (!StateSav_ReadAtariStateFromMemory(state_buf)) {
+		/* the machine is left in an unknown state */
+		Log_print("Cannot restore the state of frame %lu, playback stopped", (unsigned long) pb_keys[key].frame);
+		ClosePlayback();
+		playingback = FALSE;
+		return FALSE;
+	}
+
+	Atari800_nframes = (int) LoadULONG(header);
+	pb_input.key_code = (int) (SLONG) LoadULONG(header + 4);
+	pb_input.key_shift = header[8];
+	pb_input.key_consol = header[9];
+	pb_input.port[0] = header[10];
+	pb_input.port[1] = header[11];
+	for (i = 0; i < 4; i++)
+		pb_input.trig[i] = (header[12] >> i) & 1;
+	last_key_code = (int) (SLONG) LoadULONG(header + 13);
+	last_key_break = header[17];
+	for (i = 0; i < 4; i++)
+		last_stick[i] = header[18 + i];
+	pb_check = LoadULONG(header + 22);
+	GTIA_consol_override = header[34];
+
+	pb_frame = pb_keys[key].frame;
+	pb_next_frame = pb_frame;
+	PlaybackNextRecord();
+	/* Screen_atari still shows the frame before the seek */
+	skip_check = TRUE;
+	return TRUE;
+}
+
+/* Called at the start of each played back frame. Sets pb_input to the inputs
+   of the frame. */
+static void PlaybackFrameStart(void)
+{
+	if (seek_pending) {
+		int key = FindKeyframe((ULONG) seek_target);
+		seek_pending = FALSE;
+		/* going forward within the current keyframe interval needs no
+		   keyframe, only emulating up to the target */
+		if ((ULONG) seek_target < pb_frame || (key >= 0 && pb_keys[key].frame > pb_frame)) {
+			if (key < 0 || !PlaybackLoadKeyframe(key)) {
+				if (!playingback)
+					/* the playback stopped */
+					return;
+				Log_print("Cannot seek to frame %ld", seek_target);
+				seek_target = -1;
+			}
+		}
+	}
+	if (seek_target >= 0 && pb_frame >= (ULONG) seek_target) {
+		Log_print("Playback at frame %lu", (unsigned long) pb_frame);
+		seek_target = -1;
+	}
+	while (pb_next_type != EV_END && pb_next_frame <= pb_frame && pb_next_type != EV_CHECK) {
+		if (pb_next_type == EV_INPUT)
+			PlaybackInputRecord(&pb_input);
+		else
+			/* keyframes are only needed for seeking; values for
+			   INPUT_PlaybackInt come before the first frame */
+			PlaybackSkipRecord(pb_next_type);
+		PlaybackNextRecord();
+	}
+	frame_input = pb_input;
+}
+
+/* Called at the end of each played back frame. Returns the adler32 of the
+   screen stored in the recording. */
+static ULONG PlaybackFrameEnd(void)
+{
+	if (pb_next_type == EV_CHECK && pb_next_frame <= pb_frame) {
+		pb_check = GetULONG(playbackfp);
+		PlaybackNextRecord();
+	}
+	pb_frame++;
+	return pb_check;
+}
+
+/* Reads the inputs of the frame from a version 1 recording. */
+static void PlaybackTextFrame(void)
+{
+	event_input_t *input = &frame_input;
+	gzgets(playbacktextfp, gzbuf, GZBUFSIZE);
+	sscanf(gzbuf, "%d %d %d %d %d %d %d %d %d ", &input->key_code, &input->key_shift, &input->key_consol,
+	       &input->port[0], &input->port[1], &input->trig[0], &input->trig[1], &input->trig[2], &input->trig[3]);
+}
+
+#endif /* EVENT_RECORDING */
+
 void INPUT_Frame(void)
 {
 	int i;
-	static int last_key_code = AKEY_NONE;
-	static int last_key_break = 0;
-	static UBYTE last_stick[4] = {INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE, INPUT_STICK_CENTRE};
-	static int last_mouse_buttons = 0;
 
 	scanline_counter = 10000;	/* do nothing in INPUT_Scanline() */
 
@@ -452,12 +1100,21 @@ void INPUT_Frame(void)
 	   INPUT_key_code is used for keypad keys and INPUT_key_shift is used for 2nd button.
 	*/
 #ifdef EVENT_RECORDING
+	if (recording)
+		RecordFrameStart();
 	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%d %d %d ", &INPUT_key_code, &INPUT_key_shift, &INPUT_key_consol);
+		if (playbacktextfp != NULL)
+			PlaybackTextFrame();
+		else
+			PlaybackFrameStart();
+		INPUT_key_code = frame_input.key_code;
+		INPUT_key_shift = frame_input.key_shift;
+		INPUT_key_consol = frame_input.key_consol;
 	}
-	if (recording) {
-		gzprintf(recordfp, "%d %d %d ", INPUT_key_code, INPUT_key_shift, INPUT_key_consol);
+	else {
+		frame_input.key_code = INPUT_key_code;
+		frame_input.key_shift = INPUT_key_shift;
+		frame_input.key_consol = INPUT_key_consol;
 	}
 #endif
 	i = Atari800_machine_type == Atari800_MACHINE_5200 ? INPUT_key_shift : (INPUT_key_code == AKEY_BREAK);
@@ -536,33 +1193,23 @@ void INPUT_Frame(void)
 
 	/* handle joysticks */
 #ifdef EVENT_RECORDING
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf,"%d ",&i);
-	} else {
-#endif
-		i = PLATFORM_PORT(0);
-#ifdef EVENT_RECORDING
-	}
-	if (recording) {
-		gzprintf(recordfp,"%d ",i);
-	}
+	if (playingback)
+		i = frame_input.port[0];
+	else
+		frame_input.port[0] = i = PLATFORM_PORT(0);
+#else
+	i = PLATFORM_PORT(0);
 #endif
 
 	STICK[0] = i & 0x0f;
 	STICK[1] = (i >> 4) & 0x0f;
 #ifdef EVENT_RECORDING
-	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf,"%d ",&i);
-	} else {
-#endif
-		i = PLATFORM_PORT(1);
-#ifdef EVENT_RECORDING
-	}
-	if (recording) {
-		gzprintf(recordfp,"%d ",i);
-	}
+	if (playingback)
+		i = frame_input.port[1];
+	else
+		frame_input.port[1] = i = PLATFORM_PORT(1);
+#else
+	i = PLATFORM_PORT(1);
 #endif
 	STICK[2] = i & 0x0f;
 	STICK[3] = (i >> 4) & 0x0f;
@@ -594,30 +1241,16 @@ void INPUT_Frame(void)
 			last_stick[i] = STICK[i];
 		/* Joystick Triggers */
 #ifdef EVENT_RECORDING
-		if(playingback){
-			int trigtemp;
-			gzgets(playbackfp, gzbuf, GZBUFSIZE);
-			sscanf(gzbuf,"%d ",&trigtemp);
-			TRIG_input[i] = trigtemp;
-
-		} else {
-#endif
-			TRIG_input[i] = PLATFORM_TRIG(i);
-#ifdef EVENT_RECORDING
-		}
-		if(recording){
-			gzprintf(recordfp,"%d ",TRIG_input[i]);
-		}
+		if (playingback)
+			TRIG_input[i] = frame_input.trig[i];
+		else
+			frame_input.trig[i] = TRIG_input[i] = PLATFORM_TRIG(i);
+#else
+		TRIG_input[i] = PLATFORM_TRIG(i);
 #endif
 		if ((INPUT_joy_autofire[i] == INPUT_AUTOFIRE_FIRE && !TRIG_input[i]) || (INPUT_joy_autofire[i] == INPUT_AUTOFIRE_CONT))
 			TRIG_input[i] = (Atari800_nframes & 2) ? 1 : 0;
 	}
-#ifdef EVENT_RECORDING
-	if(recording){
-		gzprintf(recordfp,"\n");
-	}
-#endif
-
 	/* handle analog joysticks in Atari 5200 */
 	if (Atari800_machine_type != Atari800_MACHINE_5200) {
 		if(!INPUT_direct_mouse) {
@@ -890,25 +1523,37 @@ static void update_adler32_of_screen(void)
 		adler32val = compute_adler32_of_screen();
 	}
 
-	if (recording) {
-		gzprintf(recordfp, "%08X \n", adler32val);
-	}
+	if (recording)
+		RecordFrameEnd(adler32val);
 	if (playingback) {
 		unsigned int pb_adler32val;
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%08X ", &pb_adler32val);
-		if (pb_adler32val != adler32val){
-			Log_print("adler32 does not match");
+		ULONG frame = pb_frame;
+		int end;
+		if (playbacktextfp != NULL) {
+			gzgets(playbacktextfp, gzbuf, GZBUFSIZE);
+			sscanf(gzbuf, "%08X ", &pb_adler32val);
+			end = gzeof(playbacktextfp);
+		}
+		else {
+			pb_adler32val = PlaybackFrameEnd();
+			end = pb_next_type == EV_END && pb_frame >= pb_next_frame;
+		}
+		if (skip_check)
+			skip_check = FALSE;
+		else if (pb_adler32val != adler32val) {
+			if (playbacktextfp != NULL)
+				Log_print("adler32 does not match");
+			else
+				Log_print("adler32 does not match at frame %lu", (unsigned long) frame);
 			adler32_errors++;
 		}
-		
-	}
-	if (playingback && gzeof(playbackfp)) {
-		playingback = FALSE;
-		gzclose(playbackfp);
-		if (playingback_exit_after) { /* exit emulation when not set otherwise */
-			Atari800_ErrExit();
-			exit(adler32_errors > 0 ? 1 : 0); /* return code indicates errors*/
+		if (end) {
+			playingback = FALSE;
+			ClosePlayback();
+			if (playingback_exit_after) { /* exit emulation when not set otherwise */
+				Atari800_ErrExit();
+				exit(adler32_errors > 0 ? 1 : 0); /* return code indicates errors*/
+			}
 		}
 	}
 }
@@ -947,7 +1592,10 @@ int INPUT_Playingback(void)
 void INPUT_RecordInt(int i)
 {
 #ifdef EVENT_RECORDING
-	if (recording) gzprintf(recordfp, "%d\n", i);
+	if (recording) {
+		RecordHeader(EV_INT);
+		PutSigned(recordfp, i);
+	}
 #endif
 }
 
@@ -956,13 +1604,62 @@ int INPUT_PlaybackInt(void)
 	int i = 0;
 #ifdef EVENT_RECORDING
 	if (playingback) {
-		gzgets(playbackfp, gzbuf, GZBUFSIZE);
-		sscanf(gzbuf, "%d", &i);
+		if (playbacktextfp != NULL) {
+			gzgets(playbacktextfp, gzbuf, GZBUFSIZE);
+			sscanf(gzbuf, "%d", &i);
+		}
+		else if (pb_next_type == EV_INT) {
+			i = GetSigned(playbackfp);
+			PlaybackNextRecord();
+		}
 	}
 #endif
 	return i;
 }
 
+int INPUT_PlaybackFrame(void)
+{
+#ifdef EVENT_RECORDING
+	if (playingback && playbackfp != NULL)
+		return (int) pb_frame;
+#endif
+	return -1;
+}
+
+int INPUT_PlaybackLength(void)
+{
+#ifdef EVENT_RECORDING
+	if (playingback && playbackfp != NULL)
+		return (int) pb_length;
+#endif
+	return -1;
+}
+
+int INPUT_PlaybackSeek(int frame)
+{
+#ifdef EVENT_RECORDING
+	if (!playingback || playbackfp == NULL || frame < 0 || (ULONG) frame >= pb_length)
+		return FALSE;
+	/* going back needs a keyframe */
+	if ((ULONG) frame < pb_frame && FindKeyframe((ULONG) frame) < 0)
+		return FALSE;
+	seek_target = frame;
+	seek_pending = TRUE;
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+int INPUT_Seeking(void)
+{
+#ifdef EVENT_RECORDING
+	return seek_target >= 0;
+#else
+	return FALSE;
+#endif
+}
+
 void INPUT_Scanline(void)
 {
 	if (--scanline_counter == 0) {
@@ -1032,6 +1729,7 @@ void INPUT_DrawMousePointer(void)
 		int y = mouse_y >> MOUSE_SHIFT;
 		if (x >= 0 && x <= 167 && y >= 0 && y <= 119) {
 			UWORD *ptr = & ((UWORD *) Screen_atari)[12 + x + Screen_WIDTH * y];
+			Screen_LinesDirty(2 * y - 4, 10);
 			PLOT(-2, 0);
 			PLOT(-1, 0);
 			PLOT(1, 0);
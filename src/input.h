@@ -78,6 +78,22 @@ extern int INPUT_direct_mouse;      /* When true, convert the mouse pointer
 extern int INPUT_cx85;      /* emulate CX85 numeric keypad */
 /* Functions ----------------------------------------------------------- */
 
+#ifdef LIBATARI800
+/* Edge detection state of the input handling, which is not part of a state
+   save. libatari800 keeps a copy for each emulator context. */
+typedef struct {
+	int last_key_code;
+	int last_key_break;
+	UBYTE last_stick[4];
+	int last_mouse_buttons;
+	int mouse_x;
+	int mouse_y;
+} INPUT_latches_t;
+
+void INPUT_SaveLatches(INPUT_latches_t *latches);
+void INPUT_LoadLatches(const INPUT_latches_t *latches);
+#endif /* LIBATARI800 */
+
 int INPUT_Initialise(int *argc, char *argv[]);
 void INPUT_Exit(void);
 void INPUT_Frame(void);
@@ -90,6 +106,22 @@ int INPUT_Playingback(void);
 void INPUT_RecordInt(int i);
 int INPUT_PlaybackInt(void);
 
+/* Interval in seconds between the keyframes stored in event recordings.
+   0 stores no keyframes, so the playback can't seek backwards. */
+extern int INPUT_keyframe_seconds;
+/* Number of the frame being played back and the number of frames in the
+   recording, or -1 if not playing back a seekable recording. */
+int INPUT_PlaybackFrame(void);
+int INPUT_PlaybackLength(void);
+/* Continues the playback at FRAME: the emulation is restored from the
+   nearest preceding keyframe (unless FRAME is ahead in the same keyframe
+   interval) and runs as fast as possible up to FRAME. Returns FALSE if
+   FRAME can't be reached. */
+int INPUT_PlaybackSeek(int frame);
+/* Returns TRUE while the emulation runs up to the frame given to
+   INPUT_PlaybackSeek. */
+int INPUT_Seeking(void);
+
 #ifdef DREAMCAST
 extern int Atari_POT(int);
 #elif SDL2
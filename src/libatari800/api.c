@@ -35,12 +35,16 @@
 #include "../input.h"
 #include "log.h"
 #include "antic.h"
+#include "colours.h"
 #include "cpu.h"
 #include "platform.h"
 #include "memory.h"
 #include "screen.h"
 #include "sio.h"
 #include "../sound.h"
+#ifdef REWIND
+#include "rewind.h"
+#endif
 #include "util.h"
 #include "libatari800/main.h"
 #include "libatari800/cpu_crash.h"
@@ -189,6 +193,13 @@ void libatari800_clear_input_array(input_template_t *input)
 }
 
 
+#ifdef DECODE_CACHE
+/* TRUE once the caller got a pointer to the main memory, through which it
+   may change instructions that the CPU has pre-decoded */
+static int main_memory_shared = FALSE;
+#endif
+
+
 /** Perform one video frame's worth of emulation
  * 
  * This is the main driver for libatari800. This function runs the emulator for enough
@@ -208,6 +219,10 @@ void libatari800_clear_input_array(input_template_t *input)
  */
 int libatari800_next_frame(input_template_t *input)
 {
+#ifdef DECODE_CACHE
+	if (main_memory_shared)
+		MEMORY_DecodeFlush();
+#endif
 	LIBATARI800_Input_array = input;
 	INPUT_key_code = PLATFORM_Keyboard();
 	LIBATARI800_Mouse();
@@ -251,6 +266,19 @@ int libatari800_mount_disk_image(int diskno, const char *filename, int readonly)
 }
 
 
+/** Write changes to disk images back to their files
+ *
+ * Mounted disk images are kept in memory, and sectors written by the emulated
+ * machine are written back to the image files after a second without disk
+ * writes (see the \a -disk-writeback option), or when the disk is removed.
+ * This writes all pending changes immediately.
+ */
+void libatari800_flush_disks(void)
+{
+	SIO_FlushDisks();
+}
+
+
 /** Restart emulation using file
  * 
  * Perform a cold start with a disk image, executable file, cartridge, cassette image,
@@ -290,6 +318,9 @@ int libatari800_reboot_with_file(const char *filename)
  */
 UBYTE *libatari800_get_main_memory_ptr()
 {
+#ifdef DECODE_CACHE
+	main_memory_shared = TRUE;
+#endif
 	return MEMORY_mem;
 }
 
@@ -318,6 +349,150 @@ UBYTE *libatari800_get_screen_ptr()
 }
 
 
+/** Set how often the screen is drawn
+ *
+ * Drawing the screen is a large part of the time needed to emulate a frame,
+ * so callers that only examine memory can skip it on most frames. Frames that
+ * are not drawn leave the previous contents in the screen array, and unless
+ * the ACCURATE_SKIPPED_FRAMES configuration option is set, player/missile
+ * collisions are not detected in them.
+ *
+ * With an interval of N, the screen is drawn in the frames after which
+ * \a libatari800_get_frame_number returns a multiple of N. This is the same
+ * setting as the \a -refresh command line argument.
+ *
+ * @param interval draw every \a interval frames (1 draws all frames), or 0 to
+ * draw only frames requested through \a libatari800_request_render
+ */
+void libatari800_set_render_interval(int interval)
+{
+	if (interval < 1) {
+		LIBATARI800_render_on_request = TRUE;
+	}
+	else {
+		LIBATARI800_render_on_request = FALSE;
+		Atari800_refresh_rate = interval;
+	}
+}
+
+
+/** Request that the next frame be drawn
+ *
+ * When the render interval is 0, draws the screen in the frame generated by
+ * the next call to \a libatari800_next_frame. Has no effect otherwise.
+ */
+void libatari800_request_render()
+{
+	LIBATARI800_render_requested = TRUE;
+}
+
+
+/** Check whether the screen was drawn in the last frame
+ *
+ * @retval TRUE if the screen array was updated by the last call to
+ * \a libatari800_next_frame
+ * @retval FALSE if it still holds an older frame
+ */
+int libatari800_screen_rendered()
+{
+	return Atari800_display_screen;
+}
+
+
+/** Get the screen lines that changed
+ *
+ * Reports which lines of the screen array changed since the previous call,
+ * so that a caller copying the screen elsewhere can skip the others. Lines
+ * that are drawn from exactly the same data as in the previous frame are not
+ * even drawn by the emulator. In builds with NEW_CYCLE_EXACT every line that
+ * is drawn is reported as changed.
+ *
+ * Line y is bit (y & 7) of byte (y >> 3) of the bitmap. All lines are
+ * reported as changed after the screen is replaced as a whole, e.g. by
+ * switching to another context.
+ *
+ * @param lines array of \a LIBATARI800_DIRTY_LINES_SIZE bytes that receives
+ * the bitmap
+ *
+ * @returns number of changed lines
+ */
+int libatari800_get_dirty_lines(UBYTE *lines)
+{
+	int count = 0;
+	int y;
+
+	memcpy(lines, Screen_dirty_lines, LIBATARI800_DIRTY_LINES_SIZE);
+	memset(Screen_dirty_lines, 0, LIBATARI800_DIRTY_LINES_SIZE);
+	for (y = 0; y < Screen_HEIGHT; y++) {
+		if (lines[y >> 3] & (1 << (y & 7)))
+			count++;
+	}
+	return count;
+}
+
+
+/** Set whether the on-screen indicators are drawn
+ *
+ * The emulator can draw the emulation speed, the disk drive activity LED and
+ * the 1200XL keyboard LEDs on the screen, which is undesirable when the screen
+ * is used as input for another program.
+ *
+ * @param show if FALSE, none of the indicators are drawn
+ */
+void libatari800_show_overlays(int show)
+{
+	LIBATARI800_show_overlays = show;
+}
+
+
+/** Get the size of the converted screen
+ *
+ * Returns how large a buffer \a libatari800_get_converted_screen needs for
+ * \a format.
+ *
+ * @param format conversion format, see \a libatari800_get_converted_screen
+ * @param width receives the width of the converted screen in pixels
+ * @param height receives the height of the converted screen in pixels
+ *
+ * @returns size of the converted screen in bytes, or 0 if \a format is
+ * invalid
+ */
+int libatari800_get_converted_screen_size(int format, int *width, int *height)
+{
+	return LIBATARI800_Video_ConvertedSize(format, width, height);
+}
+
+
+/** Convert the screen to RGB or grayscale pixels
+ *
+ * Looks up the palette indices of the screen array in the current palette
+ * and stores the pixels in scan line order in \a buffer, so that callers
+ * don't have to convert the screen themselves. The format is one of:
+ *
+ * - LIBATARI800_SCREEN_RGB24: 3 bytes per pixel, red, green and blue
+ * - LIBATARI800_SCREEN_RGBA32: 4 bytes per pixel, red, green, blue and 255
+ * - LIBATARI800_SCREEN_GRAY8: 1 byte per pixel, the luma of the color
+ *
+ * or'ed with any of the flags:
+ *
+ * - LIBATARI800_SCREEN_VISIBLE: convert only the visible area of the screen,
+ *   the 336x240 pixels without the side overscan areas
+ * - LIBATARI800_SCREEN_HALF: halve the width and the height; each pixel is
+ *   the average of a block of 2x2 pixels
+ *
+ * @param buffer receives the converted screen; it must hold at least the
+ * number of bytes returned by \a libatari800_get_converted_screen_size
+ * @param format conversion format
+ *
+ * @returns number of bytes stored in \a buffer, or 0 if \a format is
+ * invalid
+ */
+int libatari800_get_converted_screen(UBYTE *buffer, int format)
+{
+	return LIBATARI800_Video_Convert((const UBYTE *)Screen_atari, Colours_table, buffer, format);
+}
+
+
 /** Return pointer to sound data
  *
  * If sound is used, each emulated frame will fill the sound buffer with samples
@@ -479,6 +654,163 @@ void libatari800_restore_state(emulator_state_t *state)
 }
 
 
+/* Layout of a delta-compressed state save: three ULONGs holding the total size
+   of the delta, the number of bytes of the emulator_state_t that are in use
+   and the number of pages, followed by each changed page as a 2 byte little
+   endian page number and the page data. The last page may be short. */
+#define DELTA_HEADER_SIZE 12
+
+static emulator_state_t *delta_scratch = NULL;
+
+static ULONG StateUsedSize(const emulator_state_t *state)
+{
+	return (ULONG)(state->state - (const UBYTE *)state) + state->tags.size;
+}
+
+static emulator_state_t *DeltaScratch(void)
+{
+	if (delta_scratch == NULL)
+		delta_scratch = (emulator_state_t *)Util_malloc(sizeof(emulator_state_t));
+	return delta_scratch;
+}
+
+
+/** Save the state of the emulator delta-compressed against a reference
+ *
+ * Saves the current state like \a libatari800_get_current_state, but stores
+ * only the \a LIBATARI800_STATE_PAGE_SIZE byte pages of the save that differ
+ * from the reference state \a ref. Between consecutive frames most of the
+ * main memory and all of the unused extended memory banks are unchanged, so
+ * the result is usually a few kilobytes instead of the full save, which makes
+ * it practical to keep a snapshot of every frame.
+ *
+ * This is compression only: there is no tracking of written memory. Every
+ * delta makes a complete state save and compares all of it with \a ref, so
+ * it takes longer than \a libatari800_get_current_state (on a 130XE about
+ * 1.6 times as long). In exchange RAM changed through any path (CPU, SIO,
+ * bank switching, patches, the main memory pointer) is always included.
+ *
+ * The delta can be turned back into a full state by
+ * \a libatari800_apply_state_delta, or restored directly by
+ * \a libatari800_restore_state_delta, using the same reference state.
+ *
+ * @param ref reference state from \a libatari800_get_current_state, or NULL
+ * to store all pages
+ *
+ * @param delta buffer of at least \a LIBATARI800_STATE_DELTA_MAX_SIZE bytes
+ *
+ * @returns number of bytes of \a delta that are used
+ */
+int libatari800_get_state_delta(const emulator_state_t *ref, UBYTE *delta)
+{
+	emulator_state_t *current = DeltaScratch();
+	const UBYTE *cur = (const UBYTE *)current;
+	const UBYTE *old = (const UBYTE *)ref;
+	ULONG used, ref_used, offset, num_pages = 0;
+	UBYTE *p = delta + DELTA_HEADER_SIZE;
+
+	libatari800_get_current_state(current);
+	used = StateUsedSize(current);
+	ref_used = ref != NULL ? StateUsedSize(ref) : 0;
+	for (offset = 0; offset < used; offset += LIBATARI800_STATE_PAGE_SIZE) {
+		ULONG len = used - offset;
+		ULONG page = offset / LIBATARI800_STATE_PAGE_SIZE;
+		if (len > LIBATARI800_STATE_PAGE_SIZE)
+			len = LIBATARI800_STATE_PAGE_SIZE;
+		/* the header page changes every frame, so is always stored */
+		if (page > 0 && offset + len <= ref_used && memcmp(cur + offset, old + offset, len) == 0)
+			continue;
+		*p++ = (UBYTE)page;
+		*p++ = (UBYTE)(page >> 8);
+		memcpy(p, cur + offset, len);
+		p += len;
+		num_pages++;
+	}
+	offset = (ULONG)(p - delta);
+	memcpy(delta, &offset, 4);
+	memcpy(delta + 4, &used, 4);
+	memcpy(delta + 8, &num_pages, 4);
+	return (int)offset;
+}
+
+
+/** Rebuild a full state from a delta-compressed state save
+ *
+ * Patches the pages stored in \a delta into \a state, which must hold a copy
+ * of the reference state that was passed to \a libatari800_get_state_delta.
+ * Afterwards \a state is the same as the one \a libatari800_get_current_state
+ * would have returned at the time of the delta-compressed save.
+ *
+ * @param state copy of the reference state, modified in place
+ * @param delta delta-compressed save from \a libatari800_get_state_delta
+ */
+void libatari800_apply_state_delta(emulator_state_t *state, const UBYTE *delta)
+{
+	UBYTE *dst = (UBYTE *)state;
+	const UBYTE *p = delta + DELTA_HEADER_SIZE;
+	ULONG used, num_pages;
+
+	memcpy(&used, delta + 4, 4);
+	memcpy(&num_pages, delta + 8, 4);
+	while (num_pages-- > 0) {
+		ULONG offset = (p[0] | (p[1] << 8)) * LIBATARI800_STATE_PAGE_SIZE;
+		ULONG len = used - offset;
+		if (len > LIBATARI800_STATE_PAGE_SIZE)
+			len = LIBATARI800_STATE_PAGE_SIZE;
+		memcpy(dst + offset, p + 2, len);
+		p += 2 + len;
+	}
+}
+
+
+/** Restore the state of the emulator from a delta-compressed state save
+ *
+ * Same as applying \a delta to a copy of \a ref and passing the result to
+ * \a libatari800_restore_state, but \a ref is left unchanged. Like that
+ * call, it restores the complete state.
+ *
+ * @param ref reference state that was used to create \a delta
+ * @param delta delta-compressed save from \a libatari800_get_state_delta
+ */
+void libatari800_restore_state_delta(const emulator_state_t *ref, const UBYTE *delta)
+{
+	emulator_state_t *state = DeltaScratch();
+	ULONG used;
+
+	memcpy(&used, delta + 4, 4);
+	if (ref != NULL)
+		memcpy(state, ref, used);
+	libatari800_apply_state_delta(state, delta);
+	libatari800_restore_state(state);
+}
+
+
+/** Run the emulation backwards
+ *
+ * Returns the emulator to the state it had \a frames frames ago, using the
+ * rewind history kept in memory. The history is only recorded when it has
+ * been enabled with the "-rewind <seconds>" argument to \a libatari800_init;
+ * "-rewind-memory <MB>" limits the memory it uses. States newer than the
+ * restored one are discarded, so emulation continues from the restored state.
+ *
+ * Each context keeps its own history, enabled by the arguments to
+ * \a libatari800_create.
+ *
+ * @param frames number of frames to go back
+ *
+ * @returns number of frames actually rewound, which is less than \a frames if
+ * the history is shorter, and zero if there is no history.
+ */
+int libatari800_rewind(int frames)
+{
+#ifdef REWIND
+	return REWIND_Back(frames);
+#else
+	return 0;
+#endif
+}
+
+
 /** Free resources used by the emulator.
  *
  * Release any memory or other resources used by the emulator. Further calls to
@@ -488,6 +820,8 @@ void libatari800_restore_state(emulator_state_t *state)
  */
 void libatari800_exit() {
 	Atari800_Exit(0);
+	free(delta_scratch);
+	delta_scratch = NULL;
 }
 
 /*
@@ -0,0 +1,789 @@
+/*
+ * libatari800/context.c - Atari800 as a library - multiple emulator instances
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Atari800 includes */
+#include "atari.h"
+#include "cfg.h"
+#ifdef MONITOR_TRACE
+#include "cputrace.h"
+#endif
+#if defined(AUDIO_RECORDING) || defined(VIDEO_RECORDING)
+#include "file_export.h"
+#endif
+#include "gtia.h"
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+#include "colours.h"
+#endif
+#include "log.h"
+#include "memory.h"
+#include "screen.h"
+#include "sio.h"
+#ifdef SOUND
+#include "../sound.h"
+#endif
+#ifndef BASIC
+#include "ui.h"
+#endif
+#include "util.h"
+#include "libatari800/context.h"
+#include "libatari800/cpu_crash.h"
+#include "libatari800/sound.h"
+#include "libatari800/video.h"
+
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_WAIT_H) && defined(HAVE_UNISTD_H) \
+	&& defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#define STEP_PROCESSES
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+#endif
+
+/* The emulator core keeps the state of the machine in global variables, so
+   only one machine can be running at any time. While a context is inactive it
+   holds a complete state save of its machine, plus what a state save leaves
+   out: the screen and sound output of its last frame, the input edge
+   detection, the console keys held down while the machine boots, the screen
+   drawing settings and the rewind history. The context is swapped into the core when it is used.
+
+   The settings that a state save leaves out, such as the ROM selection or
+   whether BASIC is disabled, are those of the configuration file. Each
+   context keeps them in configuration file form, captured after its
+   arguments were processed, and they are loaded back into the core, along
+   with the ROMs they select, when the context is activated after one with
+   different settings. The sound output format is set up by the platform
+   layer and is the same for all contexts. */
+
+libatari800_context_t *LIBATARI800_Context_active = NULL;
+
+/* Settings currently loaded in the core, NULL if unknown */
+static const char *core_config = NULL;
+static int num_contexts = 0;
+#ifdef SOUND
+/* Sound output format of the existing contexts */
+static Sound_setup_t context_sound;
+#endif
+
+/* Returns the current settings in configuration file form, or NULL on
+   error. */
+static char *CaptureConfig(void)
+{
+	FILE *fp = tmpfile();
+	char *config;
+	long size;
+
+	if (fp == NULL)
+		return NULL;
+	CFG_WriteConfigTo(fp);
+	size = ftell(fp);
+	if (size < 0) {
+		fclose(fp);
+		return NULL;
+	}
+	config = (char *)Util_malloc(size + 1);
+	rewind(fp);
+	if (fread(config, 1, size, fp) != (size_t)size) {
+		free(config);
+		fclose(fp);
+		return NULL;
+	}
+	config[size] = '\0';
+	fclose(fp);
+	return config;
+}
+
+static void ApplyConfig(const char *config)
+{
+	FILE *fp = tmpfile();
+	int tv_mode = Atari800_tv_mode;
+	int new_tv_mode;
+
+	if (fp == NULL) {
+		Log_print("Cannot load the settings of the emulator context");
+		return;
+	}
+	fputs(config, fp);
+	rewind(fp);
+#ifndef BASIC
+	/* the directory lists are appended to, so start them afresh */
+	UI_n_atari_files_dir = 0;
+	UI_n_saved_files_dir = 0;
+#endif
+	CFG_ReadConfigFrom(fp);
+	fclose(fp);
+	/* let Atari800_SetTVMode update what depends on the TV mode */
+	new_tv_mode = Atari800_tv_mode;
+	Atari800_tv_mode = tv_mode;
+	Atari800_SetTVMode(new_tv_mode);
+#if !defined(BASIC) && !defined(CURSES_BASIC)
+	Colours_Update();
+#endif
+	Atari800_InitialiseMachine();
+	core_config = config;
+}
+
+static void ContextSave(libatari800_context_t *ctx)
+{
+	libatari800_get_current_state(ctx->state);
+	memcpy(ctx->screen, Screen_atari, Screen_WIDTH * Screen_HEIGHT);
+	memcpy(ctx->palette, Colours_table, sizeof(ctx->palette));
+	ctx->sound_fill = sound_array_fill < ctx->sound_size ? sound_array_fill : ctx->sound_size;
+	memcpy(ctx->sound, LIBATARI800_Sound_array, ctx->sound_fill);
+	ctx->error_code = libatari800_error_code;
+	ctx->continue_on_brk = libatari800_continue_on_brk;
+	ctx->consol_override = GTIA_consol_override;
+	ctx->render_on_request = LIBATARI800_render_on_request;
+	ctx->render_requested = LIBATARI800_render_requested;
+	ctx->refresh_rate = Atari800_refresh_rate;
+	ctx->show_overlays = LIBATARI800_show_overlays;
+	ctx->screen_rendered = Atari800_display_screen;
+	INPUT_SaveLatches(&ctx->input_latches);
+#ifdef REWIND
+	ctx->rewind = REWIND_Detach();
+#endif
+}
+
+static void ContextLoad(libatari800_context_t *ctx)
+{
+	libatari800_restore_state(ctx->state);
+	memcpy(Screen_atari, ctx->screen, Screen_WIDTH * Screen_HEIGHT);
+	Screen_EntireDirty();
+	sound_array_fill = ctx->sound_fill < sound_hw_buffer_size ? ctx->sound_fill : sound_hw_buffer_size;
+	memcpy(LIBATARI800_Sound_array, ctx->sound, sound_array_fill);
+	libatari800_error_code = ctx->error_code;
+	libatari800_continue_on_brk = ctx->continue_on_brk;
+	GTIA_consol_override = ctx->consol_override;
+	LIBATARI800_render_on_request = ctx->render_on_request;
+	LIBATARI800_render_requested = ctx->render_requested;
+	Atari800_refresh_rate = ctx->refresh_rate;
+	LIBATARI800_show_overlays = ctx->show_overlays;
+	Atari800_display_screen = ctx->screen_rendered;
+	INPUT_LoadLatches(&ctx->input_latches);
+#ifdef REWIND
+	REWIND_Attach(ctx->rewind);
+	ctx->rewind = NULL;
+#endif
+}
+
+void LIBATARI800_Context_Activate(libatari800_context_t *ctx)
+{
+	if (ctx == LIBATARI800_Context_active)
+		return;
+	if (LIBATARI800_Context_active != NULL)
+		ContextSave(LIBATARI800_Context_active);
+	if (core_config == NULL || strcmp(core_config, ctx->config) != 0)
+		ApplyConfig(ctx->config);
+	ContextLoad(ctx);
+	LIBATARI800_Context_active = ctx;
+}
+
+static void ContextFree(libatari800_context_t *ctx)
+{
+	free(ctx->state);
+	free(ctx->screen);
+	free(ctx->sound);
+	free(ctx->config);
+#ifdef REWIND
+	REWIND_FreeHistory(ctx->rewind);
+#endif
+	free(ctx);
+}
+
+
+/** Create a new emulator instance
+ *
+ * Creates an independent emulated machine configured by the supplied argument
+ * list, which takes the same form as in \a libatari800_init. Any number of
+ * contexts can exist at the same time; each one keeps its own settings,
+ * memory, CPU and chip state, disk drives, screen and sound buffer. The
+ * sound output format (sample rate, sample size and channels) is shared, so
+ * it must be the same for all contexts.
+ *
+ * The new context becomes the active one, so the non-context \a libatari800_*
+ * functions operate on it until another context is used.
+ *
+ * @param argc number of arguments in @a argv, or -1 if \a argv contains a NULL
+ * terminated list.
+ *
+ * @param argv list of arguments.
+ *
+ * @returns pointer to the new context, or NULL if error in argument list
+ */
+libatari800_context_t *libatari800_create(int argc, char **argv)
+{
+	libatari800_context_t *ctx;
+
+	ctx = (libatari800_context_t *)Util_malloc(sizeof(libatari800_context_t));
+	memset(ctx, 0, sizeof(libatari800_context_t));
+	ctx->state = (emulator_state_t *)Util_malloc(sizeof(emulator_state_t));
+	ctx->screen = (UBYTE *)Util_malloc(Screen_WIDTH * Screen_HEIGHT);
+
+	/* park the running machine before the core is reinitialised */
+	if (LIBATARI800_Context_active != NULL) {
+		ContextSave(LIBATARI800_Context_active);
+		LIBATARI800_Context_active = NULL;
+	}
+
+	core_config = NULL;
+	if (!libatari800_init(argc, argv)) {
+		ContextFree(ctx);
+		return NULL;
+	}
+#ifdef SOUND
+	if (num_contexts > 0 && (Sound_out.freq != context_sound.freq
+		|| Sound_out.sample_size != context_sound.sample_size
+		|| Sound_out.channels != context_sound.channels)) {
+		Log_print("The sound output format must be the same for all contexts");
+		ContextFree(ctx);
+		return NULL;
+	}
+	context_sound = Sound_out;
+#endif
+	ctx->config = CaptureConfig();
+	if (ctx->config == NULL) {
+		Log_print("Cannot store the settings of the emulator context");
+		ContextFree(ctx);
+		return NULL;
+	}
+	core_config = ctx->config;
+	num_contexts++;
+	ctx->sound_size = sound_hw_buffer_size;
+	ctx->sound = (UBYTE *)Util_malloc(ctx->sound_size > 0 ? ctx->sound_size : 1);
+	LIBATARI800_Context_active = ctx;
+	return ctx;
+}
+
+
+/** Free an emulator instance
+ *
+ * Releases the memory used by the context. The context must not be used after
+ * this call. Other contexts are unaffected.
+ *
+ * @param ctx context created by \a libatari800_create
+ */
+void libatari800_destroy(libatari800_context_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+	if (ctx == LIBATARI800_Context_active) {
+		LIBATARI800_Context_active = NULL;
+#ifdef REWIND
+		REWIND_Clear();
+#endif
+	}
+	if (core_config == ctx->config)
+		core_config = NULL;
+	num_contexts--;
+	ContextFree(ctx);
+}
+
+
+/** Perform one video frame's worth of emulation on the given instance
+ *
+ * Same as \a libatari800_next_frame, but for the machine in \a ctx.
+ *
+ * @param ctx emulator context
+ * @param input input template structure defining the user input for the frame
+ *
+ * @returns same as \a libatari800_next_frame
+ */
+int libatari800_context_next_frame(libatari800_context_t *ctx, input_template_t *input)
+{
+	LIBATARI800_Context_Activate(ctx);
+	return libatari800_next_frame(input);
+}
+
+
+/* Runs FRAMES frames on the active context with INPUT. Returns TRUE if all
+   of them were emulated. */
+static int StepActive(input_template_t *input, int frames)
+{
+	int f;
+	for (f = 0; f < frames; f++) {
+		if (!libatari800_next_frame(input)
+			&& libatari800_error_code != LIBATARI800_DLIST_ERROR)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static int StepSerial(libatari800_context_t *ctx[], input_template_t inputs[], int n, int frames)
+{
+	int i;
+	int first = 0;
+	int ok = 0;
+
+	for (i = 0; i < n; i++) {
+		if (ctx[i] == LIBATARI800_Context_active) {
+			first = i;
+			break;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		int c = (first + i) % n;
+		LIBATARI800_Context_Activate(ctx[c]);
+		if (StepActive(&inputs[c], frames))
+			ok++;
+	}
+	return ok;
+}
+
+#ifdef STEP_PROCESSES
+/* libatari800_step_many forks worker processes, each with its own copy of
+   the emulator core. The workers and the calling process take contexts from
+   a shared counter until all are done, so faster contexts don't hold up the
+   others. A worker sends the parked context back through a slot of a shared
+   memory area: a step_slot_t followed by the state save, the screen and the
+   sound buffer. */
+
+#define SLOT_BY_WORKER 1
+#define SLOT_BY_CALLER 2
+
+typedef struct {
+	int done;  /* 0, SLOT_BY_WORKER or SLOT_BY_CALLER */
+	int ok;
+	unsigned int sound_fill;
+	int error_code;
+	int continue_on_brk;
+	int consol_override;
+	int render_requested;
+	int screen_rendered;
+	INPUT_latches_t input_latches;
+} step_slot_t;
+
+#define STEP_ALIGN(x) (((x) + 63) & ~(size_t)63)
+
+static UBYTE *step_area = NULL;
+static size_t step_area_size = 0;
+
+static int StepProcesses(void)
+{
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count > 0)
+		return (int)count;
+#endif
+	return 1;
+}
+
+/* Makes the shared area at least SIZE bytes. Returns FALSE on error. */
+static int StepArea(size_t size)
+{
+	void *area;
+	if (size <= step_area_size)
+		return TRUE;
+	if (step_area != NULL) {
+		munmap(step_area, step_area_size);
+		step_area = NULL;
+		step_area_size = 0;
+	}
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		return FALSE;
+	step_area = (UBYTE *)area;
+	step_area_size = size;
+	return TRUE;
+}
+
+/* Steps contexts taken from the shared counter until there are none left.
+   A worker process copies each context to its slot, the calling process
+   leaves it parked in the context itself. */
+static void StepTake(libatari800_context_t *ctx[], input_template_t inputs[], int n, int frames,
+                     size_t slot_size, int worker)
+{
+	int *next = (int *)step_area;
+	for (;;) {
+		int i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+		UBYTE *p;
+		step_slot_t *slot;
+		int ok;
+
+		if (i >= n)
+			break;
+		p = step_area + STEP_ALIGN(sizeof(int)) + i * slot_size;
+		slot = (step_slot_t *)p;
+		LIBATARI800_Context_Activate(ctx[i]);
+		ok = StepActive(&inputs[i], frames);
+		/* the worker's changes to disk images must reach the files */
+		SIO_FlushDisks();
+		if (worker) {
+			libatari800_context_t *c = ctx[i];
+			ContextSave(c);
+			LIBATARI800_Context_active = NULL;
+			p += STEP_ALIGN(sizeof(step_slot_t));
+			memcpy(p, c->state, sizeof(emulator_state_t));
+			p += STEP_ALIGN(sizeof(emulator_state_t));
+			memcpy(p, c->screen, Screen_WIDTH * Screen_HEIGHT);
+			p += STEP_ALIGN(Screen_WIDTH * Screen_HEIGHT);
+			memcpy(p, c->sound, c->sound_fill);
+			slot->sound_fill = c->sound_fill;
+			slot->error_code = c->error_code;
+			slot->continue_on_brk = c->continue_on_brk;
+			slot->consol_override = c->consol_override;
+			slot->render_requested = c->render_requested;
+			slot->screen_rendered = c->screen_rendered;
+			slot->input_latches = c->input_latches;
+		}
+		slot->ok = ok;
+		__atomic_store_n(&slot->done, worker ? SLOT_BY_WORKER : SLOT_BY_CALLER, __ATOMIC_RELEASE);
+	}
+}
+
+/* Returns TRUE if the frames must be emulated by the calling process,
+   because what they produce would be lost in a worker or would mix with the
+   output of other workers. A worker also has none of the threads of the
+   calling process, so it would wait forever for the recording encoder or the
+   trace writer. */
+static int MustStepHere(libatari800_context_t *ctx[], int n)
+{
+#ifdef REWIND
+	int i;
+	/* the histories recorded by the workers would be lost */
+	for (i = 0; i < n; i++) {
+		if (REWIND_Recording(ctx[i]->rewind))
+			return TRUE;
+	}
+#endif
+#if defined(AUDIO_RECORDING) || defined(VIDEO_RECORDING)
+	if (File_Export_IsRecording())
+		return TRUE;
+#endif
+#ifdef EVENT_RECORDING
+	if (INPUT_Recording() || INPUT_Playingback())
+		return TRUE;
+#endif
+#ifdef MONITOR_TRACE
+	if (CPUTRACE_active)
+		return TRUE;
+#endif
+	return FALSE;
+}
+
+/* Returns the number of contexts that emulated all frames, or -1 if the
+   worker processes can't be used. */
+static int StepParallel(libatari800_context_t *ctx[], input_template_t inputs[], int n, int frames)
+{
+	int workers = StepProcesses();
+	unsigned int sound_size = 0;
+	size_t slot_size;
+	pid_t *pids;
+	int started = 0;
+	int ok = 0;
+	int i;
+
+	if (workers > n)
+		workers = n;
+	if (workers < 2 || MustStepHere(ctx, n))
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (ctx[i]->sound_size > sound_size)
+			sound_size = ctx[i]->sound_size;
+	}
+	slot_size = STEP_ALIGN(sizeof(step_slot_t)) + STEP_ALIGN(sizeof(emulator_state_t))
+		+ STEP_ALIGN(Screen_WIDTH * Screen_HEIGHT) + STEP_ALIGN(sound_size);
+	if (!StepArea(STEP_ALIGN(sizeof(int)) + n * slot_size))
+		return -1;
+	*(int *)step_area = 0;
+	for (i = 0; i < n; i++)
+		((step_slot_t *)(step_area + STEP_ALIGN(sizeof(int)) + i * slot_size))->done = 0;
+
+	/* the workers start from the parked contexts and the files on disk */
+	if (LIBATARI800_Context_active != NULL) {
+		ContextSave(LIBATARI800_Context_active);
+		LIBATARI800_Context_active = NULL;
+	}
+	SIO_FlushDisks();
+
+	pids = (pid_t *)Util_malloc(workers * sizeof(pid_t));
+	for (i = 1; i < workers; i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			StepTake(ctx, inputs, n, frames, slot_size, TRUE);
+			_exit(0);
+		}
+		if (pid < 0)
+			break;
+		pids[started++] = pid;
+	}
+	StepTake(ctx, inputs, n, frames, slot_size, FALSE);
+	for (i = 0; i < started; i++)
+		waitpid(pids[i], NULL, 0);
+	free(pids);
+
+	for (i = 0; i < n; i++) {
+		UBYTE *p = step_area + STEP_ALIGN(sizeof(int)) + i * slot_size;
+		step_slot_t *slot = (step_slot_t *)p;
+		libatari800_context_t *c = ctx[i];
+		int done = __atomic_load_n(&slot->done, __ATOMIC_ACQUIRE);
+
+		if (done == SLOT_BY_WORKER) {
+			if (c == LIBATARI800_Context_active)
+				LIBATARI800_Context_active = NULL;
+			p += STEP_ALIGN(sizeof(step_slot_t));
+			memcpy(c->state, p, sizeof(emulator_state_t));
+			p += STEP_ALIGN(sizeof(emulator_state_t));
+			memcpy(c->screen, p, Screen_WIDTH * Screen_HEIGHT);
+			p += STEP_ALIGN(Screen_WIDTH * Screen_HEIGHT);
+			c->sound_fill = slot->sound_fill < c->sound_size ? slot->sound_fill : c->sound_size;
+			memcpy(c->sound, p, c->sound_fill);
+			c->error_code = slot->error_code;
+			c->continue_on_brk = slot->continue_on_brk;
+			c->consol_override = slot->consol_override;
+			c->render_requested = slot->render_requested;
+			c->screen_rendered = slot->screen_rendered;
+			c->input_latches = slot->input_latches;
+		}
+		else if (done == 0) {
+			/* the worker that took it failed */
+			LIBATARI800_Context_Activate(c);
+			slot->ok = StepActive(&inputs[i], frames);
+		}
+		if (slot->ok)
+			ok++;
+	}
+	return ok;
+}
+#endif /* STEP_PROCESSES */
+
+
+/** Advance several instances by a number of frames each
+ *
+ * Runs \a frames frames of emulation on each of the \a n contexts, using
+ * \a inputs[i] as the user input for every frame of \a ctx[i]. A context that
+ * reports an error stops at that frame; its error is available from
+ * \a libatari800_context_error_message. Display list errors don't stop a
+ * context, as they are normal while the machine is booting.
+ *
+ * Where the host supports it (fork and shared memory), the contexts are
+ * stepped in parallel: the emulator core keeps the running machine in global
+ * variables, so the call forks one worker process per host CPU, each with its
+ * own copy of the core. The workers and the calling process take contexts
+ * one at a time until all are done, and the workers send the resulting
+ * machine states back. Starting the workers and sending the states back
+ * costs about as much as a few frames of emulation per context, so calls
+ * should run a batch of frames rather than a single one. Disk images written
+ * to by the machines are written back to their files at the end of each
+ * context's frames; two contexts must not write to the same image file in
+ * one call.
+ *
+ * Elsewhere, with a single host CPU, when one of the contexts records a
+ * rewind history, or while an audio/video recording, an event recording or
+ * playback, or a binary CPU trace is in progress, the machines are stepped
+ * one after another: each context runs all of its frames before moving on to
+ * the next one, starting with the currently active context.
+ *
+ * @param ctx array of \a n emulator contexts
+ * @param inputs array of \a n input template structures
+ * @param n number of contexts
+ * @param frames number of frames to emulate on each context
+ *
+ * @returns number of contexts that emulated all frames without stopping
+ */
+int libatari800_step_many(libatari800_context_t *ctx[], input_template_t inputs[], int n, int frames)
+{
+#ifdef STEP_PROCESSES
+	int ok = StepParallel(ctx, inputs, n, frames);
+	if (ok >= 0)
+		return ok;
+#endif
+	return StepSerial(ctx, inputs, n, frames);
+}
+
+
+/** Get text description of latest error message of the given instance
+ *
+ * @param ctx emulator context
+ *
+ * @returns text description of error
+ */
+const char *libatari800_context_error_message(libatari800_context_t *ctx)
+{
+	LIBATARI800_Context_Activate(ctx);
+	return libatari800_error_message();
+}
+
+
+/** Use disk image in a disk drive of the given instance
+ *
+ * Same as \a libatari800_mount_disk_image, but for the machine in \a ctx.
+ */
+int libatari800_context_mount_disk_image(libatari800_context_t *ctx, int diskno, const char *filename, int readonly)
+{
+	LIBATARI800_Context_Activate(ctx);
+	return libatari800_mount_disk_image(diskno, filename, readonly);
+}
+
+
+/** Restart emulation of the given instance using file
+ *
+ * Same as \a libatari800_reboot_with_file, but for the machine in \a ctx.
+ */
+int libatari800_context_reboot_with_file(libatari800_context_t *ctx, const char *filename)
+{
+	LIBATARI800_Context_Activate(ctx);
+	return libatari800_reboot_with_file(filename);
+}
+
+
+/** Return pointer to main memory of the given instance
+ *
+ * The pointer remains valid only until the next call that uses a different
+ * context, or until the next call to \a libatari800_context_next_frame on
+ * this context; fetch it again after either.
+ *
+ * @param ctx emulator context
+ *
+ * @returns pointer to the beginning of the 64k block of main memory
+ */
+UBYTE *libatari800_context_get_main_memory_ptr(libatari800_context_t *ctx)
+{
+	if (ctx != LIBATARI800_Context_active) {
+		/* the RAM of a parked machine is in its state save, and will be
+		   loaded from there when the context becomes active */
+		return &ctx->state->state[ctx->state->tags.base_ram];
+	}
+	return libatari800_get_main_memory_ptr();
+}
+
+
+/** Return pointer to screen data of the given instance
+ *
+ * Reading the screen of an inactive context does not switch contexts.
+ *
+ * @param ctx emulator context
+ *
+ * @returns pointer to the beginning of the 92160 bytes of data holding the
+ * emulated screen.
+ */
+UBYTE *libatari800_context_get_screen_ptr(libatari800_context_t *ctx)
+{
+	if (ctx != LIBATARI800_Context_active)
+		return ctx->screen;
+	return (UBYTE *)Screen_atari;
+}
+
+
+/** Convert the screen of the given instance
+ *
+ * Same as \a libatari800_get_converted_screen, but for the machine in
+ * \a ctx. The screen is converted with the palette of the settings of
+ * \a ctx, whichever context is active.
+ */
+int libatari800_context_get_converted_screen(libatari800_context_t *ctx, UBYTE *buffer, int format)
+{
+	if (ctx != LIBATARI800_Context_active)
+		return LIBATARI800_Video_Convert(ctx->screen, ctx->palette, buffer, format);
+	return LIBATARI800_Video_Convert((const UBYTE *)Screen_atari, Colours_table, buffer, format);
+}
+
+
+/** Return pointer to sound data of the given instance
+ *
+ * @param ctx emulator context
+ *
+ * @returns pointer to the beginning of the sound sample buffer
+ */
+UBYTE *libatari800_context_get_sound_buffer(libatari800_context_t *ctx)
+{
+	if (ctx != LIBATARI800_Context_active)
+		return ctx->sound;
+	return LIBATARI800_Sound_array;
+}
+
+
+/** Return the usable size of the sound buffer of the given instance.
+ *
+ * @param ctx emulator context
+ *
+ * @returns number of bytes of valid data in the sound buffer
+ */
+int libatari800_context_get_sound_buffer_len(libatari800_context_t *ctx)
+{
+	if (ctx != LIBATARI800_Context_active)
+		return (int)ctx->sound_fill;
+	return (int)sound_array_fill;
+}
+
+
+/** Return the number of frames of emulation of the given instance
+ *
+ * @param ctx emulator context
+ *
+ * @returns number of frames that have been generated
+ */
+int libatari800_context_get_frame_number(libatari800_context_t *ctx)
+{
+	if (ctx != LIBATARI800_Context_active)
+		return (int)ctx->state->flags.nframes;
+	return Atari800_nframes;
+}
+
+
+/** Save the state of the given instance
+ *
+ * Same as \a libatari800_get_current_state, but for the machine in \a ctx.
+ */
+void libatari800_context_get_current_state(libatari800_context_t *ctx, emulator_state_t *state)
+{
+	if (ctx != LIBATARI800_Context_active) {
+		memcpy(state, ctx->state, sizeof(emulator_state_t));
+		return;
+	}
+	libatari800_get_current_state(state);
+}
+
+
+/** Restore the state of the given instance
+ *
+ * Same as \a libatari800_restore_state, but for the machine in \a ctx.
+ */
+void libatari800_context_restore_state(libatari800_context_t *ctx, emulator_state_t *state)
+{
+	LIBATARI800_Context_Activate(ctx);
+	libatari800_restore_state(state);
+}
+
+
+/** Run the emulation of the given instance backwards
+ *
+ * Same as \a libatari800_rewind, but for the machine in \a ctx.
+ */
+int libatari800_context_rewind(libatari800_context_t *ctx, int frames)
+{
+	LIBATARI800_Context_Activate(ctx);
+	return libatari800_rewind(frames);
+}
+
+/*
+vim:ts=4:sw=4:
+*/
@@ -0,0 +1,49 @@
+#ifndef LIBATARI800_CONTEXT_H_
+#define LIBATARI800_CONTEXT_H_
+
+#include <stdio.h>
+
+#include "config.h"
+#include "atari.h"
+#include "../input.h"
+#ifdef REWIND
+#include "rewind.h"
+#endif
+#include "libatari800/libatari800.h"
+
+/* Everything needed to park an emulated machine while another one is using
+   the emulator core. The machine state of the active context lives in the
+   usual global variables; only inactive contexts use the saved copies. */
+struct libatari800_context {
+	emulator_state_t *state;
+	/* settings in configuration file form */
+	char *config;
+	UBYTE *screen;
+	/* Colours_table of the settings, for converting the screen */
+	int palette[256];
+	UBYTE *sound;
+	unsigned int sound_size;
+	unsigned int sound_fill;
+	int error_code;
+	int continue_on_brk;
+	int consol_override;
+	/* screen drawing settings of libatari800_set_render_interval and
+	   libatari800_show_overlays */
+	int render_on_request;
+	int render_requested;
+	int refresh_rate;
+	int show_overlays;
+	int screen_rendered;
+	INPUT_latches_t input_latches;
+#ifdef REWIND
+	REWIND_history_t *rewind;
+#endif
+};
+
+extern libatari800_context_t *LIBATARI800_Context_active;
+
+/* Make CTX the machine that the emulator core is running, parking the
+   previously active context first. */
+void LIBATARI800_Context_Activate(libatari800_context_t *ctx);
+
+#endif /* LIBATARI800_CONTEXT_H_ */
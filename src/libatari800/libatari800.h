@@ -156,6 +156,12 @@ typedef struct {
     UBYTE state[STATESAV_MAX_SIZE];
 } emulator_state_t;
 
+/* Delta-compressed state saves hold only the pages of an emulator_state_t
+   that differ from a reference state. */
+#define LIBATARI800_STATE_PAGE_SIZE 256
+#define LIBATARI800_STATE_NUM_PAGES ((sizeof(emulator_state_t) + LIBATARI800_STATE_PAGE_SIZE - 1) / LIBATARI800_STATE_PAGE_SIZE)
+#define LIBATARI800_STATE_DELTA_MAX_SIZE (12 + 2 * LIBATARI800_STATE_NUM_PAGES + sizeof(emulator_state_t))
+
 typedef struct {
     UBYTE A;
     UBYTE P;
@@ -278,12 +284,40 @@ int libatari800_next_frame(input_template_t *input);
 
 int libatari800_mount_disk_image(int diskno, const char *filename, int readonly);
 
+void libatari800_flush_disks(void);
+
 int libatari800_reboot_with_file(const char *filename);
 
 UBYTE *libatari800_get_main_memory_ptr();
 
 UBYTE *libatari800_get_screen_ptr();
 
+void libatari800_set_render_interval(int interval);
+
+void libatari800_request_render();
+
+int libatari800_screen_rendered();
+
+/* Size of the bitmap of changed screen lines, one bit for each of the 240 lines. */
+#define LIBATARI800_DIRTY_LINES_SIZE 30
+
+int libatari800_get_dirty_lines(UBYTE *lines);
+
+void libatari800_show_overlays(int show);
+
+/* Formats of the converted screen */
+#define LIBATARI800_SCREEN_RGB24 0
+#define LIBATARI800_SCREEN_RGBA32 1
+#define LIBATARI800_SCREEN_GRAY8 2
+/* Flags that can be or'ed to the format: convert only the visible area,
+   and halve the width and height by averaging blocks of 2x2 pixels. */
+#define LIBATARI800_SCREEN_VISIBLE 0x100
+#define LIBATARI800_SCREEN_HALF 0x200
+
+int libatari800_get_converted_screen_size(int format, int *width, int *height);
+
+int libatari800_get_converted_screen(UBYTE *buffer, int format);
+
 UBYTE *libatari800_get_sound_buffer();
 
 int libatari800_get_sound_buffer_len();
@@ -304,6 +338,50 @@ void libatari800_get_current_state(emulator_state_t *state);
 
 void libatari800_restore_state(emulator_state_t *state);
 
+int libatari800_get_state_delta(const emulator_state_t *ref, UBYTE *delta);
+
+void libatari800_apply_state_delta(emulator_state_t *state, const UBYTE *delta);
+
+void libatari800_restore_state_delta(const emulator_state_t *ref, const UBYTE *delta);
+
+int libatari800_rewind(int frames);
+
 void libatari800_exit();
 
+/* Multiple emulator instances. Each context owns the complete state of one
+   emulated machine; see README.libatari800 for details. */
+typedef struct libatari800_context libatari800_context_t;
+
+libatari800_context_t *libatari800_create(int argc, char **argv);
+
+void libatari800_destroy(libatari800_context_t *ctx);
+
+int libatari800_context_next_frame(libatari800_context_t *ctx, input_template_t *input);
+
+int libatari800_step_many(libatari800_context_t *ctx[], input_template_t inputs[], int n, int frames);
+
+const char *libatari800_context_error_message(libatari800_context_t *ctx);
+
+int libatari800_context_mount_disk_image(libatari800_context_t *ctx, int diskno, const char *filename, int readonly);
+
+int libatari800_context_reboot_with_file(libatari800_context_t *ctx, const char *filename);
+
+UBYTE *libatari800_context_get_main_memory_ptr(libatari800_context_t *ctx);
+
+UBYTE *libatari800_context_get_screen_ptr(libatari800_context_t *ctx);
+
+int libatari800_context_get_converted_screen(libatari800_context_t *ctx, UBYTE *buffer, int format);
+
+UBYTE *libatari800_context_get_sound_buffer(libatari800_context_t *ctx);
+
+int libatari800_context_get_sound_buffer_len(libatari800_context_t *ctx);
+
+int libatari800_context_get_frame_number(libatari800_context_t *ctx);
+
+void libatari800_context_get_current_state(libatari800_context_t *ctx, emulator_state_t *state);
+
+void libatari800_context_restore_state(libatari800_context_t *ctx, emulator_state_t *state);
+
+int libatari800_context_rewind(libatari800_context_t *ctx, int frames);
+
 #endif /* LIBATARI800_H_ */
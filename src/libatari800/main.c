@@ -60,6 +60,9 @@
 #ifdef PBI_BB
 #include "pbi_bb.h"
 #endif
+#ifdef REWIND
+#include "rewind.h"
+#endif
 #if defined(PBI_XLD) || defined (VOICEBOX)
 #include "votraxsnd.h"
 #endif
@@ -125,16 +128,29 @@ void LIBATARI800_Frame(void)
 	VOTRAXSND_Frame(); /* for the Votrax */
 #endif
 	Devices_Frame();
+	SIO_Frame();
 	INPUT_Frame();
 	GTIA_Frame();
-	ANTIC_Frame(TRUE);
-	INPUT_DrawMousePointer();
-	Screen_DrawAtariSpeed(Util_time());
-	Screen_DrawDiskLED();
-	Screen_Draw1200LED();
+	if (LIBATARI800_Video_DrawThisFrame()) {
+		ANTIC_Frame(TRUE);
+		INPUT_DrawMousePointer();
+		if (LIBATARI800_show_overlays) {
+			Screen_DrawAtariSpeed(Util_time());
+			Screen_DrawDiskLED();
+			Screen_Draw1200LED();
+		}
+		Atari800_display_screen = TRUE;
+	}
+	else {
+		ANTIC_Frame(Atari800_collisions_in_skipped_frames);
+		Atari800_display_screen = FALSE;
+	}
 	POKEY_Frame();
 	Sound_Update();
 	Atari800_nframes++;
+#ifdef REWIND
+	REWIND_Frame();
+#endif
 }
 
 
@@ -25,17 +25,267 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#include "atari.h"
+#include "colours.h"
+#include "log.h"
 #include "platform.h"
 #include "screen.h"
+#include "libatari800/libatari800.h"
 #include "libatari800/video.h"
 
+int LIBATARI800_render_on_request = FALSE;
+int LIBATARI800_render_requested = FALSE;
+int LIBATARI800_show_overlays = TRUE;
+
 void PLATFORM_DisplayScreen(void){
 }
 
 int LIBATARI800_Video_Initialise(int *argc, char *argv[]) {
+	int i, j;
+
+	/* every context starts with the defaults */
+	LIBATARI800_render_on_request = FALSE;
+	LIBATARI800_render_requested = FALSE;
+	LIBATARI800_show_overlays = TRUE;
+
+	for (i = j = 1; i < *argc; i++) {
+		if (strcmp(argv[i], "-render-on-request") == 0)
+			LIBATARI800_render_on_request = TRUE;
+		else if (strcmp(argv[i], "-overlays") == 0)
+			LIBATARI800_show_overlays = TRUE;
+		else if (strcmp(argv[i], "-no-overlays") == 0)
+			LIBATARI800_show_overlays = FALSE;
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-render-on-request  Draw the screen only when requested by the caller");
+				Log_print("\t-overlays          Draw speed and LED indicators on the screen");
+				Log_print("\t-no-overlays       Don't draw speed and LED indicators on the screen");
+			}
+			argv[j++] = argv[i];
+		}
+	}
+	*argc = j;
+
 	return TRUE;
 }
 
+int LIBATARI800_Video_DrawThisFrame(void)
+{
+	if (LIBATARI800_render_on_request) {
+		int draw = LIBATARI800_render_requested;
+		LIBATARI800_render_requested = FALSE;
+		return draw;
+	}
+	/* Atari800_nframes is incremented after the frame is emulated, so the
+	   screen is fresh whenever the frame number is a multiple of the rate */
+	return (Atari800_nframes + 1) % Atari800_refresh_rate == 0;
+}
+
 void LIBATARI800_Video_Exit(void) {
 }
+
+/* the palette as converted to the tables below */
+static int converted_palette[256];
+static int tables_valid = FALSE;
+/* R, G, B and opaque alpha of each palette index */
+static UBYTE rgba_table[256][4];
+static UBYTE gray_table[256];
+
+static void UpdateTables(const int *palette)
+{
+	int i;
+
+	if (tables_valid && memcmp(converted_palette, palette, sizeof(converted_palette)) == 0)
+		return;
+	for (i = 0; i < 256; i++) {
+		int r = (palette[i] >> 16) & 0xff;
+		int g = (palette[i] >> 8) & 0xff;
+		int b = palette[i] & 0xff;
+		rgba_table[i][0] = (UBYTE) r;
+		rgba_table[i][1] = (UBYTE) g;
+		rgba_table[i][2] = (UBYTE) b;
+		rgba_table[i][3] = 0xff;
+		/* ITU-R BT.601 luma, the weights add up to 256 */
+		gray_table[i] = (UBYTE) ((r * 77 + g * 150 + b * 29) >> 8);
+	}
+	memcpy(converted_palette, palette, sizeof(converted_palette));
+	tables_valid = TRUE;
+}
+
+static int BytesPerPixel(int format)
+{
+	if ((format & ~(0xff | LIBATARI800_SCREEN_VISIBLE | LIBATARI800_SCREEN_HALF)) != 0)
+		return 0;
+	switch (format & 0xff) {
+	case LIBATARI800_SCREEN_RGB24:
+		return 3;
+	case LIBATARI800_SCREEN_RGBA32:
+		return 4;
+	case LIBATARI800_SCREEN_GRAY8:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Gets the part of the screen that is converted and the size of the
+   result. */
+static void GetArea(int format, int *x1, int *y1, int *width, int *height)
+{
+	if (format & LIBATARI800_SCREEN_VISIBLE) {
+		*x1 = Screen_visible_x1;
+		*y1 = Screen_visible_y1;
+		*width = Screen_visible_x2 - Screen_visible_x1;
+		*height = Screen_visible_y2 - Screen_visible_y1;
+	}
+	else {
+		*x1 = *y1 = 0;
+		*width = Screen_WIDTH;
+		*height = Screen_HEIGHT;
+	}
+	if (format & LIBATARI800_SCREEN_HALF) {
+		*width >>= 1;
+		*height >>= 1;
+	}
+}
+
+int LIBATARI800_Video_ConvertedSize(int format, int *width, int *height)
+{
+	int x1;
+	int y1;
+	int bpp = BytesPerPixel(format);
+
+	if (bpp == 0)
+		return 0;
+	GetArea(format, &x1, &y1, width, height);
+	return *width * *height * bpp;
+}
+
+#ifdef __SSE2__
+/* Converts pairs of output pixels of a half-size RGB24 or RGBA32 row with
+   SSE2 and returns how many were converted. The palette lookups stay
+   scalar (SSE2 has no gather), but the averaging of the 4 source pixels,
+   which takes about as long as the lookups in the scalar loop, is done for
+   all channels of 2 output pixels at once. The result is the same as in
+   the scalar loop. */
+static int ConvertHalfRowSSE2(const UBYTE *src1, const UBYTE *src2, UBYTE *dst, int width, int bpp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	UBYTE pixels[2][16];
+	UBYTE out[8];
+	int x;
+
+	for (x = 0; x + 1 < width; x += 2) {
+		__m128i row1;
+		__m128i row2;
+		__m128i left;
+		__m128i right;
+		__m128i sum;
+		memcpy(pixels[0], rgba_table[src1[2 * x]], 4);
+		memcpy(pixels[0] + 4, rgba_table[src1[2 * x + 1]], 4);
+		memcpy(pixels[0] + 8, rgba_table[src1[2 * x + 2]], 4);
+		memcpy(pixels[0] + 12, rgba_table[src1[2 * x + 3]], 4);
+		memcpy(pixels[1], rgba_table[src2[2 * x]], 4);
+		memcpy(pixels[1] + 4, rgba_table[src2[2 * x + 1]], 4);
+		memcpy(pixels[1] + 8, rgba_table[src2[2 * x + 2]], 4);
+		memcpy(pixels[1] + 12, rgba_table[src2[2 * x + 3]], 4);
+		row1 = _mm_loadu_si128((const __m128i *) pixels[0]);
+		row2 = _mm_loadu_si128((const __m128i *) pixels[1]);
+		/* 16-bit sums of the columns: 2 source pixels of each output pixel */
+		left = _mm_add_epi16(_mm_unpacklo_epi8(row1, zero), _mm_unpacklo_epi8(row2, zero));
+		right = _mm_add_epi16(_mm_unpackhi_epi8(row1, zero), _mm_unpackhi_epi8(row2, zero));
+		sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+		_mm_storel_epi64((__m128i *) out, _mm_packus_epi16(sum, sum));
+		if (bpp == 4)
+			memcpy(dst, out, 8);
+		else {
+			memcpy(dst, out, 3);
+			memcpy(dst + 3, out + 4, 3);
+		}
+		dst += 2 * bpp;
+	}
+	return x;
+}
+#endif /* __SSE2__ */
+
+int LIBATARI800_Video_Convert(const UBYTE *screen, const int *palette, UBYTE *buffer, int format)
+{
+	int x1;
+	int y1;
+	int width;
+	int height;
+	int x;
+	int y;
+	int bpp = BytesPerPixel(format);
+	UBYTE *dst = buffer;
+
+	if (bpp == 0)
+		return 0;
+	UpdateTables(palette);
+	GetArea(format, &x1, &y1, &width, &height);
+	screen += y1 * Screen_WIDTH + x1;
+
+	if (format & LIBATARI800_SCREEN_HALF) {
+		for (y = 0; y < height; y++) {
+			const UBYTE *src1 = screen + 2 * y * Screen_WIDTH;
+			const UBYTE *src2 = src1 + Screen_WIDTH;
+			if (bpp == 1) {
+				for (x = 0; x < width; x++) {
+					int sum = gray_table[src1[2 * x]] + gray_table[src1[2 * x + 1]]
+					        + gray_table[src2[2 * x]] + gray_table[src2[2 * x + 1]];
+					*dst++ = (UBYTE) ((sum + 2) >> 2);
+				}
+			}
+			else {
+				x = 0;
+#ifdef __SSE2__
+				x = ConvertHalfRowSSE2(src1, src2, dst, width, bpp);
+				dst += x * bpp;
+#endif
+				for (; x < width; x++) {
+					const UBYTE *a = rgba_table[src1[2 * x]];
+					const UBYTE *b = rgba_table[src1[2 * x + 1]];
+					const UBYTE *c = rgba_table[src2[2 * x]];
+					const UBYTE *d = rgba_table[src2[2 * x + 1]];
+					dst[0] = (UBYTE) ((a[0] + b[0] + c[0] + d[0] + 2) >> 2);
+					dst[1] = (UBYTE) ((a[1] + b[1] + c[1] + d[1] + 2) >> 2);
+					dst[2] = (UBYTE) ((a[2] + b[2] + c[2] + d[2] + 2) >> 2);
+					if (bpp == 4)
+						dst[3] = 0xff;
+					dst += bpp;
+				}
+			}
+		}
+	}
+	else {
+		for (y = 0; y < height; y++) {
+			const UBYTE *src = screen + y * Screen_WIDTH;
+			switch (bpp) {
+			case 1:
+				for (x = 0; x < width; x++)
+					dst[x] = gray_table[src[x]];
+				break;
+			case 3:
+				/* Store 4 bytes and let the next pixel overwrite the
+				   alpha, one store is faster than three. */
+				for (x = 0; x < width - 1; x++)
+					memcpy(dst + 3 * x, rgba_table[src[x]], 4);
+				if (width > 0)
+					memcpy(dst + 3 * x, rgba_table[src[x]], 3);
+				break;
+			default:
+				for (x = 0; x < width; x++)
+					memcpy(dst + 4 * x, rgba_table[src[x]], 4);
+				break;
+			}
+			dst += width * bpp;
+		}
+	}
+	return (int) (dst - buffer);
+}
@@ -4,8 +4,30 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "atari.h"
+
+/* If TRUE, the screen is drawn only in frames following a call to
+   libatari800_request_render. Otherwise it is drawn every
+   Atari800_refresh_rate frames. */
+extern int LIBATARI800_render_on_request;
+extern int LIBATARI800_render_requested;
+
+/* If FALSE, the speed indicator and the disk and keyboard LEDs are never
+   drawn on the screen. */
+extern int LIBATARI800_show_overlays;
 
 int LIBATARI800_Video_Initialise(int *argc, char *argv[]);
+/* Returns TRUE if the frame about to be emulated should be drawn. */
+int LIBATARI800_Video_DrawThisFrame(void);
 void LIBATARI800_Video_Exit(void);
 
+/* Returns the size in bytes of the screen converted to FORMAT (one of the
+   LIBATARI800_SCREEN_* formats, possibly with flags) and stores its
+   dimensions in *WIDTH and *HEIGHT. Returns 0 if FORMAT is invalid. */
+int LIBATARI800_Video_ConvertedSize(int format, int *width, int *height);
+/* Converts SCREEN, Screen_WIDTH x Screen_HEIGHT indices into PALETTE (in
+   the form of Colours_table), to FORMAT in BUFFER. Returns the number of
+   bytes written, 0 if FORMAT is invalid. */
+int LIBATARI800_Video_Convert(const UBYTE *screen, const int *palette, UBYTE *buffer, int format);
+
 #endif /* LIBATARI800_VIDEO_H_ */
@@ -36,6 +36,9 @@
 #include "gtia.h"
 #include "log.h"
 #include "memory.h"
+#ifdef MEMORY_WATCH
+#include "monitor.h"
+#endif
 #include "pbi.h"
 #include "pia.h"
 #include "pokey.h"
@@ -72,6 +75,172 @@ map_save save_map[2] = {
 	{1, NULL, MEMORY_ROM_PutByte}    /* ROM */
 };
 
+#ifdef MEMORY_WATCH
+UBYTE MEMORY_watch[65536];
+MEMORY_rdfunc MEMORY_watch_readmap[256];
+MEMORY_wrfunc MEMORY_watch_writemap[256];
+int MEMORY_watch_pages = 0;
+int MEMORY_watch_hit_addr = -1;
+UBYTE MEMORY_watch_hit_value;
+int MEMORY_watch_hit_write;
+
+/* MEMORY_WATCH_READ and MEMORY_WATCH_WRITE flags of each page */
+static UBYTE watch_page[256];
+
+static void WatchHit(UWORD addr, UBYTE value, int write)
+{
+	/* keep the first access until the monitor shows it */
+	if (MEMORY_watch_hit_addr < 0) {
+		MEMORY_watch_hit_addr = addr;
+		MEMORY_watch_hit_value = value;
+		MEMORY_watch_hit_write = write;
+	}
+	MONITOR_break_step = TRUE;
+}
+
+UBYTE MEMORY_WatchGetByte(UWORD addr, int no_side_effects)
+{
+	MEMORY_rdfunc func = MEMORY_watch_readmap[addr >> 8];
+	UBYTE value = func != NULL ? (*func)(addr, no_side_effects) : MEMORY_mem[addr];
+	if ((MEMORY_watch[addr] & MEMORY_WATCH_READ) && !no_side_effects)
+		WatchHit(addr, value, FALSE);
+	return value;
+}
+
+void MEMORY_WatchPutByte(UWORD addr, UBYTE byte)
+{
+	MEMORY_wrfunc func = MEMORY_watch_writemap[addr >> 8];
+	if (MEMORY_watch[addr] & MEMORY_WATCH_WRITE)
+		WatchHit(addr, byte, TRUE);
+	if (func != NULL)
+		(*func)(addr, byte);
+	else
+		MEMORY_mem[addr] = byte;
+}
+
+void MEMORY_WatchUpdate(void)
+{
+	int page;
+	MEMORY_watch_pages = 0;
+	for (page = 0; page < 256; page++) {
+		if (watch_page[page] & MEMORY_WATCH_READ) {
+			if (MEMORY_readmap[page] != MEMORY_WatchGetByte) {
+				MEMORY_watch_readmap[page] = MEMORY_readmap[page];
+				MEMORY_readmap[page] = MEMORY_WatchGetByte;
+			}
+		}
+		else if (MEMORY_readmap[page] == MEMORY_WatchGetByte)
+			MEMORY_readmap[page] = MEMORY_watch_readmap[page];
+		if (watch_page[page] & MEMORY_WATCH_WRITE) {
+			if (MEMORY_writemap[page] != MEMORY_WatchPutByte) {
+				MEMORY_watch_writemap[page] = MEMORY_writemap[page];
+				MEMORY_writemap[page] = MEMORY_WatchPutByte;
+			}
+		}
+		else if (MEMORY_writemap[page] == MEMORY_WatchPutByte)
+			MEMORY_writemap[page] = MEMORY_watch_writemap[page];
+		if (watch_page[page] != 0)
+			MEMORY_watch_pages++;
+	}
+}
+
+void MEMORY_WatchSet(UWORD addr1, UWORD addr2, int flags)
+{
+	int page;
+	memset(MEMORY_watch + addr1, flags, addr2 - addr1 + 1);
+	for (page = addr1 >> 8; page <= addr2 >> 8; page++) {
+		int addr;
+		watch_page[page] = 0;
+		for (addr = page << 8; addr < (page + 1) << 8; addr++)
+			watch_page[page] |= MEMORY_watch[addr];
+	}
+	MEMORY_WatchUpdate();
+}
+#endif /* MEMORY_WATCH */
+
+#ifdef DECODE_CACHE
+MEMORY_decoded_t *MEMORY_decode_map[256];
+UBYTE MEMORY_decode_off[256];
+
+static MEMORY_decoded_t decode_pages[256][256];
+
+/* Stores the decode cache's handler in place of the plain RAM store of PAGE,
+   or removes it. */
+static void DecodeTrap(int page, MEMORY_wrfunc from, MEMORY_wrfunc to)
+{
+#ifdef MEMORY_WATCH
+	if (MEMORY_writemap[page] == MEMORY_WatchPutByte) {
+		if (MEMORY_watch_writemap[page] == from)
+			MEMORY_watch_writemap[page] = to;
+		return;
+	}
+#endif
+	if (MEMORY_writemap[page] == from)
+		MEMORY_writemap[page] = to;
+}
+
+MEMORY_decoded_t *MEMORY_DecodePage(int page)
+{
+	MEMORY_wrfunc func = MEMORY_UnwatchedWritemap(page);
+	/* the CPU stores into zero page and the stack without the maps */
+	if (page < 2 || MEMORY_UnwatchedReadmap(page) != NULL
+		|| (func != NULL && func != MEMORY_ROM_PutByte)) {
+		MEMORY_decode_off[page] = TRUE;
+		return NULL;
+	}
+	memset(decode_pages[page], 0, sizeof(decode_pages[page]));
+	if (func == NULL)
+		DecodeTrap(page, NULL, MEMORY_DecodePutByte);
+	return MEMORY_decode_map[page] = decode_pages[page];
+}
+
+static void DecodeForgetPage(int page)
+{
+	if (MEMORY_decode_map[page] != NULL) {
+		MEMORY_decode_map[page] = NULL;
+		DecodeTrap(page, MEMORY_DecodePutByte, NULL);
+	}
+	MEMORY_decode_off[page] = FALSE;
+}
+
+void MEMORY_DecodePutByte(UWORD addr, UBYTE byte)
+{
+	MEMORY_decoded_t *decoded = MEMORY_decode_map[addr >> 8];
+	if (decoded != NULL) {
+		/* the byte may be the opcode or an operand of an instruction */
+		int offset = addr & 0xff;
+		decoded[offset].cycles = 0;
+		if (offset >= 1)
+			decoded[offset - 1].cycles = 0;
+		if (offset >= 2)
+			decoded[offset - 2].cycles = 0;
+	}
+	MEMORY_mem[addr] = byte;
+}
+
+void MEMORY_DecodePutWord(UWORD addr, UWORD word)
+{
+	MEMORY_DecodePutByte(addr, (UBYTE) word);
+	MEMORY_DecodePutByte((UWORD) (addr + 1), (UBYTE) (word >> 8));
+}
+
+void MEMORY_DecodeInvalidate(int addr1, int addr2)
+{
+	int page;
+	if (addr2 > 0xffff)
+		addr2 = 0xffff;
+	for (page = addr1 >> 8; page <= addr2 >> 8; page++)
+		DecodeForgetPage(page);
+}
+
+void MEMORY_DecodeFlush(void)
+{
+	int page;
+	for (page = 0; page < 256; page++)
+		DecodeForgetPage(page);
+}
+#endif /* DECODE_CACHE */
+
 #endif /* PAGED_ATTRIB */
 
 UBYTE MEMORY_basic[8192];
@@ -208,7 +377,7 @@ void MEMORY_InitialiseMachine(void)
 		if (GTIA_GRACTL & 4)
 			GTIA_TRIG_latch[3] = 0;
 	}
-	memcpy(MEMORY_mem + os_rom_start, MEMORY_os, os_size);
+	MEMORY_dCopyToMem(MEMORY_os, os_rom_start, os_size);
 	switch (Atari800_machine_type) {
 	case Atari800_MACHINE_5200:
 		MEMORY_dFillMem(0x0000, 0x00, 0xf800);
@@ -334,6 +503,9 @@ void MEMORY_InitialiseMachine(void)
 	axlon_curbank = 0;
 	mosaic_curbank = 0x3f;
 	AllocMapRAM();
+#ifdef PAGED_ATTRIB
+	MEMORY_MapsChanged();
+#endif
 	Atari800_Coldstart();
 }
 
@@ -375,9 +547,10 @@ void MEMORY_StateSave(UBYTE SaveVerbose)
 		UBYTE attrib_page[256];
 		int i;
 		for (i = 0; i < 256; i++) {
-			if (MEMORY_writemap[i] == NULL)
+			MEMORY_wrfunc func = MEMORY_UnwatchedWritemap(i);
+			if (func == NULL)
 				memset(attrib_page, MEMORY_RAM, 256);
-			else if (MEMORY_writemap[i] == MEMORY_ROM_PutByte)
+			else if (func == MEMORY_ROM_PutByte)
 				memset(attrib_page, MEMORY_ROM, 256);
 			else if (i == 0x4f || i == 0x5f || i == 0x8f || i == 0x9f) {
 				/* special case: Bounty Bob bank switching registers */
@@ -481,6 +654,7 @@ void MEMORY_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 		/* Read amount of base RAM in kilobytes. */
 		StateSav_ReadINT(&base_ram_kb, 1);
 	StateSav_ReadUBYTE(&MEMORY_mem[0], 65536);
+	MEMORY_DecodeFlush();
 #ifndef PAGED_ATTRIB
 	StateSav_ReadUBYTE(&MEMORY_attrib[0], 65536);
 #else
@@ -573,6 +747,7 @@ void MEMORY_StateRead(UBYTE SaveVerbose, UBYTE StateVersion)
 				break;
 			}
 		}
+		MEMORY_MapsChanged();
 	}
 #endif
 
@@ -744,7 +919,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 	if (mapram_selected && !new_mapram_selected) {
 		/* Restore RAM hidden by MapRAM. */
 		memcpy(mapram_memory, MEMORY_mem + 0x5000, 0x800);
-		memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+		MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 	}
 
 	/* Switch XE memory bank in 0x4000-0x7fff */
@@ -785,7 +960,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		        || antic_bank != new_antic_bank
 		        || (MEMORY_ram_size == MEMORY_RAM_320_COMPY_SHOP && (byte & 0x20) == 0))) {
 			/* Disable Self Test ROM */
-			memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+			MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 			if (ANTIC_xe_ptr != NULL)
 				/* Also disable Self Test from XE bank accessed by ANTIC. */
 				memcpy(atarixe_memory + (antic_bank << 14) + 0x1000, antic_bank_under_selftest, 0x800);
@@ -794,7 +969,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		}
 		if (cpu_bank != new_cpu_bank) {
 			memcpy(atarixe_memory + (cpu_bank << 14), MEMORY_mem + 0x4000, 0x4000);
-			memcpy(MEMORY_mem + 0x4000, atarixe_memory + (new_cpu_bank << 14), 0x4000);
+			MEMORY_dCopyToMem(atarixe_memory + (new_cpu_bank << 14), 0x4000, 0x4000);
 		}
 
 		if (MEMORY_ram_size == 128 || MEMORY_ram_size == MEMORY_RAM_320_COMPY_SHOP)
@@ -814,15 +989,15 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 				MEMORY_SetROM(0xc000, 0xcfff);
 				MEMORY_SetROM(0xd800, 0xffff);
 			}
-			memcpy(MEMORY_mem + 0xc000, MEMORY_os, 0x1000);
-			memcpy(MEMORY_mem + 0xd800, MEMORY_os + 0x1800, 0x2800);
+			MEMORY_dCopyToMem(MEMORY_os, 0xc000, 0x1000);
+			MEMORY_dCopyToMem(MEMORY_os + 0x1800, 0xd800, 0x2800);
 			ESC_PatchOS();
 		}
 		else {
 			/* Disable OS ROM */
 			if (MEMORY_ram_size > 48) {
-				memcpy(MEMORY_mem + 0xc000, under_atarixl_os, 0x1000);
-				memcpy(MEMORY_mem + 0xd800, under_atarixl_os + 0x1800, 0x2800);
+				MEMORY_dCopyToMem(under_atarixl_os, 0xc000, 0x1000);
+				MEMORY_dCopyToMem(under_atarixl_os + 0x1800, 0xd800, 0x2800);
 				MEMORY_SetRAM(0xc000, 0xcfff);
 				MEMORY_SetRAM(0xd800, 0xffff);
 			} else {
@@ -832,7 +1007,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			/* When OS ROM is disabled we also have to disable Self Test - Jindroush */
 			if (MEMORY_selftest_enabled) {
 				if (MEMORY_ram_size > 20) {
-					memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+					MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 					if (ANTIC_xe_ptr != NULL)
 						/* Also disable Self Test from XE bank accessed by ANTIC. */
 						memcpy(atarixe_memory + (antic_bank << 14) + 0x1000, antic_bank_under_selftest, 0x800);
@@ -856,14 +1031,14 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 			}
 			if (builtin_cart_new == NULL) { /* switching RAM in */
 				if (MEMORY_ram_size > 40) {
-					memcpy(MEMORY_mem + 0xa000, under_cartA0BF, 0x2000);
+					MEMORY_dCopyToMem(under_cartA0BF, 0xa000, 0x2000);
 					MEMORY_SetRAM(0xa000, 0xbfff);
 				}
 				else
 					MEMORY_dFillMem(0xa000, 0xff, 0x2000);
 			}
 			else
-				memcpy(MEMORY_mem + 0xa000, builtin_cart_new, 0x2000);
+				MEMORY_dCopyToMem(builtin_cart_new, 0xa000, 0x2000);
 		}
 	}
 
@@ -872,7 +1047,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		if (MEMORY_selftest_enabled) {
 			/* Disable Self Test ROM */
 			if (MEMORY_ram_size > 20) {
-				memcpy(MEMORY_mem + 0x5000, under_atarixl_os + 0x1000, 0x800);
+				MEMORY_dCopyToMem(under_atarixl_os + 0x1000, 0x5000, 0x800);
 				if (ANTIC_xe_ptr != NULL)
 					/* Also disable Self Test from XE bank accessed by ANTIC. */
 					memcpy(atarixe_memory + (antic_bank << 14) + 0x1000, antic_bank_under_selftest, 0x800);
@@ -898,7 +1073,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 					memcpy(antic_bank_under_selftest, atarixe_memory + (antic_bank << 14) + 0x1000, 0x800);
 				MEMORY_SetROM(0x5000, 0x57ff);
 			}
-			memcpy(MEMORY_mem + 0x5000, MEMORY_os + 0x1000, 0x800);
+			MEMORY_dCopyToMem(MEMORY_os + 0x1000, 0x5000, 0x800);
 			if (ANTIC_xe_ptr != NULL)
 				/* Also enable Self Test in the XE bank accessed by ANTIC. */
 				memcpy(atarixe_memory + (antic_bank << 14) + 0x1000, MEMORY_os + 0x1000, 0x800);
@@ -907,7 +1082,7 @@ void MEMORY_HandlePORTB(UBYTE byte, UBYTE oldval)
 		else if (!mapram_selected && new_mapram_selected) {
 			/* Enable MapRAM */
 			memcpy(under_atarixl_os + 0x1000, MEMORY_mem + 0x5000, 0x800);
-			memcpy(MEMORY_mem + 0x5000, mapram_memory, 0x800);
+			MEMORY_dCopyToMem(mapram_memory, 0x5000, 0x800);
 		}
 	}
 }
@@ -937,13 +1112,13 @@ static void MosaicPutByte(UWORD addr, UBYTE byte)
 	}
 	else if (newbank < mosaic_current_num_banks && mosaic_curbank >= mosaic_current_num_banks) {
 		/*rom->ram*/
-		memcpy(MEMORY_mem + 0xc000, mosaic_ram+newbank*0x1000,0x1000);
+		MEMORY_dCopyToMem(mosaic_ram+newbank*0x1000, 0xc000, 0x1000);
 		MEMORY_SetRAM(0xc000, 0xcfff);
 	}
 	else {
 		/*ram -> ram*/
 		memcpy(mosaic_ram + mosaic_curbank*0x1000, MEMORY_mem + 0xc000, 0x1000);
-		memcpy(MEMORY_mem + 0xc000, mosaic_ram + newbank*0x1000, 0x1000);
+		MEMORY_dCopyToMem(mosaic_ram + newbank*0x1000, 0xc000, 0x1000);
 		MEMORY_SetRAM(0xc000, 0xcfff);
 	}
 	mosaic_curbank = newbank;
@@ -980,7 +1155,7 @@ static void AxlonPutByte(UWORD addr, UBYTE byte)
 	newbank = (byte&axlon_current_bankmask);
 	if (newbank == axlon_curbank) return;
 	memcpy(axlon_ram + axlon_curbank*0x4000, MEMORY_mem + 0x4000, 0x4000);
-	memcpy(MEMORY_mem + 0x4000, axlon_ram + newbank*0x4000, 0x4000);
+	MEMORY_dCopyToMem(axlon_ram + newbank*0x4000, 0x4000, 0x4000);
 	axlon_curbank = newbank;
 }
 
@@ -996,7 +1171,7 @@ void MEMORY_Cart809fDisable(void)
 {
 	if (cart809F_enabled) {
 		if (MEMORY_ram_size > 32) {
-			memcpy(MEMORY_mem + 0x8000, under_cart809F, 0x2000);
+			MEMORY_dCopyToMem(under_cart809F, 0x8000, 0x2000);
 			MEMORY_SetRAM(0x8000, 0x9fff);
 		}
 		else
@@ -1024,14 +1199,14 @@ void MEMORY_CartA0bfDisable(void)
 		UBYTE const *builtin = builtin_cart(PIA_PORTB | PIA_PORTB_mask);
 		if (builtin == NULL) { /* switch RAM in */
 			if (MEMORY_ram_size > 40) {
-				memcpy(MEMORY_mem + 0xa000, under_cartA0BF, 0x2000);
+				MEMORY_dCopyToMem(under_cartA0BF, 0xa000, 0x2000);
 				MEMORY_SetRAM(0xa000, 0xbfff);
 			}
 			else
 				MEMORY_dFillMem(0xa000, 0xff, 0x2000);
 		}
 		else
-			memcpy(MEMORY_mem + 0xa000, builtin, 0x2000);
+			MEMORY_dCopyToMem(builtin, 0xa000, 0x2000);
 		MEMORY_cartA0BF_enabled = FALSE;
 		if (Atari800_machine_type == Atari800_MACHINE_XLXE) {
 			GTIA_TRIG[3] = 0;
@@ -7,7 +7,12 @@
 #include "atari.h"
 
 #define MEMORY_dGetByte(x)				(MEMORY_mem[x])
+#ifndef DECODE_CACHE
 #define MEMORY_dPutByte(x, y)			(MEMORY_mem[x] = y)
+#else
+/* the CPU may have pre-decoded the instructions at X */
+#define MEMORY_dPutByte(x, y)			MEMORY_DecodePutByte(x, y)
+#endif
 
 #ifndef WORDS_BIGENDIAN
 #ifdef WORDS_UNALIGNED_OK
@@ -32,8 +37,30 @@
 #endif	/* WORDS_BIGENDIAN */
 
 #define MEMORY_dCopyFromMem(from, to, size)	memcpy(to, MEMORY_mem + (from), size)
+#ifndef DECODE_CACHE
 #define MEMORY_dCopyToMem(from, to, size)		memcpy(MEMORY_mem + (to), from, size)
 #define MEMORY_dFillMem(addr1, value, length)	memset(MEMORY_mem + (addr1), value, length)
+#define MEMORY_DecodeInvalidate(addr1, addr2)	do {} while (0)
+#define MEMORY_DecodeFlush()					do {} while (0)
+#else /* DECODE_CACHE */
+/* The CPU may keep pre-decoded 6502 instructions of MEMORY_mem, which must
+   be forgotten when the memory changes. The CPU's own stores and those made
+   with MEMORY_PutByte, the MEMORY_dPut* macros, MEMORY_dCopyToMem,
+   MEMORY_dFillMem and MEMORY_CopyFromCart are seen; other direct changes to
+   MEMORY_mem must be followed by MEMORY_DecodeInvalidate. */
+#undef MEMORY_dPutWord
+#undef MEMORY_dPutWordAligned
+#define MEMORY_dPutWord(x, y)			MEMORY_DecodePutWord(x, y)
+#define MEMORY_dPutWordAligned(x, y)	MEMORY_DecodePutWord(x, y)
+#define MEMORY_dCopyToMem(from, to, size)		(memcpy(MEMORY_mem + (to), from, size), MEMORY_DecodeInvalidate(to, (to) + (size) - 1))
+#define MEMORY_dFillMem(addr1, value, length)	(memset(MEMORY_mem + (addr1), value, length), MEMORY_DecodeInvalidate(addr1, (addr1) + (length) - 1))
+void MEMORY_DecodePutByte(UWORD addr, UBYTE byte);
+void MEMORY_DecodePutWord(UWORD addr, UWORD word);
+/* Forgets the instructions pre-decoded from ADDR1..ADDR2. */
+void MEMORY_DecodeInvalidate(int addr1, int addr2);
+/* Forgets all pre-decoded instructions. */
+void MEMORY_DecodeFlush(void);
+#endif /* DECODE_CACHE */
 
 extern UBYTE MEMORY_mem[65536 + 2];
 
@@ -63,6 +90,10 @@ extern UBYTE MEMORY_attrib[65536];
 #define MEMORY_SetROM(addr1, addr2) memset(MEMORY_attrib + (addr1), MEMORY_ROM, (addr2) - (addr1) + 1)
 #define MEMORY_SetHARDWARE(addr1, addr2) memset(MEMORY_attrib + (addr1), MEMORY_HARDWARE, (addr2) - (addr1) + 1)
 
+#ifdef DECODE_CACHE
+#error DECODE_CACHE needs PAGED_ATTRIB
+#endif
+
 #else /* PAGED_ATTRIB */
 
 typedef UBYTE (*MEMORY_rdfunc)(UWORD addr, int no_side_effects);
@@ -71,6 +102,29 @@ extern MEMORY_rdfunc MEMORY_readmap[256];
 extern MEMORY_rdfunc MEMORY_safe_readmap[256];
 extern MEMORY_wrfunc MEMORY_writemap[256];
 void MEMORY_ROM_PutByte(UWORD addr, UBYTE byte);
+
+#ifdef DECODE_CACHE
+/* Pre-decoded 6502 instructions, kept by CPU_GO for each address of the
+   pages of RAM and ROM it executes code from. A page of RAM gets
+   MEMORY_DecodePutByte in MEMORY_writemap while it has any, so that stores
+   into it are seen. Instructions that would be read past the end of their
+   page are not kept. */
+typedef struct {
+	const void *handler;	/* label of the instruction in CPU_GO */
+	UWORD operand;			/* the two bytes after the opcode */
+	UBYTE code;				/* the opcode */
+	UBYTE cycles;			/* 0 if not decoded */
+} MEMORY_decoded_t;
+/* The instructions of each page, NULL if none are kept */
+extern MEMORY_decoded_t *MEMORY_decode_map[256];
+/* TRUE for pages that can't be kept until the maps change */
+extern UBYTE MEMORY_decode_off[256];
+/* Starts keeping instructions of PAGE. Returns NULL if it can't. */
+MEMORY_decoded_t *MEMORY_DecodePage(int page);
+#define MEMORY_DECODE_UNTRAP(func) ((func) == MEMORY_DecodePutByte ? (MEMORY_wrfunc) NULL : (func))
+#else /* DECODE_CACHE */
+#define MEMORY_DECODE_UNTRAP(func) (func)
+#endif /* DECODE_CACHE */
 /* Reads a byte from ADDR. Can potentially have side effects, when reading
    from hardware area. */
 #define MEMORY_GetByte(addr)		(MEMORY_readmap[(addr) >> 8] ? (*MEMORY_readmap[(addr) >> 8])(addr, FALSE) : MEMORY_mem[addr])
@@ -83,6 +137,7 @@ void MEMORY_ROM_PutByte(UWORD addr, UBYTE byte);
 			MEMORY_readmap[i] = NULL; \
 			MEMORY_writemap[i] = NULL; \
 		} \
+		MEMORY_MapsChanged(); \
 	} while (0)
 #define MEMORY_SetROM(addr1, addr2) do { \
 		int i; \
@@ -90,8 +145,51 @@ void MEMORY_ROM_PutByte(UWORD addr, UBYTE byte);
 			MEMORY_readmap[i] = NULL; \
 			MEMORY_writemap[i] = MEMORY_ROM_PutByte; \
 		} \
+		MEMORY_MapsChanged(); \
 	} while (0)
 
+#ifdef MONITOR_BREAK
+/* Memory watch: a read or write of a watched address breaks into the monitor
+   after the current instruction. Only the pages that hold watched addresses
+   get MEMORY_WatchGetByte/MEMORY_WatchPutByte in MEMORY_readmap/writemap;
+   the handlers these replace are kept in MEMORY_watch_readmap/writemap.
+   All other pages keep their usual handlers. Accesses that the CPU makes
+   with MEMORY_dGetByte/MEMORY_dPutByte (zero page addressing, the stack,
+   opcode fetches) bypass the maps and are not seen. */
+#define MEMORY_WATCH
+
+#define MEMORY_WATCH_READ   1
+#define MEMORY_WATCH_WRITE  2
+/* MEMORY_WATCH_READ and MEMORY_WATCH_WRITE flags of each address */
+extern UBYTE MEMORY_watch[65536];
+extern MEMORY_rdfunc MEMORY_watch_readmap[256];
+extern MEMORY_wrfunc MEMORY_watch_writemap[256];
+/* Number of pages that have watch handlers installed. */
+extern int MEMORY_watch_pages;
+/* The access that hit a watch, for the monitor. MEMORY_watch_hit_addr is -1
+   if there was none. */
+extern int MEMORY_watch_hit_addr;
+extern UBYTE MEMORY_watch_hit_value;
+extern int MEMORY_watch_hit_write;
+
+UBYTE MEMORY_WatchGetByte(UWORD addr, int no_side_effects);
+void MEMORY_WatchPutByte(UWORD addr, UBYTE byte);
+/* Sets the watch FLAGS (0 to remove the watch) on ADDR1..ADDR2. */
+void MEMORY_WatchSet(UWORD addr1, UWORD addr2, int flags);
+/* Installs the watch handlers again after MEMORY_readmap/writemap changed. */
+void MEMORY_WatchUpdate(void);
+/* The handler for PAGE without the watch, or the decode cache's store
+   handler. */
+#define MEMORY_UnwatchedReadmap(page) (MEMORY_readmap[page] == MEMORY_WatchGetByte ? MEMORY_watch_readmap[page] : MEMORY_readmap[page])
+#define MEMORY_UnwatchedWritemap(page) MEMORY_DECODE_UNTRAP(MEMORY_writemap[page] == MEMORY_WatchPutByte ? MEMORY_watch_writemap[page] : MEMORY_writemap[page])
+/* Must follow direct changes to MEMORY_readmap or MEMORY_writemap. */
+#define MEMORY_MapsChanged() do { MEMORY_DecodeFlush(); if (MEMORY_watch_pages > 0) MEMORY_WatchUpdate(); } while (0)
+#else /* MONITOR_BREAK */
+#define MEMORY_UnwatchedReadmap(page) MEMORY_readmap[page]
+#define MEMORY_UnwatchedWritemap(page) MEMORY_DECODE_UNTRAP(MEMORY_writemap[page])
+#define MEMORY_MapsChanged() MEMORY_DecodeFlush()
+#endif /* MONITOR_BREAK */
+
 #endif /* PAGED_ATTRIB */
 
 extern UBYTE MEMORY_basic[8192];
@@ -116,7 +214,10 @@ void MEMORY_Cart809fDisable(void);
 void MEMORY_Cart809fEnable(void);
 void MEMORY_CartA0bfDisable(void);
 void MEMORY_CartA0bfEnable(void);
-#define MEMORY_CopyFromCart(addr1, addr2, src) memcpy(MEMORY_mem + (addr1), src, (addr2) - (addr1) + 1)
+#define MEMORY_CopyFromCart(addr1, addr2, src) do { \
+		MEMORY_DecodeInvalidate(addr1, addr2); \
+		memcpy(MEMORY_mem + (addr1), src, (addr2) - (addr1) + 1); \
+	} while (0)
 #define MEMORY_CopyToCart(addr1, addr2, dst) memcpy(dst, MEMORY_mem + (addr1), (addr2) - (addr1) + 1)
 void MEMORY_GetCharset(UBYTE *cs);
 
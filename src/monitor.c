@@ -42,7 +42,11 @@
 #include "antic.h"
 #include "atari.h"
 #include "cpu.h"
+#ifdef MONITOR_TRACE
+#include "cputrace.h"
+#endif
 #include "gtia.h"
+#include "input.h"
 #include "memory.h"
 #include "cartridge.h"
 #include "monitor.h"
@@ -403,6 +407,22 @@ static int symtable_builtin_enable = TRUE;
 static symtable_rec *symtable_user = NULL;
 static int symtable_user_size = 0;
 
+/* Hash indices of a symbol table, so that looking up a label doesn't scan
+   the whole table. by_addr and by_name are open addressing tables of size
+   slots holding indices into the symbol table, or -1 for an empty slot.
+   If several labels have the same address or name, only the first one is
+   in the index, because that's the one a scan of the table would find. */
+typedef struct {
+	int *by_addr;
+	int *by_name;
+	int size;   /* a power of two */
+} symtable_index;
+
+static symtable_index symtable_user_index = { NULL, NULL, 0 };
+static symtable_index symtable_builtin_index = { NULL, NULL, 0 };
+/* the table symtable_builtin_index was built for */
+static const symtable_rec *symtable_builtin_indexed = NULL;
+
 #endif /* MONITOR_HINTS */
 
 #ifdef MONITOR_ANSI
@@ -473,21 +493,121 @@ static void print_atascii_char(UWORD c) {
 
 #ifdef MONITOR_HINTS
 
-static const char *find_label_name(UWORD addr, int is_write)
+static unsigned int hash_label_name(const char *name)
+{
+	unsigned int h = 2166136261U;
+	while (*name != '\0')
+		h = (h ^ (UBYTE) toupper((UBYTE) *name++)) * 16777619U;
+	return h;
+}
+
+static unsigned int hash_label_addr(UWORD addr)
+{
+	return addr * 40503U;
+}
+
+static void symtable_index_free(symtable_index *index)
+{
+	free(index->by_addr);
+	free(index->by_name);
+	index->by_addr = NULL;
+	index->by_name = NULL;
+	index->size = 0;
+}
+
+/* Adds label I of TABLE to INDEX, which must have room for it. */
+static void symtable_index_insert(symtable_index *index, const symtable_rec *table, int i)
+{
+	unsigned int mask = index->size - 1;
+	unsigned int h;
+	for (h = hash_label_addr(table[i].addr) & mask; index->by_addr[h] >= 0; h = (h + 1) & mask) {
+		if (table[index->by_addr[h]].addr == table[i].addr)
+			break;
+	}
+	if (index->by_addr[h] < 0)
+		index->by_addr[h] = i;
+	for (h = hash_label_name(table[i].name) & mask; index->by_name[h] >= 0; h = (h + 1) & mask) {
+		if (Util_stricmp(table[index->by_name[h]].name, table[i].name) == 0)
+			break;
+	}
+	if (index->by_name[h] < 0)
+		index->by_name[h] = i;
+}
+
+/* Indexes the first COUNT labels of TABLE. */
+static void symtable_index_build(symtable_index *index, const symtable_rec *table, int count)
 {
+	int size = 64;
 	int i;
-	for (i = 0; i < symtable_user_size; i++) {
-		if (symtable_user[i].addr == addr)
-			return symtable_user[i].name;
+	while (size < 2 * count)
+		size <<= 1;
+	if (size != index->size) {
+		symtable_index_free(index);
+		index->by_addr = (int *) Util_malloc(size * sizeof(int));
+		index->by_name = (int *) Util_malloc(size * sizeof(int));
+		index->size = size;
 	}
+	memset(index->by_addr, -1, size * sizeof(int));
+	memset(index->by_name, -1, size * sizeof(int));
+	for (i = 0; i < count; i++)
+		symtable_index_insert(index, table, i);
+}
+
+/* Returns the index in TABLE of the first label at ADDR, or -1. */
+static int symtable_index_find_addr(const symtable_index *index, const symtable_rec *table, UWORD addr)
+{
+	unsigned int mask = index->size - 1;
+	unsigned int h;
+	if (index->size == 0)
+		return -1;
+	for (h = hash_label_addr(addr) & mask; index->by_addr[h] >= 0; h = (h + 1) & mask) {
+		if (table[index->by_addr[h]].addr == addr)
+			return index->by_addr[h];
+	}
+	return -1;
+}
+
+/* Returns the index in TABLE of the first label called NAME, or -1. */
+static int symtable_index_find_name(const symtable_index *index, const symtable_rec *table, const char *name)
+{
+	unsigned int mask = index->size - 1;
+	unsigned int h;
+	if (index->size == 0)
+		return -1;
+	for (h = hash_label_name(name) & mask; index->by_name[h] >= 0; h = (h + 1) & mask) {
+		if (Util_stricmp(table[index->by_name[h]].name, name) == 0)
+			return index->by_name[h];
+	}
+	return -1;
+}
+
+/* Returns the built-in symbol table for the current machine, indexed. */
+static const symtable_rec *get_builtin_symtable(void)
+{
+	const symtable_rec *table = Atari800_machine_type == Atari800_MACHINE_5200 ? symtable_builtin_5200 : symtable_builtin;
+	if (table != symtable_builtin_indexed) {
+		int count = 0;
+		while (table[count].name != NULL)
+			count++;
+		symtable_index_build(&symtable_builtin_index, table, count);
+		symtable_builtin_indexed = table;
+	}
+	return table;
+}
+
+static const char *find_label_name(UWORD addr, int is_write)
+{
+	int i = symtable_index_find_addr(&symtable_user_index, symtable_user, addr);
+	if (i >= 0)
+		return symtable_user[i].name;
 	if (symtable_builtin_enable) {
-		const symtable_rec *p;
-		for (p = (Atari800_machine_type == Atari800_MACHINE_5200 ? symtable_builtin_5200 : symtable_builtin); p->name != NULL; p++) {
-			if (p->addr == addr) {
-				if (is_write && p[1].addr == addr)
-					p++;
-				return p->name;
-			}
+		const symtable_rec *table = get_builtin_symtable();
+		i = symtable_index_find_addr(&symtable_builtin_index, table, addr);
+		if (i >= 0) {
+			/* the table is sorted by address, the read name first */
+			if (is_write && table[i + 1].name != NULL && table[i + 1].addr == addr)
+				i++;
+			return table[i].name;
 		}
 	}
 	return NULL;
@@ -495,12 +615,8 @@ static const char *find_label_name(UWORD addr, int is_write)
 
 static symtable_rec *find_user_label(const char *name)
 {
-	int i;
-	for (i = 0; i < symtable_user_size; i++) {
-		if (Util_stricmp(symtable_user[i].name, name) == 0)
-			return &symtable_user[i];
-	}
-	return NULL;
+	int i = symtable_index_find_name(&symtable_user_index, symtable_user, name);
+	return i >= 0 ? &symtable_user[i] : NULL;
 }
 
 static int find_label_value(const char *name)
@@ -509,10 +625,10 @@ static int find_label_value(const char *name)
 	if (p != NULL)
 		return p->addr;
 	if (symtable_builtin_enable) {
-		for (p = (Atari800_machine_type == Atari800_MACHINE_5200 ? symtable_builtin_5200 : symtable_builtin); p->name != NULL; p++) {
-			if (Util_stricmp(p->name, name) == 0)
-				return p->addr;
-		}
+		const symtable_rec *table = get_builtin_symtable();
+		int i = symtable_index_find_name(&symtable_builtin_index, table, name);
+		if (i >= 0)
+			return table[i].addr;
 	}
 	return -1;
 }
@@ -525,6 +641,7 @@ static void free_user_labels(void)
 		free(symtable_user);
 		symtable_user = NULL;
 	}
+	symtable_index_free(&symtable_user_index);
 }
 
 static void add_user_label(const char *name, UWORD addr)
@@ -541,6 +658,11 @@ static void add_user_label(const char *name, UWORD addr)
 	symtable_user[symtable_user_size].name = Util_strdup(name);
 	symtable_user[symtable_user_size].addr = addr;
 	symtable_user_size++;
+	/* keep the index at most half full */
+	if (2 * symtable_user_size > symtable_user_index.size)
+		symtable_index_build(&symtable_user_index, symtable_user, symtable_user_size);
+	else
+		symtable_index_insert(&symtable_user_index, symtable_user, symtable_user_size - 1);
 }
 
 static void load_user_labels(const char *filename)
@@ -895,7 +1017,9 @@ static int get_attrib_range(UWORD *addr1, UWORD *addr2)
 	return FALSE;
 }
 
-static UWORD show_instruction(FILE *fp, UWORD pc)
+/* Disassembles the instruction at PC, whose opcode and operand bytes are BYTES.
+   Returns the address of the next instruction. */
+static UWORD show_instruction_bytes(FILE *fp, UWORD pc, const UBYTE *bytes)
 {
 	UWORD addr = pc;
 	UBYTE insn;
@@ -904,26 +1028,26 @@ static UWORD show_instruction(FILE *fp, UWORD pc)
 	int value = 0;
 	int nchars = 0;
 
-	insn = MEMORY_SafeGetByte(pc);
+	insn = bytes[0];
 	pc++;
 	mnemonic = instr6502[insn];
 	for (p = mnemonic + 3; *p != '\0'; p++) {
 		if (*p == '1') {
-			value = MEMORY_SafeGetByte(pc);
+			value = bytes[1];
 			pc++;
 			nchars = fprintf(fp, "%04X: %02X %02X     " /*"%Xcyc  "*/ "%.*s$%02X%s",
 			                 addr, insn, value, /*cycles[insn],*/ (int) (p - mnemonic), mnemonic, value, p + 1);
 			break;
 		}
 		if (*p == '2') {
-			value = MEMORY_SafeGetByte(pc) + (MEMORY_SafeGetByte(pc + 1) << 8);
+			value = bytes[1] + (bytes[2] << 8);
 			nchars = fprintf(fp, "%04X: %02X %02X %02X  " /*"%Xcyc  "*/ "%.*s$%04X%s",
 			                 addr, insn, value & 0xff, value >> 8, /*cycles[insn],*/ (int) (p - mnemonic), mnemonic, value, p + 1);
 			pc += 2;
 			break;
 		}
 		if (*p == '0') {
-			UBYTE op = MEMORY_SafeGetByte(pc);
+			UBYTE op = bytes[1];
 			pc++;
 			value = (UWORD) (pc + (SBYTE) op);
 			nchars = fprintf(fp, "%04X: %02X %02X     " /*"3cyc  "*/ "%.4s$%04X", addr, insn, op, mnemonic, value);
@@ -950,8 +1074,20 @@ static UWORD show_instruction(FILE *fp, UWORD pc)
 	return pc;
 }
 
+static UWORD show_instruction(FILE *fp, UWORD pc)
+{
+	UBYTE bytes[3];
+	bytes[0] = MEMORY_SafeGetByte(pc);
+	bytes[1] = MEMORY_SafeGetByte((UWORD) (pc + 1));
+	bytes[2] = MEMORY_SafeGetByte((UWORD) (pc + 2));
+	return show_instruction_bytes(fp, pc, bytes);
+}
+
 void MONITOR_Exit(void)
 {
+#ifdef MONITOR_TRACE
+	CPUTRACE_Close();
+#endif
 	if (trainer_memory != NULL) {
 		free(trainer_memory);
 		trainer_memory=NULL;
@@ -959,11 +1095,17 @@ void MONITOR_Exit(void)
 	}
 }
 
+static void show_state_line(FILE *fp, int ypos, int xpos, UBYTE a, UBYTE x, UBYTE y, UBYTE s,
+                            char n, char v, char d, char i, char z, char c)
+{
+	fprintf(fp, "%3d %3d A=%02X X=%02X Y=%02X S=%02X P=%c%c*-%c%c%c%c PC=",
+		ypos, xpos, a, x, y, s, n, v, d, i, z, c);
+}
+
 void MONITOR_ShowState(FILE *fp, UWORD pc, UBYTE a, UBYTE x, UBYTE y, UBYTE s,
                 char n, char v, char z, char c)
 {
-	fprintf(fp, "%3d %3d A=%02X X=%02X Y=%02X S=%02X P=%c%c*-%c%c%c%c PC=",
-		ANTIC_ypos, ANTIC_XPOS, a, x, y, s,
+	show_state_line(fp, ANTIC_ypos, ANTIC_XPOS, a, x, y, s,
 		n, v, (CPU_regP & CPU_D_FLAG) ? 'D' : '-', (CPU_regP & CPU_I_FLAG) ? 'I' : '-', z, c);
 	show_instruction(fp, pc);
 }
@@ -1141,6 +1283,101 @@ int MONITOR_ret_nesting = 0;
 MONITOR_breakpoint_cond MONITOR_breakpoint_table[MONITOR_BREAKPOINT_TABLE_MAX];
 int MONITOR_breakpoint_table_size = 0;
 int MONITOR_breakpoints_enabled = TRUE;
+int MONITOR_breakpoint_checks = 0;
+UBYTE MONITOR_breakpoint_pc_map[0x10000 / 8];
+UBYTE MONITOR_breakpoint_read_map[0x10000 / 8];
+UBYTE MONITOR_breakpoint_write_map[0x10000 / 8];
+
+static int breakpoint_compare(int cond, int value, int val)
+{
+	return ((cond & MONITOR_BREAKPOINT_LESS) != 0 && val < value)
+	    || ((cond & MONITOR_BREAKPOINT_EQUAL) != 0 && val == value)
+	    || ((cond & MONITOR_BREAKPOINT_GREATER) != 0 && val > value);
+}
+
+/* Adds the AND-connected conditions from start to end-1 to the bitmaps. */
+static void breakpoint_compile_group(int start, int end)
+{
+	int has_pc = FALSE;
+	int has_read = FALSE;
+	int has_write = FALSE;
+	int has_access = FALSE;
+	int i;
+	int a;
+	for (i = start; i < end; i++) {
+		if (!MONITOR_breakpoint_table[i].enabled)
+			continue;
+		switch (MONITOR_breakpoint_table[i].condition >> 3) {
+		case MONITOR_BREAKPOINT_PC >> 3:
+			has_pc = TRUE;
+			break;
+		case MONITOR_BREAKPOINT_READ >> 3:
+			has_read = TRUE;
+			break;
+		case MONITOR_BREAKPOINT_WRITE >> 3:
+			has_write = TRUE;
+			break;
+		case MONITOR_BREAKPOINT_ACCESS >> 3:
+			has_access = TRUE;
+			break;
+		default:
+			break;
+		}
+	}
+	if (has_pc)
+		MONITOR_breakpoint_checks |= MONITOR_BREAKPOINT_CHECK_PC;
+	else if (has_read || has_write || has_access)
+		MONITOR_breakpoint_checks |= MONITOR_BREAKPOINT_CHECK_ACCESS;
+	else {
+		/* nothing to map, or an empty group, which always fires */
+		MONITOR_breakpoint_checks |= MONITOR_BREAKPOINT_CHECK_ALWAYS;
+		return;
+	}
+	/* mark the addresses that satisfy all the PC (or all the address)
+	   conditions; the other conditions are checked by CPU_GO */
+	for (a = 0; a < 0x10000; a++) {
+		for (i = start; i < end; i++) {
+			int type = MONITOR_breakpoint_table[i].condition >> 3;
+			if (!MONITOR_breakpoint_table[i].enabled)
+				continue;
+			if (has_pc ? type != (MONITOR_BREAKPOINT_PC >> 3)
+			           : type != (MONITOR_BREAKPOINT_READ >> 3) && type != (MONITOR_BREAKPOINT_WRITE >> 3) && type != (MONITOR_BREAKPOINT_ACCESS >> 3))
+				continue;
+			if (!breakpoint_compare(MONITOR_breakpoint_table[i].condition, MONITOR_breakpoint_table[i].value, a))
+				break;
+		}
+		if (i < end)
+			continue;
+		if (has_pc)
+			MONITOR_breakpoint_pc_map[a >> 3] |= 1 << (a & 7);
+		else {
+			if (has_read || !has_write)
+				MONITOR_breakpoint_read_map[a >> 3] |= 1 << (a & 7);
+			if (has_write || !has_read)
+				MONITOR_breakpoint_write_map[a >> 3] |= 1 << (a & 7);
+		}
+	}
+}
+
+void MONITOR_CompileBreakpoints(void)
+{
+	int start = 0;
+	int i;
+	memset(MONITOR_breakpoint_pc_map, 0, sizeof(MONITOR_breakpoint_pc_map));
+	memset(MONITOR_breakpoint_read_map, 0, sizeof(MONITOR_breakpoint_read_map));
+	memset(MONITOR_breakpoint_write_map, 0, sizeof(MONITOR_breakpoint_write_map));
+	MONITOR_breakpoint_checks = 0;
+	if (!MONITOR_breakpoints_enabled || MONITOR_breakpoint_table_size == 0)
+		return;
+	/* split the table at the enabled ORs, like CPU_GO does */
+	for (i = 0; i <= MONITOR_breakpoint_table_size; i++) {
+		if (i < MONITOR_breakpoint_table_size
+		 && (MONITOR_breakpoint_table[i].condition != MONITOR_BREAKPOINT_OR || !MONITOR_breakpoint_table[i].enabled))
+			continue;
+		breakpoint_compile_group(start, i);
+		start = i + 1;
+	}
+}
 
 static void breakpoint_print_flag(int flagmask)
 {
@@ -1538,6 +1775,66 @@ static void monitor_break_PC(void)
 	}
 }
 
+#ifdef MEMORY_WATCH
+/* Lists, sets or clears memory watches. */
+static void monitor_watch(void)
+{
+	char *t = get_token();
+	UWORD addr1;
+	UWORD addr2;
+	int flags;
+
+	if (t == NULL) {
+		int addr = 0;
+		int any = FALSE;
+		while (addr < 0x10000) {
+			int start = addr;
+			flags = MEMORY_watch[addr];
+			while (addr < 0x10000 && MEMORY_watch[addr] == flags)
+				addr++;
+			if (flags != 0) {
+				printf("%04X-%04X %s\n", start, addr - 1,
+				       flags == MEMORY_WATCH_READ ? "R" : flags == MEMORY_WATCH_WRITE ? "W" : "RW");
+				any = TRUE;
+			}
+		}
+		if (!any)
+			printf("No memory watches\n");
+		return;
+	}
+	Util_strupper(t);
+	if (strcmp(t, "C") == 0) {
+		if (!get_hex(&addr1)) {
+			MEMORY_WatchSet(0x0000, 0xffff, 0);
+			printf("All memory watches cleared\n");
+			return;
+		}
+		flags = 0;
+	}
+	else if (strcmp(t, "R") == 0)
+		flags = MEMORY_WATCH_READ;
+	else if (strcmp(t, "W") == 0)
+		flags = MEMORY_WATCH_WRITE;
+	else if (strcmp(t, "RW") == 0)
+		flags = MEMORY_WATCH_READ | MEMORY_WATCH_WRITE;
+	else {
+		printf("Usage: WATCH [R|W|RW addr1 [addr2]] or WATCH C [addr1 [addr2]]\n");
+		return;
+	}
+	if (flags != 0 && !get_hex(&addr1)) {
+		printf("Missing or bad argument!\n");
+		return;
+	}
+	if (!get_hex(&addr2))
+		addr2 = addr1;
+	if (addr2 < addr1) {
+		printf("Bad address range!\n");
+		return;
+	}
+	MEMORY_WatchSet(addr1, addr2, flags);
+}
+#endif /* MEMORY_WATCH */
+
 /* Displays last 64 executed instructions. */
 static void show_history(void)
 {
@@ -1798,6 +2095,59 @@ static void set_trace_file(char const *filename)
 			perror(filename);
 	}
 }
+
+/* Starts/stops writing the binary 6502 trace. */
+static void set_binary_trace_file(char const *filename)
+{
+	if (CPUTRACE_active) {
+		CPUTRACE_Close();
+		printf("Binary trace file closed\n");
+	}
+	if (filename != NULL) {
+		if (CPUTRACE_Open(filename))
+			printf("Binary trace file open\n");
+		else
+			perror(filename);
+	}
+}
+
+/* Converts a binary trace to the text written by TRACE. */
+static void decode_trace(void)
+{
+	const char *binname = get_token();
+	const char *textname = get_token();
+	FILE *fp;
+	FILE *out;
+	CPUTRACE_record r;
+	long count = 0;
+
+	if (textname == NULL) {
+		printf("Missing argument!\n");
+		return;
+	}
+	fp = CPUTRACE_OpenRead(binname);
+	if (fp == NULL) {
+		printf("%s is not a binary trace\n", binname);
+		return;
+	}
+	out = fopen(textname, "w");
+	if (out == NULL) {
+		perror(textname);
+		fclose(fp);
+		return;
+	}
+	while (CPUTRACE_Read(fp, &r)) {
+		show_state_line(out, r.ypos, r.xpos, r.a, r.x, r.y, r.s,
+			(r.p & CPU_N_FLAG) ? 'N' : '-', (r.p & CPU_V_FLAG) ? 'V' : '-',
+			(r.p & CPU_D_FLAG) ? 'D' : '-', (r.p & CPU_I_FLAG) ? 'I' : '-',
+			(r.p & CPU_Z_FLAG) ? 'Z' : '-', (r.p & CPU_C_FLAG) ? 'C' : '-');
+		show_instruction_bytes(out, r.pc, r.insn);
+		count++;
+	}
+	fclose(out);
+	fclose(fp);
+	printf("%ld instructions decoded\n", count);
+}
 #endif /* MONITOR_TRACE */
 
 static void get_terminal_size(int *cols, int *rows) {
@@ -2102,6 +2452,381 @@ static void coverage(void)
 	printf("Total: %lu instructions, %lu cycles executed\n",
 			MONITOR_coverage_insns, MONITOR_coverage_cycles);
 }
+
+/* Cycle profiler. The cycles are attributed to a tree of calling contexts:
+   each node is a subroutine (entered with JSR) or an interrupt handler,
+   reached through the chain of its parents. A shadow stack holds the node
+   of every active call along with the value of S just after the call, so
+   that a call is over as soon as S rises above that value, whether the
+   6502 left it with RTS/RTI or by discarding the return address. */
+
+#define CYCLE_NODES_MAX 65536
+#define CYCLE_STACK_MAX 256
+#define CYCLE_LINE_NODES 8
+
+typedef struct {
+	UWORD addr;           /* entry point */
+	int parent;
+	int first_child;
+	int next_sibling;
+	unsigned long cycles; /* cycles spent in the node itself */
+	unsigned long wait;   /* cycles spent waiting for WSYNC */
+} cycle_node;
+
+typedef struct {
+	int node;
+	UBYTE s;
+	UBYTE interrupt;      /* entered by an interrupt, JMP (addr) not followed yet */
+} cycle_frame;
+
+typedef struct {
+	unsigned long count;  /* number of times the line was profiled */
+	unsigned long cpu;    /* cycles used by 6502 instructions */
+	unsigned long wait;   /* cycles the 6502 spent halted by WSYNC */
+	unsigned long antic;  /* other cycles, stolen by ANTIC */
+	int max_cpu;          /* cpu cycles in the worst frame */
+	int max_node;         /* node that used most cycles in the worst frame */
+} cycle_line;
+
+int MONITOR_cycle_profile = FALSE;
+
+static cycle_node *cycle_nodes = NULL;
+static int cycle_node_count = 0;
+static unsigned long cycle_antic_total = 0;
+static cycle_frame cycle_stack[CYCLE_STACK_MAX];
+static int cycle_depth = 0;
+static int cycle_current = 0;   /* node being executed */
+static cycle_line cycle_lines[Atari800_TV_PAL];
+static int cycle_line_started = FALSE;
+static int cycle_line_start_xpos;
+static int cycle_line_cpu;
+static int cycle_line_wait;
+/* cycles used by the nodes executed in the current line */
+static int cycle_line_node[CYCLE_LINE_NODES];
+static int cycle_line_node_cycles[CYCLE_LINE_NODES];
+static int cycle_line_node_count;
+
+static void cycle_profile_clear(void)
+{
+	if (cycle_nodes == NULL)
+		cycle_nodes = (cycle_node *) Util_malloc(CYCLE_NODES_MAX * sizeof(cycle_node));
+	cycle_nodes[0].addr = 0;
+	cycle_nodes[0].parent = -1;
+	cycle_nodes[0].first_child = -1;
+	cycle_nodes[0].next_sibling = -1;
+	cycle_nodes[0].cycles = 0;
+	cycle_nodes[0].wait = 0;
+	cycle_node_count = 1;
+	cycle_antic_total = 0;
+	cycle_depth = 0;
+	cycle_current = 0;
+	memset(cycle_lines, 0, sizeof(cycle_lines));
+	cycle_line_started = FALSE;
+	cycle_line_cpu = cycle_line_wait = cycle_line_node_count = 0;
+}
+
+/* Returns the child of node PARENT entered at ADDR, creating it if needed. */
+static int cycle_child(int parent, UWORD addr)
+{
+	int i;
+	for (i = cycle_nodes[parent].first_child; i >= 0; i = cycle_nodes[i].next_sibling)
+		if (cycle_nodes[i].addr == addr)
+			return i;
+	if (cycle_node_count >= CYCLE_NODES_MAX)
+		return parent;
+	i = cycle_node_count++;
+	cycle_nodes[i].addr = addr;
+	cycle_nodes[i].parent = parent;
+	cycle_nodes[i].first_child = -1;
+	cycle_nodes[i].next_sibling = cycle_nodes[parent].first_child;
+	cycle_nodes[i].cycles = 0;
+	cycle_nodes[i].wait = 0;
+	cycle_nodes[parent].first_child = i;
+	return i;
+}
+
+static void cycle_push(UWORD addr, UBYTE s, int interrupt)
+{
+	if (cycle_depth >= CYCLE_STACK_MAX)
+		return;
+	cycle_current = cycle_child(cycle_current, addr);
+	cycle_stack[cycle_depth].node = cycle_current;
+	cycle_stack[cycle_depth].s = s;
+	cycle_stack[cycle_depth].interrupt = (UBYTE) interrupt;
+	cycle_depth++;
+}
+
+static void cycle_charge(int cycles)
+{
+	int i;
+	cycle_nodes[cycle_current].cycles += cycles;
+	cycle_line_cpu += cycles;
+	for (i = 0; i < cycle_line_node_count; i++) {
+		if (cycle_line_node[i] == cycle_current) {
+			cycle_line_node_cycles[i] += cycles;
+			return;
+		}
+	}
+	if (i < CYCLE_LINE_NODES) {
+		cycle_line_node[i] = cycle_current;
+		cycle_line_node_cycles[i] = cycles;
+		cycle_line_node_count++;
+	}
+}
+
+void MONITOR_CycleProfileInsn(UBYTE insn, int cycles, UBYTE s, UWORD pc)
+{
+	cycle_charge(cycles);
+	if (cycle_depth > 0 && s > cycle_stack[cycle_depth - 1].s) {
+		do
+			cycle_depth--;
+		while (cycle_depth > 0 && s > cycle_stack[cycle_depth - 1].s);
+		cycle_current = cycle_depth > 0 ? cycle_stack[cycle_depth - 1].node : 0;
+	}
+	if (insn == 0x20 || insn == 0x00)  /* JSR, BRK */
+		cycle_push(pc, s, insn == 0x00);
+	else if (insn == 0x6c && cycle_depth > 0 && cycle_stack[cycle_depth - 1].interrupt) {
+		/* The OS dispatches interrupts with JMP (vector). Show the handler
+		   the vector points to (e.g. the DLI) below the OS routine. */
+		cycle_stack[cycle_depth - 1].interrupt = FALSE;
+		cycle_push(pc, cycle_stack[cycle_depth - 1].s, FALSE);
+	}
+}
+
+void MONITOR_CycleProfileInterrupt(int cycles, UBYTE s, UWORD pc)
+{
+	cycle_push(pc, s, TRUE);
+	cycle_charge(cycles);
+}
+
+void MONITOR_CycleProfileWait(int cycles)
+{
+	cycle_nodes[cycle_current].wait += cycles;
+	cycle_line_wait += cycles;
+}
+
+void MONITOR_CycleProfileEndLine(void)
+{
+	if (cycle_line_started && ANTIC_ypos < Atari800_TV_PAL) {
+		cycle_line *line = &cycle_lines[ANTIC_ypos];
+		int antic = ANTIC_xpos - cycle_line_start_xpos - cycle_line_cpu - cycle_line_wait;
+		if (antic < 0)
+			antic = 0;
+		line->count++;
+		line->cpu += cycle_line_cpu;
+		line->wait += cycle_line_wait;
+		line->antic += antic;
+		cycle_antic_total += antic;
+		if (cycle_line_cpu >= line->max_cpu) {
+			int i;
+			int max = -1;
+			line->max_cpu = cycle_line_cpu;
+			for (i = 0; i < cycle_line_node_count; i++) {
+				if (cycle_line_node_cycles[i] > max) {
+					max = cycle_line_node_cycles[i];
+					line->max_node = cycle_line_node[i];
+				}
+			}
+			if (max < 0)
+				line->max_node = cycle_current;
+		}
+	}
+	cycle_line_started = TRUE;
+	cycle_line_start_xpos = ANTIC_xpos - ANTIC_LINE_C;
+	cycle_line_cpu = cycle_line_wait = cycle_line_node_count = 0;
+}
+
+/* Writes the name of a calling context node: its label or address. */
+static int cycle_node_name(int node, char *buffer, size_t size)
+{
+	if (node == 0)
+		return snprintf(buffer, size, "[top]");
+#ifdef MONITOR_HINTS
+	{
+		const char *label = find_label_name(cycle_nodes[node].addr, 0);
+		if (label != NULL)
+			return snprintf(buffer, size, "%s", label);
+	}
+#endif
+	return snprintf(buffer, size, "$%04X", cycle_nodes[node].addr);
+}
+
+/* Writes the names of the nodes from the root down to NODE, separated by
+   semicolons. */
+static void cycle_write_path(FILE *fp, int node)
+{
+	char name[128];
+	if (node > 0) {
+		cycle_write_path(fp, cycle_nodes[node].parent);
+		fputc(';', fp);
+	}
+	cycle_node_name(node, name, sizeof(name));
+	fputs(name, fp);
+}
+
+/* Writes the profile as "caller;callee;... cycles" lines, as read by
+   flamegraph.pl and similar tools. */
+static void cycle_profile_write_folded(const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+	int i;
+	if (fp == NULL) {
+		perror(filename);
+		return;
+	}
+	for (i = 0; i < cycle_node_count; i++) {
+		if (cycle_nodes[i].cycles != 0) {
+			cycle_write_path(fp, i);
+			fprintf(fp, " %lu\n", cycle_nodes[i].cycles);
+		}
+		if (cycle_nodes[i].wait != 0) {
+			cycle_write_path(fp, i);
+			fprintf(fp, ";[WSYNC] %lu\n", cycle_nodes[i].wait);
+		}
+	}
+	if (cycle_antic_total != 0)
+		fprintf(fp, "[ANTIC] %lu\n", cycle_antic_total);
+	fclose(fp);
+	printf("Profile written to %s\n", filename);
+}
+
+/* Shows the subroutines that used the most cycles, including the
+   subroutines they called. */
+static void cycle_profile_show_hogs(void)
+{
+	unsigned long *total = (unsigned long *) Util_malloc(cycle_node_count * sizeof(unsigned long));
+	unsigned long *inclusive = (unsigned long *) Util_malloc(0x10000 * sizeof(unsigned long));
+	unsigned long *self = (unsigned long *) Util_malloc(0x10000 * sizeof(unsigned long));
+	unsigned long all = 0;
+	hog_rec hog_list[HOG_MAX];
+	unsigned int hog_count = 0;
+	unsigned int i;
+	int n;
+
+	memset(inclusive, 0, 0x10000 * sizeof(unsigned long));
+	memset(self, 0, 0x10000 * sizeof(unsigned long));
+	/* children always come after their parents */
+	for (n = cycle_node_count - 1; n >= 0; n--)
+		total[n] = cycle_nodes[n].cycles + cycle_nodes[n].wait;
+	for (n = cycle_node_count - 1; n > 0; n--)
+		total[cycle_nodes[n].parent] += total[n];
+	for (n = 1; n < cycle_node_count; n++) {
+		UWORD addr = cycle_nodes[n].addr;
+		int p;
+		self[addr] += cycle_nodes[n].cycles + cycle_nodes[n].wait;
+		/* count recursive calls once */
+		for (p = cycle_nodes[n].parent; p > 0; p = cycle_nodes[p].parent)
+			if (cycle_nodes[p].addr == addr)
+				break;
+		if (p <= 0)
+			inclusive[addr] += total[n];
+	}
+	all = total[0];
+	for (i = 0; i < 0x10000; i++)
+		if (inclusive[i] != 0)
+			insert_hog_rec(hog_list, &hog_count, (UWORD) i, inclusive[i]);
+	if (all == 0)
+		all = 1;
+	printf("Subroutine        Inclusive             Self\n");
+	for (i = 0; i < hog_count; i++) {
+		UWORD addr = hog_list[i].addr;
+		char name[128];
+#ifdef MONITOR_HINTS
+		const char *label = find_label_name(addr, 0);
+		if (label != NULL)
+			snprintf(name, sizeof(name), "%.11s", label);
+		else
+#endif
+			snprintf(name, sizeof(name), "%04X", addr);
+		printf("%-11s %10lu(%5.2f%%) %10lu(%5.2f%%)\n", name,
+			inclusive[addr], 100.0f * (float)inclusive[addr] / (float)all,
+			self[addr], 100.0f * (float)self[addr] / (float)all);
+	}
+	printf("Total: %lu cycles, %lu outside subroutines, %lu stolen by ANTIC\n",
+		total[0], cycle_nodes[0].cycles + cycle_nodes[0].wait, cycle_antic_total);
+	free(self);
+	free(inclusive);
+	free(total);
+}
+
+/* Shows the average use of each scanline. */
+static void cycle_profile_show_lines(int first, int last)
+{
+	int y;
+	int count = 0;
+	printf("Line   CPU  WSYNC ANTIC  Worst  Busiest in worst frame\n");
+	for (y = first; y <= last && y < Atari800_TV_PAL; y++) {
+		const cycle_line *line = &cycle_lines[y];
+		char name[128];
+		if (line->count == 0)
+			continue;
+		if (count++ >= 20) {
+			if (pager()) return;
+			count = 0;
+		}
+		cycle_node_name(line->max_node, name, sizeof(name));
+		printf("%3d %6.1f %6.1f %5.1f  %5d  %s\n", y,
+			(double) line->cpu / line->count, (double) line->wait / line->count,
+			(double) line->antic / line->count, line->max_cpu, name);
+	}
+}
+
+static void cycle_profile(void)
+{
+	char *cmd = get_token();
+	char cc = cmd != NULL ? (char) tolower(*cmd) : '?';
+
+	if (cmd != NULL && Util_stricmp(cmd, "ON") == 0) {
+		if (cycle_nodes == NULL)
+			cycle_profile_clear();
+		/* the calls in progress are unknown */
+		cycle_depth = 0;
+		cycle_current = 0;
+		cycle_line_started = FALSE;
+		MONITOR_cycle_profile = TRUE;
+		printf("Cycle profiling on\n");
+	}
+	else if (cmd != NULL && Util_stricmp(cmd, "OFF") == 0) {
+		MONITOR_cycle_profile = FALSE;
+		printf("Cycle profiling off\n");
+	}
+	else if (cc == 'c') {
+		cycle_profile_clear();
+		printf("Cycle profile reset\n");
+	}
+	else if (cc == 's' || cc == 'l' || cc == 'f') {
+		if (cycle_node_count == 0) {
+			printf("No cycle profile, use \"CYCLES ON\"\n");
+			return;
+		}
+		if (cc == 's')
+			cycle_profile_show_hogs();
+		else if (cc == 'l') {
+			int first = 0;
+			int last = Atari800_TV_PAL - 1;
+			get_dec(&first);
+			get_dec(&last);
+			cycle_profile_show_lines(first, last);
+		}
+		else {
+			const char *filename = get_token();
+			if (filename == NULL)
+				printf("Missing filename!\n");
+			else
+				cycle_profile_write_folded(filename);
+		}
+	}
+	else {
+		printf(
+			"Usage:\n"
+			"CYCLES ON|OFF            - Start/stop cycle profiling\n"
+			"CYCLES C                 - Clear the profile\n"
+			"CYCLES S                 - Subroutines that used the most cycles\n"
+			"CYCLES L [first [last]]  - Average cycle use of each scanline\n"
+			"CYCLES F filename        - Write call stacks in folded format\n"
+			"                           (for flamegraph.pl)\n");
+	}
+}
 #endif /* MONITOR_PROFILE */
 
 /* Displays current contents of the processor stack. */
@@ -2217,6 +2942,7 @@ static void monitor_read_from_file(UWORD *addr)
 					if ((int)toaddr-(int)fromaddr<0) { printf("Bad xex file\n"); break; }
 					nbytes=toaddr-fromaddr+1;
 
+					MEMORY_DecodeInvalidate(fromaddr, toaddr);
 					/* if not full block, error */
 					if (fread(&MEMORY_mem[*addr], nbytes, 1, f) == 0) {
 						printf("Bad xex file\n");
@@ -2243,6 +2969,7 @@ static void monitor_read_from_file(UWORD *addr)
 					}
 					else {
 						/* read as many bytes as given or available */
+						MEMORY_DecodeInvalidate(*addr, *addr + nbytes - 1);
 						if ((nbytes=fread(&MEMORY_mem[*addr], 1, nbytes, f)) == 0)
 							printf("Could not read bytes\n");
 						fclose(f);
@@ -2408,8 +3135,8 @@ static void monitor_change_mem(UWORD *addr)
 		taddr=*addr;
 		while (get_hex(&temp)) {
 #ifdef PAGED_ATTRIB
-			if (MEMORY_writemap[*addr >> 8] != NULL && MEMORY_writemap[*addr >> 8] != MEMORY_ROM_PutByte)
-				(*MEMORY_writemap[*addr >> 8])(*addr, (UBYTE) temp);
+			if (MEMORY_UnwatchedWritemap(*addr >> 8) != NULL && MEMORY_UnwatchedWritemap(*addr >> 8) != MEMORY_ROM_PutByte)
+				(*MEMORY_UnwatchedWritemap(*addr >> 8))(*addr, (UBYTE) temp);
 #else
 			if (MEMORY_attrib[*addr] == MEMORY_HARDWARE)
 				MEMORY_HwPutByte(*addr, (UBYTE) temp);
@@ -2419,8 +3146,8 @@ static void monitor_change_mem(UWORD *addr)
 			(*addr)++;
 			if (temp > 0xff) {
 #ifdef PAGED_ATTRIB
-				if (MEMORY_writemap[*addr >> 8] != NULL && MEMORY_writemap[*addr >> 8] != MEMORY_ROM_PutByte)
-					(*MEMORY_writemap[*addr >> 8])(*addr, (UBYTE) (temp >> 8));
+				if (MEMORY_UnwatchedWritemap(*addr >> 8) != NULL && MEMORY_UnwatchedWritemap(*addr >> 8) != MEMORY_ROM_PutByte)
+					(*MEMORY_UnwatchedWritemap(*addr >> 8))(*addr, (UBYTE) (temp >> 8));
 #else
 				if (MEMORY_attrib[*addr] == MEMORY_HARDWARE)
 					MEMORY_HwPutByte(*addr, (UBYTE) (temp >> 8));
@@ -2706,6 +3433,7 @@ static void configure_labels(UWORD *addr)
 					if (p->addr != *addr) {
 						printf("%s redefined (previous value: %04X)\n", name, p->addr);
 						p->addr = *addr;
+						symtable_index_build(&symtable_user_index, symtable_user, symtable_user_size);
 					}
 				}
 				else
@@ -3147,13 +3875,20 @@ static void show_help(void)
 	if(pager()) return;
 #ifdef MONITOR_TRACE
 	printf(
-		"TRACE [filename]               - Output 6502 trace on/off\n");
+		"TRACE [filename]               - Output 6502 trace on/off\n"
+		"TRACEBIN [filename]            - Output binary 6502 trace on/off\n"
+		"TRACEDECODE binfile textfile   - Convert binary trace to TRACE output\n");
 #endif
 #ifdef MONITOR_BREAK
 	printf(
 		"BPC [addr]                     - Set breakpoint at address\n"
 		"BLINE [ypos] or [1000+ypos]    - Break at scanline or blink scanline\n"
 		"BBRK ON or OFF                 - Breakpoint on BRK on/off\n"
+#ifdef MEMORY_WATCH
+		"WATCH                          - List memory watches\n"
+		"WATCH R|W|RW addr1 [addr2]     - Break on read/write of memory\n"
+		"WATCH C [addr1 [addr2]]        - Clear memory watches\n"
+#endif
 		"HISTORY or H                   - List last %d executed instructions\n", CPU_REMEMBER_PC_STEPS);
 	printf(
 		"JUMPS                          - List last %d executed JMP/JSR\n", CPU_REMEMBER_JMP_STEPS);
@@ -3177,7 +3912,8 @@ static void show_help(void)
 	printf(
 #ifdef MONITOR_PROFILE
 		"PROFILE                        - Display profiling statistics\n"
-		"COV [argument...]              - Coverage statistics (\"COV ?\" for help)\n");
+		"COV [argument...]              - Coverage statistics (\"COV ?\" for help)\n"
+		"CYCLES [argument...]           - Cycle profiler (\"CYCLES ?\" for help)\n");
 	printf(
 #endif
 #ifdef MONITOR_HINTS
@@ -3215,7 +3951,13 @@ static void show_help(void)
 		"GRM addr [width] [height]      - Display memory as mono bitmap\n"
 		"GRC addr [width] [height]      - Display memory as 4-color bitmap\n"
 		"SAVESTATE [filename]           - Save machine state (default 'monitor.a8s')\n"
-		"LOADSTATE [filename]           - Load machine state (default 'monitor.a8s')\n"
+		"LOADSTATE [filename]           - Load machine state (default 'monitor.a8s')\n");
+#ifdef EVENT_RECORDING
+	printf(
+		"PLAYBACK [frame]               - Show position of event playback, or continue\n"
+		"                                 the playback at decimal frame\n");
+#endif
+	printf(
 		"QUIT or EXIT                   - Quit emulator\n"
 		"HELP or ?                      - This text\n");
 }
@@ -3529,20 +4271,26 @@ static char *command_generator(const char *text, int state)
 	static const char *commands[] = {
 		"CONT", "SHOW", "STACK", "LOOP", "HARDWARE", "READ", "WRITE",
 #ifdef MONITOR_TRACE
-		"TRACE",
+		"TRACE", "TRACEBIN", "TRACEDECODE",
 #endif
 #if defined(MONITOR_BREAK) || !defined(NO_YPOS_BREAK_FLICKER)
 		"BLINE",
 #endif
 #ifdef MONITOR_BREAK
 		"BBRK", "HISTORY", "JUMPS",
+#endif
+#ifdef MEMORY_WATCH
+		"WATCH",
 #endif
 		"ANTIC", "GTIA", "PIA", "POKEY", "DLIST",
 #ifdef MONITOR_PROFILE
-		"PROFILE",
+		"PROFILE", "CYCLES",
 #endif
 		"LABELS",
 		"SAVESTATE", "LOADSTATE",
+#ifdef EVENT_RECORDING
+		"PLAYBACK",
+#endif
 		"COLDSTART", "WARMSTART", "QUIT", "EXIT", "HELP",
 		NULL };
 
@@ -3669,6 +4417,17 @@ static int cmd_wants_filename(void) {
 #ifdef MONITOR_TRACE
 	if(spaces == 1 && Util_strnicmp(rl_line_buffer, "trace ", 6) == 0)
 		return TRUE;
+
+	if(spaces == 1 && Util_strnicmp(rl_line_buffer, "tracebin ", 9) == 0)
+		return TRUE;
+
+	if((spaces == 1 || spaces == 2) && Util_strnicmp(rl_line_buffer, "tracedecode ", 12) == 0)
+		return TRUE;
+#endif
+
+#ifdef MONITOR_PROFILE
+	if(spaces == 2 && Util_strnicmp(rl_line_buffer, "cycles f ", 9) == 0)
+		return TRUE;
 #endif
 
 #ifdef HAVE_STRSTR
@@ -3807,6 +4566,14 @@ int MONITOR_Run(void)
 		printf("(breakpoint at scanline %d)\n", ANTIC_break_ypos);
 	else if (MONITOR_break_ret && MONITOR_ret_nesting <= 0)
 		printf("(returned)\n");
+#ifdef MEMORY_WATCH
+	if (MEMORY_watch_hit_addr >= 0) {
+		printf("(%s %04X=%02X) ", MEMORY_watch_hit_write ? "write" : "read",
+		       MEMORY_watch_hit_addr, MEMORY_watch_hit_value);
+		show_instruction(stdout, CPU_remember_PC[(CPU_remember_PC_curpos + CPU_REMEMBER_PC_STEPS - 1) % CPU_REMEMBER_PC_STEPS]);
+		MEMORY_watch_hit_addr = -1;
+	}
+#endif
 	MONITOR_break_step = FALSE;
 	MONITOR_break_ret = FALSE;
 #endif /* MONITOR_BREAK */
@@ -3861,6 +4628,10 @@ int MONITOR_Run(void)
 			monitor_break_BRK();
 		else if (strcmp(t, "BPC") == 0)
 			monitor_break_PC();
+#ifdef MEMORY_WATCH
+		else if (strcmp(t, "WATCH") == 0)
+			monitor_watch();
+#endif
 		else if (strcmp(t, "HISTORY") == 0 || strcmp(t, "H") == 0)
 			show_history();
 		else if (strcmp(t, "JUMPS") == 0)
@@ -3919,12 +4690,20 @@ int MONITOR_Run(void)
 			const char *filename = get_token();
 			set_trace_file(filename);
 		}
+		else if (strcmp(t, "TRACEBIN") == 0) {
+			const char *filename = get_token();
+			set_binary_trace_file(filename);
+		}
+		else if (strcmp(t, "TRACEDECODE") == 0)
+			decode_trace();
 #endif /* MONITOR_TRACE */
 #ifdef MONITOR_PROFILE
 		else if (strcmp(t, "PROFILE") == 0)
 			command_PROFILE();
 		else if (strcmp(t, "COV") == 0)
 			coverage();
+		else if (strcmp(t, "CYCLES") == 0)
+			cycle_profile();
 #endif /* MONITOR_PROFILE */
 		else if (strcmp(t, "SHOW") == 0)
 			show_state();
@@ -3977,8 +4756,10 @@ int MONITOR_Run(void)
 		else if (strcmp(t, "S") == 0)
 			monitor_search_mem();
 #ifdef MONITOR_BREAKPOINTS
-		else if (strcmp(t, "B") == 0)
+		else if (strcmp(t, "B") == 0) {
 			monitor_breakpoints();
+			MONITOR_CompileBreakpoints();
+		}
 #endif
 		else if (strcmp(t, "D") == 0) {
 			get_hex(&addr);
@@ -4042,6 +4823,20 @@ int MONITOR_Run(void)
 		} else if (strcmp(t, "LOADSTATE") == 0) {
 			save_load_state(FALSE);
 #endif /* BASIC */
+#ifdef EVENT_RECORDING
+		} else if (strcmp(t, "PLAYBACK") == 0) {
+			int frame;
+			if (INPUT_PlaybackFrame() < 0)
+				printf("No seekable event playback\n");
+			else if (!get_dec(&frame))
+				printf("Frame %d of %d\n", INPUT_PlaybackFrame(), INPUT_PlaybackLength());
+			else if (INPUT_PlaybackSeek(frame)) {
+				PLUS_EXIT_MONITOR;
+				return TRUE;
+			}
+			else
+				printf("Cannot seek to frame %d\n", frame);
+#endif /* EVENT_RECORDING */
 		} else if (strcmp(t, "SSTR") == 0) {
 			string_search(FALSE);
 		} else if (strcmp(t, "SSCR") == 0) {
@@ -67,6 +67,24 @@ extern MONITOR_breakpoint_cond MONITOR_breakpoint_table[MONITOR_BREAKPOINT_TABLE
 extern int MONITOR_breakpoint_table_size;
 extern int MONITOR_breakpoints_enabled;
 
+/* The breakpoint table compiled into bitmaps of 6502 addresses, so that
+   CPU_GO can skip the table walk for most instructions. PC conditions go
+   into the PC map, READ/WRITE/ACCESS conditions of groups without a PC
+   condition into the read and write maps. Groups that can't be mapped
+   (only register, flag or MEM conditions) are checked on every instruction. */
+#define MONITOR_BREAKPOINT_CHECK_PC      1
+#define MONITOR_BREAKPOINT_CHECK_ACCESS  2
+#define MONITOR_BREAKPOINT_CHECK_ALWAYS  4
+extern int MONITOR_breakpoint_checks;
+extern UBYTE MONITOR_breakpoint_pc_map[0x10000 / 8];
+extern UBYTE MONITOR_breakpoint_read_map[0x10000 / 8];
+extern UBYTE MONITOR_breakpoint_write_map[0x10000 / 8];
+#define MONITOR_BREAKPOINT_MAP_TEST(map, addr) ((map)[(addr) >> 3] & (1 << ((addr) & 7)))
+
+/* Must be called after MONITOR_breakpoint_table or
+   MONITOR_breakpoints_enabled have been changed. */
+void MONITOR_CompileBreakpoints(void);
+
 #endif /* MONITOR_BREAKPOINTS */
 
 #ifdef MONITOR_PROFILE
@@ -78,6 +96,20 @@ extern MONITOR_coverage_rec MONITOR_coverage[0x10000];
 extern unsigned long MONITOR_coverage_insns;
 extern unsigned long MONITOR_coverage_cycles;
 
+/* Cycle profiler: attributes cycles to call stacks and to scanlines while
+   MONITOR_cycle_profile is TRUE. See the CYCLES monitor command. */
+extern int MONITOR_cycle_profile;
+/* Called after each instruction: INSN took CYCLES cycles, S and PC are the
+   stack pointer and program counter after it. */
+void MONITOR_CycleProfileInsn(UBYTE insn, int cycles, UBYTE s, UWORD pc);
+/* Called after the 6502 has taken an interrupt and jumped to PC. */
+void MONITOR_CycleProfileInterrupt(int cycles, UBYTE s, UWORD pc);
+/* Called when the CPU resumes after waiting CYCLES cycles for WSYNC. */
+void MONITOR_CycleProfileWait(int cycles);
+/* Called at the end of each scanline, with ANTIC_xpos not yet reduced by
+   ANTIC_LINE_C. */
+void MONITOR_CycleProfileEndLine(void);
+
 #endif /* MONITOR_PROFILE */
 
 #endif /* MONITOR_H_ */
@@ -106,15 +106,47 @@ struct stPokeyState;
 typedef int (*readout_t)(struct stPokeyState* ps);
 typedef void (*event_t)(struct stPokeyState* ps, int p5v, int p4v, int p917v);
 
+#ifdef FIXED_POINT_SOUND
+/* Resampling in integer arithmetic. Volumes in the change queue are in
+   units of 1/QEV_SCALE. filter_fixed[] holds filter_data[] multiplied by the
+   output gain, in units of 2^-OUT_SHIFT output LSB per volume unit, so the
+   sum over the change queue is the output sample scaled by 2^OUT_SHIFT.
+   filter_fixed_sync[] is the same with the gain of the synchronised output,
+   which includes the volume setting.
+   The fraction of the sample position is kept in 1/2^32 of a tick, so that
+   it doesn't drift away from the exact sample rate, and the filter is
+   interpolated with its top FRAC_SHIFT bits. */
+#define OUT_SHIFT 12
+#define FRAC_SHIFT 8
+#ifdef NONLINEAR_MIXING
+#define QEV_SCALE 64
+typedef int qev_t;
+static qev_t pokeymix_fixed[61+CONSOLE_VOL];
+#define POKEYMIX(x) pokeymix_fixed[x]
+#else
+#define QEV_SCALE 1
+typedef unsigned char qev_t;
+#endif
+
+static int filter_fixed[SND_FILTER_SIZE];
+static int filter_fixed_sync[SND_FILTER_SIZE];
+
+static int ticks_per_sample;
+static unsigned int ticks_per_sample_frac;
+static int samp_pos;
+static unsigned int samp_pos_frac;
+#else /* FIXED_POINT_SOUND */
 #ifdef NONLINEAR_MIXING
 /* Change queue event value type */
 typedef double qev_t;
+#define POKEYMIX(x) pokeymix[x]
 #else
 typedef unsigned char qev_t;
 #endif
 
 static double ticks_per_sample;
 static double samp_pos;
+#endif /* FIXED_POINT_SOUND */
 
 /* State variables for single Pokey Chip */
 typedef struct stPokeyState
@@ -260,6 +292,9 @@ typedef struct stPokeyState
 
     int speaker;
 
+    /* Dither noise generator */
+    unsigned int dither;
+
 } PokeyState;
 
 PokeyState pokey_states[NPOKEYS];
@@ -418,8 +453,82 @@ static void ResetPokeyState(PokeyState* ps)
 
     /* GTIA speaker */
     ps->speaker = 0;
+
+    /* Different seeds keep the dither of the two chips uncorrelated */
+    ps->dither = (unsigned int) (ps - pokey_states) * 0x9e3779b9U;
+}
+
+/* Dither noise comes from a linear congruential generator in each chip
+   instead of rand(), which is slow, shared with the rest of the program and
+   makes the output depend on everything else that calls it. */
+static unsigned int next_dither(PokeyState* ps)
+{
+    ps->dither = ps->dither * 1664525U + 1013904223U;
+    return ps->dither;
+}
+
+#ifdef FIXED_POINT_SOUND
+/* Sums the contributions of the change queue with FILTER at the input
+   sample at or before the output point (returned) and at the one after it
+   (stored in *next). The queue only holds the volume changes within the
+   filter length, a few per sample, so this sparse sum needs far fewer
+   multiplications than a dense convolution over all filter_size taps. */
+static int sum_resam(PokeyState* ps, const int *filter, int *next)
+{
+    int i = ps->qebeg;
+    qev_t avol = ps->ovola;
+    int sum0 = 0;
+    int sum1 = 0;
+
+    /* Separate two loop cases, for wrap-around and without */
+    if (ps->qeend < ps->qebeg) /* With wrap */
+    {
+        for (; i < filter_size; ++i)
+        {
+            const int *f = filter + (ps->curtick - ps->qet[i]);
+            int d = avol - ps->qev[i];
+            sum0 += d * f[0];
+            sum1 += d * f[1];
+            avol = ps->qev[i];
+        }
+        i = 0;
+    }
+
+    /* without wrap */
+    for (; i < ps->qeend; ++i)
+    {
+        const int *f = filter + (ps->curtick - ps->qet[i]);
+        int d = avol - ps->qev[i];
+        sum0 += d * f[0];
+        sum1 += d * f[1];
+        avol = ps->qev[i];
+    }
+
+    *next = sum1 + avol * filter[1];
+    return sum0 + avol * filter[0];
+}
+
+/* returns the filtered output sample value scaled by 2^OUT_SHIFT */
+static int read_resam_all(PokeyState* ps)
+{
+    int next;
+    return sum_resam(ps, filter_fixed, &next);
 }
 
+/* returns the filtered output sample value scaled by 2^OUT_SHIFT, using an
+ * interpolated filter; frac is the fractional distance of the output sample
+ * point between input sample values, in 1/2^FRAC_SHIFT.
+ * As the weights of the queue add up to ovola, the filter_data[filter_size-1]
+ * term of the floating point version is taken out of the sum. */
+static int interp_read_resam_all(PokeyState* ps, int frac)
+{
+    int next;
+    int sum = sum_resam(ps, filter_fixed_sync, &next);
+    return sum + ((next - sum) >> FRAC_SHIFT) * frac
+           - ((filter_fixed_sync[filter_size - 1] * ps->ovola) >> FRAC_SHIFT) * ((1 << FRAC_SHIFT) - frac);
+}
+
+#else /* FIXED_POINT_SOUND */
 
 static double read_resam_all(PokeyState* ps)
 {
@@ -513,6 +622,7 @@ static double interp_read_resam_all(PokeyState* ps, double frac)
 
     return sum;
 }
+#endif /* FIXED_POINT_SOUND */
 
 static void add_change(PokeyState* ps, qev_t a)
 {
@@ -949,7 +1059,7 @@ static void advance_ticks(PokeyState* ps, int ticks)
     {
         ps->forcero = 0;
 #ifdef NONLINEAR_MIXING
-        outvol_new = pokeymix[ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3 + ps->speaker];
+        outvol_new = POKEYMIX(ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3 + ps->speaker);
 #else
         outvol_new = ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3;
         outvol_new += ps->speaker;
@@ -1115,7 +1225,7 @@ static void advance_ticks(PokeyState* ps, int ticks)
             }
 
 #ifdef NONLINEAR_MIXING
-            outvol_new = pokeymix[ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3 + ps->speaker];
+            outvol_new = POKEYMIX(ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3 + ps->speaker);
 #else
             outvol_new = ps->outvol_0 + ps->outvol_1 + ps->outvol_2 + ps->outvol_3;
             outvol_new += ps->speaker;
@@ -1129,7 +1239,11 @@ static void advance_ticks(PokeyState* ps, int ticks)
     }
 }
 
+#ifdef FIXED_POINT_SOUND
+static int generate_sample(PokeyState* ps)
+#else
 static double generate_sample(PokeyState* ps)
+#endif
 {
     /*unsigned long ta = (subticks+pokey_frq)/POKEYSND_playback_freq;
     subticks = (subticks+pokey_frq)%POKEYSND_playback_freq;*/
@@ -1265,13 +1379,24 @@ static void Update_consol_sound_mz( int set );
 /*****************************************************************************/
 
 static void generate_sync(unsigned int num_ticks);
+#ifdef FIXED_POINT_SOUND
+static void build_filter_fixed(int bit16);
+#endif
 
 static void init_syncsound(void)
 {
     double samples_per_frame = (double)POKEYSND_playback_freq/(Atari800_tv_mode == Atari800_TV_PAL ? Atari800_FPS_PAL : Atari800_FPS_NTSC);
     unsigned int ticks_per_frame = Atari800_tv_mode*114;
+#ifdef FIXED_POINT_SOUND
+    double tps = (double)ticks_per_frame / samples_per_frame;
+    ticks_per_sample = (int)tps;
+    ticks_per_sample_frac = (unsigned int)((tps - ticks_per_sample) * 4294967296.0);
+    samp_pos = 0;
+    samp_pos_frac = 0;
+#else
     ticks_per_sample = (double)ticks_per_frame / samples_per_frame;
     samp_pos = 0.0;
+#endif
     POKEYSND_GenerateSync = generate_sync;
 }
 
@@ -1392,6 +1517,9 @@ int MZPOKEYSND_Init(ULONG freq17, int playback_freq, UBYTE num_pokeys,
 	init_syncsound();
 	volume.s8 = POKEYSND_volume * 0xff / 256.0;
 	volume.s16 = POKEYSND_volume * 0xffff / 256.0;
+#ifdef FIXED_POINT_SOUND
+	build_filter_fixed(flags & POKEYSND_BIT16);
+#endif
 
 	return 0; /* OK */
 }
@@ -2280,6 +2408,126 @@ void mzpokeysnd_debugreset(UBYTE chip)
 
 #define MAX_SAMPLE 152
 
+#ifdef FIXED_POINT_SOUND
+
+/* Scales the filter and the nonlinear mixing table for integer resampling.
+   Like in the floating point version, the non-synchronised output is at
+   full level and only the synchronised one depends on the volume. */
+static void build_filter_fixed(int bit16)
+{
+    int i;
+    double gain = (bit16 ? 65535.0 : 255.0) / 2 / MAX_SAMPLE / 4 * M_PI * 0.95
+                  * (1 << OUT_SHIFT) / QEV_SCALE;
+    double gain_sync = (bit16 ? volume.s16 : volume.s8) / 2 / MAX_SAMPLE / 4 * M_PI * 0.95
+                       * (1 << OUT_SHIFT) / QEV_SCALE;
+
+    for (i = 0; i < filter_size; i++) {
+        filter_fixed[i] = (int)floor(filter_data[i] * gain + 0.5);
+        filter_fixed_sync[i] = (int)floor(filter_data[i] * gain_sync + 0.5);
+    }
+#ifdef NONLINEAR_MIXING
+    for (i = 0; i < 61+CONSOLE_VOL; i++)
+        pokeymix_fixed[i] = (qev_t)floor(pokeymix[i] * QEV_SCALE + 0.5);
+#endif
+}
+
+/* rounding plus dither of 0.25 LSB, scaled by 2^OUT_SHIFT */
+#define DITHER(ps) ((1 << (OUT_SHIFT - 2)) + (int)(next_dither(ps) >> (33 - OUT_SHIFT)))
+/* the output is offset to positive values so that the shift rounds down */
+#define OUTPUT_8(sum) ((UBYTE)(((sum) + (128 << OUT_SHIFT)) >> OUT_SHIFT))
+#define OUTPUT_16(sum) ((SWORD)((((sum) + (32768 << OUT_SHIFT)) >> OUT_SHIFT) - 32768))
+
+static void mzpokeysnd_process_8(void* sndbuffer, int sndn)
+{
+    int i;
+    int nsam = sndn;
+    UBYTE *buffer = (UBYTE *) sndbuffer;
+
+    if(num_cur_pokeys<1)
+        return; /* module was not initialized */
+
+    /* if there are two pokeys, then the signal is stereo
+       we assume even sndn */
+    while(nsam >= (int) num_cur_pokeys)
+    {
+        for(i=0; i<num_cur_pokeys; i++)
+            buffer[i] = OUTPUT_8(generate_sample(pokey_states + i) + DITHER(pokey_states + i));
+        buffer += num_cur_pokeys;
+        nsam -= num_cur_pokeys;
+    }
+}
+
+static void mzpokeysnd_process_16(void* sndbuffer, int sndn)
+{
+    int i;
+    int nsam = sndn;
+    SWORD *buffer = (SWORD *) sndbuffer;
+
+    if(num_cur_pokeys<1)
+        return; /* module was not initialized */
+
+    /* if there are two pokeys, then the signal is stereo
+       we assume even sndn */
+    while(nsam >= (int) num_cur_pokeys)
+    {
+        for(i=0; i<num_cur_pokeys; i++)
+            buffer[i] = OUTPUT_16(generate_sample(pokey_states + i) + DITHER(pokey_states + i));
+        buffer += num_cur_pokeys;
+        nsam -= num_cur_pokeys;
+    }
+}
+
+static void generate_sync(unsigned int num_ticks)
+{
+	unsigned int ticks;
+	UBYTE *buffer = POKEYSND_process_buffer + POKEYSND_process_buffer_fill;
+	UBYTE *buffer_end = POKEYSND_process_buffer + POKEYSND_process_buffer_length;
+	unsigned int i;
+
+	for (;;) {
+		unsigned int new_samp_pos_frac = samp_pos_frac + ticks_per_sample_frac;
+		int frac;
+		/* add the carry out of the fraction */
+		ticks = (unsigned int)(samp_pos + ticks_per_sample + (new_samp_pos_frac < samp_pos_frac));
+		if (ticks > num_ticks) {
+			samp_pos -= num_ticks;
+			break;
+		}
+		if (buffer >= buffer_end)
+			break;
+
+		samp_pos = 0;
+		samp_pos_frac = new_samp_pos_frac;
+		num_ticks -= ticks;
+		frac = samp_pos_frac >> (32 - FRAC_SHIFT);
+
+		for (i = 0; i < num_cur_pokeys; ++i) {
+			/* advance pokey to the new position and produce a sample */
+			int sum;
+			advance_ticks(pokey_states + i, ticks);
+			sum = interp_read_resam_all(pokey_states + i, frac) + DITHER(pokey_states + i);
+			if (POKEYSND_snd_flags & POKEYSND_BIT16) {
+				*((SWORD *)buffer) = OUTPUT_16(sum);
+				buffer += 2;
+			}
+			else
+				*buffer++ = OUTPUT_8(sum);
+		}
+	}
+
+	POKEYSND_process_buffer_fill = buffer - POKEYSND_process_buffer;
+	if (num_ticks > 0) {
+		/* remaining ticks */
+		for (i = 0; i < num_cur_pokeys; ++i)
+			advance_ticks(pokey_states + i, num_ticks);
+	}
+}
+
+#else /* FIXED_POINT_SOUND */
+
+/* uniform noise in [-0.25, 0.25) */
+#define DITHER(ps) (next_dither(ps) * (0.5 / 4294967296.0) - 0.25)
+
 static void mzpokeysnd_process_8(void* sndbuffer, int sndn)
 {
     int i;
@@ -2294,11 +2542,11 @@ static void mzpokeysnd_process_8(void* sndbuffer, int sndn)
     while(nsam >= (int) num_cur_pokeys)
     {
         buffer[0] = (UBYTE)floor(generate_sample(pokey_states)
-         * (255.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 128 + 0.5 + 0.5 * rand() / RAND_MAX - 0.25);
+         * (255.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 128 + 0.5 + DITHER(pokey_states));
         for(i=1; i<num_cur_pokeys; i++)
         {
             buffer[i] = (UBYTE)floor(generate_sample(pokey_states + i)
-             * (255.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 128 + 0.5 + 0.5 * rand() / RAND_MAX - 0.25);
+             * (255.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 128 + 0.5 + DITHER(pokey_states + i));
         }
         buffer += num_cur_pokeys;
         nsam -= num_cur_pokeys;
@@ -2319,11 +2567,11 @@ static void mzpokeysnd_process_16(void* sndbuffer, int sndn)
     while(nsam >= (int) num_cur_pokeys)
     {
         buffer[0] = (SWORD)floor(generate_sample(pokey_states)
-         * (65535.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 0.5 + 0.5 * rand() / RAND_MAX - 0.25);
+         * (65535.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 0.5 + DITHER(pokey_states));
         for(i=1; i<num_cur_pokeys; i++)
         {
             buffer[i] = (SWORD)floor(generate_sample(pokey_states + i)
-             * (65535.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 0.5 + 0.5 * rand() / RAND_MAX - 0.25);
+             * (65535.0 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95) + 0.5 + DITHER(pokey_states + i));
         }
         buffer += num_cur_pokeys;
         nsam -= num_cur_pokeys;
@@ -2360,7 +2608,7 @@ static void generate_sync(unsigned int num_ticks)
 				*((SWORD *)buffer) = (SWORD)floor(
 					interp_read_resam_all(pokey_states + i, samp_pos)
 					* (volume.s16 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95)
-					+ 0.5 + 0.5 * rand() / RAND_MAX - 0.25
+					+ 0.5 + DITHER(pokey_states + i)
 				);
 				buffer += 2;
 			}
@@ -2368,7 +2616,7 @@ static void generate_sync(unsigned int num_ticks)
 				*buffer++ = (UBYTE)floor(
 					interp_read_resam_all(pokey_states + i, samp_pos)
 					* (volume.s8 / 2 / MAX_SAMPLE / 4 * M_PI * 0.95)
-					+ 128 + 0.5 + 0.5 * rand() / RAND_MAX - 0.25
+					+ 128 + 0.5 + DITHER(pokey_states + i)
 				);
 		}
 	}
@@ -2381,6 +2629,8 @@ static void generate_sync(unsigned int num_ticks)
 	}
 }
 
+#endif /* FIXED_POINT_SOUND */
+
 #ifdef CONSOLE_SOUND
 static void Update_consol_sound_mz( int set )
 {
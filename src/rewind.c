@@ -0,0 +1,395 @@
+/*
+ * rewind.c - keeping a history of states in memory to run the emulation
+ *            backwards
+ *
+ * Copyright (C) 2026 Atari800 development team (see DOC/CREDITS)
+ *
+ * This file is part of the Atari800 emulator project which emulates
+ * the Atari 400, 800, 800XL, 130XE, and 5200 8-bit computers.
+ *
+ * Atari800 is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Atari800 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atari800; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "atari.h"
+#include "log.h"
+#include "rewind.h"
+#include "statesav.h"
+#include "util.h"
+
+/* The history is a ring of state saves, one per frame. Every
+   KEYFRAME_INTERVAL frames (and whenever the size of the state save changes)
+   a complete state save is stored as a keyframe. The other frames are stored
+   as the XOR with the preceding keyframe, run length encoded: most of the
+   state doesn't change from frame to frame, so the XOR is mostly zeros.
+
+   An encoded frame is a sequence of records, each one a UWORD count of bytes
+   equal to the keyframe, a UWORD count of literal bytes and the literal bytes
+   (XORed with the keyframe). UWORDs are little endian. */
+
+#define KEYFRAME_INTERVAL 60
+/* a run of equal bytes shorter than this is kept inside a literal block */
+#define MIN_SKIP 4
+
+/* Recording costs a state save every frame, so it is off unless asked for. */
+int REWIND_seconds = 0;
+int REWIND_memory_mb = 32;
+
+typedef struct {
+	UBYTE *data;
+	ULONG size;        /* number of bytes in data */
+	ULONG state_size;  /* size of the decoded state save */
+	int key;           /* TRUE if data holds a complete state save */
+	int nframes;       /* Atari800_nframes of the state */
+} rewind_entry;
+
+static rewind_entry *entries = NULL;
+static int capacity = 0;
+static int first = 0;    /* index of the oldest entry in entries */
+static int count = 0;
+static int num_keys = 0;
+static int last_key = -1; /* position of the newest keyframe, 0 = oldest */
+static ULONG memory_used = 0;
+static ULONG memory_limit = 0; /* REWIND_memory_mb in bytes */
+
+/* state save of the current frame, and output of the encoder */
+static UBYTE *state_buf = NULL;
+static UBYTE *delta_buf = NULL;
+
+#define ENTRY(pos) (entries[(first + (pos)) % capacity])
+
+static void PutUWORD(UBYTE *p, ULONG value)
+{
+	p[0] = (UBYTE) value;
+	p[1] = (UBYTE) (value >> 8);
+}
+
+static ULONG EncodeDelta(const UBYTE *key, const UBYTE *state, ULONG size, UBYTE *out)
+{
+	UBYTE *p = out;
+	ULONG pos = 0;
+	while (pos < size) {
+		ULONG start = pos;
+		ULONG skip;
+		/* most of the state is unchanged, so skip it 8 bytes at a time */
+		while (pos + 8 <= size && pos - start + 8 <= 0xffff && memcmp(state + pos, key + pos, 8) == 0)
+			pos += 8;
+		while (pos < size && state[pos] == key[pos] && pos - start < 0xffff)
+			pos++;
+		skip = pos - start;
+		start = pos;
+		while (pos < size && pos - start < 0xffff) {
+			if (state[pos] == key[pos]) {
+				ULONG run = 1;
+				while (run < MIN_SKIP && pos + run < size && state[pos + run] == key[pos + run])
+					run++;
+				if (run == MIN_SKIP || pos + run == size || pos + run - start > 0xffff)
+					break;
+				pos += run;
+			}
+			else
+				pos++;
+		}
+		PutUWORD(p, skip);
+		PutUWORD(p + 2, pos - start);
+		p += 4;
+		while (start < pos) {
+			*p++ = state[start] ^ key[start];
+			start++;
+		}
+	}
+	return (ULONG) (p - out);
+}
+
+static void DecodeDelta(const UBYTE *delta, ULONG delta_size, UBYTE *state)
+{
+	const UBYTE *end = delta + delta_size;
+	ULONG pos = 0;
+	while (delta < end) {
+		ULONG literal;
+		pos += delta[0] | (delta[1] << 8);
+		literal = delta[2] | (delta[3] << 8);
+		delta += 4;
+		while (literal-- > 0)
+			state[pos++] ^= *delta++;
+	}
+}
+
+static void FreeEntry(rewind_entry *e)
+{
+	memory_used -= e->size;
+	if (e->key)
+		num_keys--;
+	free(e->data);
+	e->data = NULL;
+}
+
+/* Drops the oldest keyframe and the frames encoded against it. */
+static void DropOldestGroup(void)
+{
+	do {
+		FreeEntry(&ENTRY(0));
+		first = (first + 1) % capacity;
+		count--;
+		last_key--;
+	} while (count > 0 && !ENTRY(0).key);
+}
+
+void REWIND_Clear(void)
+{
+	while (count > 0) {
+		FreeEntry(&ENTRY(count - 1));
+		count--;
+	}
+	first = 0;
+	last_key = -1;
+}
+
+static void AllocStateBuffers(void)
+{
+	if (state_buf == NULL) {
+		state_buf = (UBYTE *) Util_malloc(STATESAV_MAX_SIZE);
+		/* worst case of the encoder is one record for every MIN_SKIP + 1 bytes */
+		delta_buf = (UBYTE *) Util_malloc(STATESAV_MAX_SIZE + STATESAV_MAX_SIZE / (MIN_SKIP + 1) * 4 + 8);
+	}
+}
+
+static int AllocBuffers(void)
+{
+	int new_capacity = REWIND_seconds * 60 + KEYFRAME_INTERVAL;
+	REWIND_Clear();
+	free(entries);
+	entries = NULL;
+	capacity = 0;
+	if (REWIND_seconds <= 0)
+		return TRUE;
+	entries = (rewind_entry *) Util_malloc(new_capacity * sizeof(rewind_entry));
+	capacity = new_capacity;
+	memory_limit = (ULONG) REWIND_memory_mb << 20;
+	AllocStateBuffers();
+	return TRUE;
+}
+
+struct REWIND_history_t {
+	rewind_entry *entries;
+	int capacity;
+	int first;
+	int count;
+	int num_keys;
+	int last_key;
+	ULONG memory_used;
+	ULONG memory_limit;
+};
+
+REWIND_history_t *REWIND_Detach(void)
+{
+	REWIND_history_t *h = (REWIND_history_t *) Util_malloc(sizeof(REWIND_history_t));
+	h->entries = entries;
+	h->capacity = capacity;
+	h->first = first;
+	h->count = count;
+	h->num_keys = num_keys;
+	h->last_key = last_key;
+	h->memory_used = memory_used;
+	h->memory_limit = memory_limit;
+	entries = NULL;
+	capacity = 0;
+	first = 0;
+	count = 0;
+	num_keys = 0;
+	last_key = -1;
+	memory_used = 0;
+	return h;
+}
+
+void REWIND_Attach(REWIND_history_t *history)
+{
+	REWIND_Clear();
+	free(entries);
+	entries = history->entries;
+	capacity = history->capacity;
+	first = history->first;
+	count = history->count;
+	num_keys = history->num_keys;
+	last_key = history->last_key;
+	memory_used = history->memory_used;
+	memory_limit = history->memory_limit;
+	free(history);
+	if (capacity > 0)
+		AllocStateBuffers();
+}
+
+int REWIND_Recording(const REWIND_history_t *history)
+{
+	return (history == NULL ? capacity : history->capacity) > 0;
+}
+
+void REWIND_FreeHistory(REWIND_history_t *history)
+{
+	int i;
+	if (history == NULL)
+		return;
+	for (i = 0; i < history->count; i++)
+		free(history->entries[(history->first + i) % history->capacity].data);
+	free(history->entries);
+	free(history);
+}
+
+int REWIND_Initialise(int *argc, char *argv[])
+{
+	int i, j;
+
+	/* libatari800 initialises again for every context */
+	REWIND_seconds = 0;
+	REWIND_memory_mb = 32;
+
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-rewind") == 0) {
+			if (i_a) {
+				REWIND_seconds = Util_sscandec(argv[++i]);
+				if (REWIND_seconds < 0) {
+					Log_print("Invalid rewind length, rewind disabled.");
+					REWIND_seconds = 0;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else if (strcmp(argv[i], "-rewind-memory") == 0) {
+			if (i_a) {
+				REWIND_memory_mb = Util_sscandec(argv[++i]);
+				/* the limit in bytes must fit in a ULONG */
+				if (REWIND_memory_mb <= 0 || REWIND_memory_mb > REWIND_MAX_MEMORY_MB) {
+					Log_print("Invalid rewind memory size, rewind disabled.");
+					REWIND_memory_mb = 32;
+					REWIND_seconds = 0;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-rewind <sec>    Keep the last <sec> seconds of emulation for rewinding");
+				Log_print("\t                 (default 0 = disable)");
+				Log_print("\t-rewind-memory <MB>");
+				Log_print("\t                 Maximum memory used by the rewind history (1-%d)", REWIND_MAX_MEMORY_MB);
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
+	return AllocBuffers();
+}
+
+void REWIND_Exit(void)
+{
+	REWIND_Clear();
+	free(entries);
+	entries = NULL;
+	capacity = 0;
+	free(state_buf);
+	state_buf = NULL;
+	free(delta_buf);
+	delta_buf = NULL;
+}
+
+void REWIND_Frame(void)
+{
+	rewind_entry *e;
+	ULONG size;
+
+	if (capacity == 0)
+		return;
+	size = StateSav_SaveAtariStateToMemory(state_buf);
+	if (size == 0)
+		return;
+
+	if (count == capacity)
+		DropOldestGroup();
+	e = &ENTRY(count);
+	e->nframes = Atari800_nframes;
+	e->state_size = size;
+	e->key = TRUE;
+	if (last_key >= 0 && count - last_key < KEYFRAME_INTERVAL
+	 && ENTRY(last_key).state_size == size) {
+		ULONG delta_size = EncodeDelta(ENTRY(last_key).data, state_buf, size, delta_buf);
+		if (delta_size < size) {
+			e->key = FALSE;
+			e->data = (UBYTE *) Util_malloc(delta_size);
+			memcpy(e->data, delta_buf, delta_size);
+			e->size = delta_size;
+		}
+	}
+	if (e->key) {
+		e->data = (UBYTE *) Util_malloc(size);
+		memcpy(e->data, state_buf, size);
+		e->size = size;
+		last_key = count;
+		num_keys++;
+	}
+	memory_used += e->size;
+	count++;
+
+	/* keep at least the group of the newest keyframe */
+	while (memory_used > memory_limit && num_keys > 1)
+		DropOldestGroup();
+}
+
+int REWIND_Back(int frames)
+{
+	rewind_entry *e;
+	int target;
+	int key;
+
+	if (count == 0 || frames < 0)
+		return 0;
+	if (frames > count - 1)
+		frames = count - 1;
+	target = count - 1 - frames;
+	for (key = target; !ENTRY(key).key; key--);
+	e = &ENTRY(target);
+	memcpy(state_buf, ENTRY(key).data, ENTRY(key).size);
+	if (key != target)
+		DecodeDelta(e->data, e->size, state_buf);
+	if (!StateSav_ReadAtariStateFromMemory(state_buf)) {
+		Log_print("Rewind failed.");
+		REWIND_Clear();
+		return 0;
+	}
+	Atari800_nframes = e->nframes;
+
+	/* the restored state becomes the newest one */
+	while (count > target + 1) {
+		FreeEntry(&ENTRY(count - 1));
+		count--;
+	}
+	last_key = key;
+	return frames;
+}
+
+/*
+vim:ts=4:sw=4:
+*/
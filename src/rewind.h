@@ -0,0 +1,46 @@
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include "config.h"
+#include "atari.h"
+
+/* Length of the rewind history in seconds. 0 turns recording off. */
+extern int REWIND_seconds;
+/* Maximum size of the rewind history in megabytes, at most
+   REWIND_MAX_MEMORY_MB. */
+extern int REWIND_memory_mb;
+#define REWIND_MAX_MEMORY_MB 4095
+
+int REWIND_Initialise(int *argc, char *argv[]);
+void REWIND_Exit(void);
+
+/* Records the state of the machine. Called at the end of every frame. */
+void REWIND_Frame(void);
+
+/* Returns the machine to the state it had FRAMES frames ago, or to the
+   oldest recorded state if the history is shorter. The newer states are
+   discarded. Returns the number of frames actually rewound. */
+int REWIND_Back(int frames);
+
+/* Forgets the recorded history. */
+void REWIND_Clear(void);
+
+/* The recorded history of one machine, with its length and memory limit. */
+typedef struct REWIND_history_t REWIND_history_t;
+
+/* Takes the recorded history away, for keeping it while another machine is
+   running. Recording stops until a history is attached again. */
+REWIND_history_t *REWIND_Detach(void);
+
+/* Replaces the recorded history with HISTORY, taken with REWIND_Detach, and
+   continues recording with its settings. HISTORY is consumed. */
+void REWIND_Attach(REWIND_history_t *history);
+
+/* Frees a detached history. */
+void REWIND_FreeHistory(REWIND_history_t *history);
+
+/* Returns TRUE if HISTORY, or the attached history if HISTORY is NULL,
+   records states. */
+int REWIND_Recording(const REWIND_history_t *history);
+
+#endif /* REWIND_H_ */
@@ -43,6 +43,7 @@
 #endif
 
 ULONG *Screen_atari = NULL;
+UBYTE Screen_dirty_lines[Screen_HEIGHT / 8];
 #ifdef DIRTYRECT
 UBYTE *Screen_dirty = NULL;
 #endif
@@ -150,8 +151,8 @@ int Screen_Initialise(int *argc, char *argv[])
 		memset(Screen_atari, 0, Screen_HEIGHT * Screen_WIDTH);
 #ifdef DIRTYRECT
 		Screen_dirty = (UBYTE *) Util_malloc(Screen_HEIGHT * Screen_WIDTH / 8);
-		Screen_EntireDirty();
 #endif
+		Screen_EntireDirty();
 #ifdef BITPL_SCR
 		Screen_atari_b = (ULONG *) Util_malloc(Screen_HEIGHT * Screen_WIDTH);
 		memset(Screen_atari_b, 0, Screen_HEIGHT * Screen_WIDTH);
@@ -623,6 +624,7 @@ static void SmallFont_DrawChar(UBYTE *screen, int ch, UBYTE color1, UBYTE color2
 		}
 	};
 	int y;
+	Screen_LinesDirty((int) (screen - (UBYTE *) Screen_atari) / Screen_WIDTH, SMALLFONT_HEIGHT);
 	for (y = 0; y < SMALLFONT_HEIGHT; y++) {
 		int src;
 		int mask;
@@ -888,6 +890,7 @@ int Screen_SaveScreenshot(const char *filename, int interlaced)
 	if (interlaced) {
 		Screen_atari = (ULONG *) Util_malloc(Screen_WIDTH * Screen_HEIGHT);
 		ptr2 = (UBYTE *) Screen_atari;
+		ANTIC_InvalidateLines(0, Screen_HEIGHT);
 		ANTIC_Frame(TRUE); /* draw on Screen_atari */
 	}
 	else {
@@ -900,6 +903,8 @@ int Screen_SaveScreenshot(const char *filename, int interlaced)
 	if (interlaced) {
 		free(Screen_atari);
 		Screen_atari = main_screen_atari;
+		/* the lines were last drawn on the freed buffer */
+		Screen_EntireDirty();
 	}
 	return result;
 }
@@ -921,4 +926,19 @@ void Screen_EntireDirty(void)
 	if (Screen_dirty)
 		memset(Screen_dirty, 1, Screen_WIDTH * Screen_HEIGHT / 8);
 #endif /* DIRTYRECT */
+	Screen_LinesDirty(0, Screen_HEIGHT);
+}
+
+void Screen_LinesDirty(int first, int count)
+{
+	int y;
+	if (first < 0) {
+		count += first;
+		first = 0;
+	}
+	if (first + count > Screen_HEIGHT)
+		count = Screen_HEIGHT - first;
+	for (y = first; y < first + count; y++)
+		Screen_dirty_lines[y >> 3] |= 1 << (y & 7);
+	ANTIC_InvalidateLines(first, count);
 }
@@ -21,6 +21,12 @@ extern ULONG *Screen_atari;
 #define Screen_WIDTH  384
 #define Screen_HEIGHT 240
 
+/* One bit for each line of Screen_atari (bit y & 7 of byte y >> 3), set when
+   the line changes. The bits are never cleared by the emulator: the display
+   code clears them after copying the changed lines. */
+extern UBYTE Screen_dirty_lines[Screen_HEIGHT / 8];
+#define Screen_LINE_DIRTY(y) (Screen_dirty_lines[(y) >> 3] & (1 << ((y) & 7)))
+
 #ifdef BITPL_SCR
 extern ULONG *Screen_atari_b;
 extern ULONG *Screen_atari1;
@@ -56,6 +62,9 @@ void Screen_FindScreenshotFilename(char *buffer, unsigned bufsize);
 int Screen_SaveScreenshot(const char *filename, int interlaced);
 void Screen_SaveNextScreenshot(int interlaced);
 void Screen_EntireDirty(void);
+/* Marks lines FIRST..FIRST+COUNT-1 of Screen_atari as changed by something
+   other than the emulated display. */
+void Screen_LinesDirty(int first, int count);
 void Screen_SetStatusText(const char* text, int duration);
 void Screen_DrawStatusText(void);
 
@@ -110,6 +110,9 @@ static int KBD_MON = SDLK_F8;
 static int KBD_EXIT = SDLK_F9;
 static int KBD_SSHOT = SDLK_F10;
 static int KBD_TURBO = SDLK_F12;
+#ifdef REWIND
+static int KBD_REWIND = SDLK_F11;
+#endif
 
 /* Each emulated joystick can take its input from host keyboard, an
    LPT joystick, an actual SDL joystick, or a combination thereof. */
@@ -474,6 +477,10 @@ int SDL_INPUT_ReadConfig(char *option, char *parameters)
 		return SDLKeyBind(&KBD_SSHOT, parameters);
 	else if (strcmp(option, KEY_SDL"TURBO_KEY") == 0)
 		return SDLKeyBind(&KBD_TURBO, parameters);
+#ifdef REWIND
+	else if (strcmp(option, KEY_SDL"REWIND_KEY") == 0)
+		return SDLKeyBind(&KBD_REWIND, parameters);
+#endif
 	else
 		return FALSE;
 }
@@ -508,6 +515,9 @@ void SDL_INPUT_WriteConfig(FILE *fp)
 	fprintf(fp, KEY_SDL"EXIT_KEY=%d\n", KBD_EXIT);
 	fprintf(fp, KEY_SDL"SSHOT_KEY=%d\n", KBD_SSHOT);
 	fprintf(fp, KEY_SDL"TURBO_KEY=%d\n", KBD_TURBO);
+#ifdef REWIND
+	fprintf(fp, KEY_SDL"REWIND_KEY=%d\n", KBD_REWIND);
+#endif
 
 	write_real_js_configs(fp);
 }
@@ -1144,6 +1154,12 @@ int PLATFORM_Keyboard(void)
 		key_pressed = 0;
 		return AKEY_TURBO;
 	}
+#ifdef REWIND
+	if (lastkey == KBD_REWIND && !UI_is_active) {
+		/* repeats while the key is held */
+		return AKEY_REWIND;
+	}
+#endif
 	if (UI_alt_function != -1) {
 		key_pressed = 0;
 		return AKEY_UI;
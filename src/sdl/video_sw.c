@@ -55,6 +55,11 @@
 
 static int fullscreen = 1;
 
+/* TRUE when SDL_VIDEO_screen holds the previous frame, so only the lines
+   flagged in Screen_dirty_lines have to be copied to it. */
+static int screen_valid = FALSE;
+#define SRC_LINE_CHANGED(y) (!screen_valid || Screen_LINE_DIRTY(VIDEOMODE_src_offset_top + (y)))
+
 int SDL_VIDEO_SW_bpp = 0;
 
 static void DisplayWithoutScaling(void);
@@ -167,6 +172,7 @@ static void UpdatePaletteLookup(VIDEOMODE_MODE_t mode)
 void SDL_VIDEO_SW_PaletteUpdate(void)
 {
 	UpdatePaletteLookup(SDL_VIDEO_current_display_mode);
+	screen_valid = FALSE;
 }
 
 static void ModeInfo(void)
@@ -317,6 +323,7 @@ void SDL_VIDEO_SW_SetVideoMode(VIDEOMODE_resolution_t const *res, int windowed,
 		SDL_FillRect(SDL_VIDEO_screen, NULL, 0);
 #endif /* SDL2 */
 	SDL_ShowCursor(SDL_DISABLE);	/* hide mouse cursor */
+	screen_valid = FALSE;
 
 	if (mode == VIDEOMODE_MODE_NORMAL) {
 		if (rotate90)
@@ -742,20 +749,32 @@ static void DisplayWithoutScaling(void)
 	int pitch4 = SDL_VIDEO_screen->pitch / 4;
 	UBYTE *screen = (UBYTE *)Screen_atari + Screen_WIDTH * VIDEOMODE_src_offset_top + VIDEOMODE_src_offset_left;
 	Uint8 *pixels = (Uint8 *) SDL_VIDEO_screen->pixels + SDL_VIDEO_screen->pitch * VIDEOMODE_dest_offset_top;
-	switch (SDL_VIDEO_screen->format->BitsPerPixel) {
-	/* Possible values are 8, 16 and 32, as checked earlier in the
+	int bpp = SDL_VIDEO_screen->format->BitsPerPixel;
+	int y = 0;
+	/* Possible values of bpp are 8, 16 and 32, as checked earlier in the
 	 * PLATFORM_SetVideoMode() function. */
-	case 8:
-		pixels += VIDEOMODE_dest_offset_left;
-		SDL_VIDEO_BlitNormal8((Uint32 *)pixels, screen, pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height);
-		break;
-	case 16:
-		pixels += VIDEOMODE_dest_offset_left * 2;
-		SDL_VIDEO_BlitNormal16((Uint32*)pixels, screen, pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, SDL_PALETTE_buffer.bpp16);
-		break;
-	default: /* SDL_VIDEO_screen->format->BitsPerPixel == 32 */
-		pixels += VIDEOMODE_dest_offset_left * 4;
-		SDL_VIDEO_BlitNormal32((Uint32 *)pixels, screen, pitch4, VIDEOMODE_src_width, VIDEOMODE_src_height, SDL_PALETTE_buffer.bpp32);
+	pixels += VIDEOMODE_dest_offset_left * (bpp / 8);
+	/* copy each run of changed lines */
+	while (y < VIDEOMODE_src_height) {
+		int height;
+		Uint32 *dest;
+		if (!SRC_LINE_CHANGED(y)) {
+			y++;
+			continue;
+		}
+		for (height = 1; y + height < VIDEOMODE_src_height && SRC_LINE_CHANGED(y + height); height++);
+		dest = (Uint32 *) (pixels + SDL_VIDEO_screen->pitch * y);
+		switch (bpp) {
+		case 8:
+			SDL_VIDEO_BlitNormal8(dest, screen + Screen_WIDTH * y, pitch4, VIDEOMODE_src_width, height);
+			break;
+		case 16:
+			SDL_VIDEO_BlitNormal16(dest, screen + Screen_WIDTH * y, pitch4, VIDEOMODE_src_width, height, SDL_PALETTE_buffer.bpp16);
+			break;
+		default:
+			SDL_VIDEO_BlitNormal32(dest, screen + Screen_WIDTH * y, pitch4, VIDEOMODE_src_width, height, SDL_PALETTE_buffer.bpp32);
+		}
+		y += height;
 	}
 }
 
@@ -790,6 +809,12 @@ static void DisplayWithScaling(void)
 		while (i > 0) {
 			x = init_x;
 			pos = w1;
+			if (!SRC_LINE_CHANGED(y >> 16)) {
+				pixels += pitch4;
+				y += dy;
+				i--;
+				continue;
+			}
 			yy = Screen_WIDTH * (y >> 16);
 			while (pos >= 0) {
 #if SDL_BYTEORDER == SDL_BIG_ENDIAN
@@ -827,6 +852,12 @@ static void DisplayWithScaling(void)
 		while (i > 0) {
 			x = init_x;
 			pos = w1;
+			if (!SRC_LINE_CHANGED(y >> 16)) {
+				pixels += pitch4;
+				y += dy;
+				i--;
+				continue;
+			}
 			yy = Screen_WIDTH * (y >> 16);
 			while (pos >= 0) {
 #if SDL_BYTEORDER == SDL_BIG_ENDIAN
@@ -860,6 +891,12 @@ static void DisplayWithScaling(void)
 		while (i > 0) {
 			x = init_x;
 			pos = w1;
+			if (!SRC_LINE_CHANGED(y >> 16)) {
+				pixels += pitch4;
+				y += dy;
+				i--;
+				continue;
+			}
 			yy = Screen_WIDTH * (y >> 16);
 			while (pos >= 0) {
 				c = screen[yy + (x >> 16)];
@@ -920,6 +957,8 @@ void SDL_VIDEO_SW_DisplayScreen(void)
 		return;
 	}
 	(*blit_funcs[SDL_VIDEO_current_display_mode])();
+	memset(Screen_dirty_lines, 0, sizeof(Screen_dirty_lines));
+	screen_valid = TRUE;
 	SDL_UpdateTexture(SDL_VIDEO_texture, NULL, SDL_VIDEO_screen->pixels, SDL_VIDEO_screen->pitch);
 	SDL_RenderClear(SDL_VIDEO_renderer);
 	SDL_RenderCopy(SDL_VIDEO_renderer, SDL_VIDEO_texture, NULL, NULL);
@@ -936,6 +975,9 @@ void SDL_VIDEO_SW_DisplayScreen(void)
 		   return;
 	/* Use function corresponding to the current_display_mode. */
 	(*blit_funcs[SDL_VIDEO_current_display_mode])();
+	memset(Screen_dirty_lines, 0, sizeof(Screen_dirty_lines));
+	/* with double buffering the next frame is drawn over an older one */
+	screen_valid = !(SDL_VIDEO_screen->flags & SDL_DOUBLEBUF);
 	SDL_UnlockSurface(SDL_VIDEO_screen);
 	/* SDL_UpdateRect is faster than SDL_Flip for a software surface, because
 	   it copies only the used part of the screen. */
@@ -38,6 +38,7 @@
 #include "compfile.h"
 #include "cpu.h"
 #include "esc.h"
+#include "imgcache.h"
 #include "log.h"
 #include "memory.h"
 #include "platform.h"
@@ -74,7 +75,22 @@ static int image_type[SIO_MAX_DRIVES];
 #define IMAGE_TYPE_ATR  1
 #define IMAGE_TYPE_PRO  2
 #define IMAGE_TYPE_VAPI 3
+/* A mounted image is loaded into memory as a whole, and sectors are read
+   from there. Writes go to the memory copy and mark the DIRTY_BLOCK-byte
+   blocks of the image they touch; the marked blocks are written back to the
+   file when the disk is dismounted, when no writes have happened for
+   SIO_writeback_delay seconds, or on SIO_FlushDisks(). disk[] is the file
+   to write back to, and is NULL for read-only images. The data of an image
+   comes from the image cache and is shared with other mounts of the same
+   file until it is first written to. */
+#define DIRTY_BLOCK 128
 static FILE *disk[SIO_MAX_DRIVES] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+static UBYTE *image[SIO_MAX_DRIVES];
+static ULONG image_length[SIO_MAX_DRIVES];
+static ULONG image_pos[SIO_MAX_DRIVES]; /* position of next ImageRead/ImageWrite */
+static UBYTE *dirty[SIO_MAX_DRIVES];
+static int dirty_frames[SIO_MAX_DRIVES]; /* frames since the last write, -1 if clean */
+int SIO_writeback_delay = 1;
 static int sectorcount[SIO_MAX_DRIVES];
 static int sectorsize[SIO_MAX_DRIVES];
 /* these two are used by the 1450XLD parallel disk device */
@@ -186,7 +202,7 @@ int ignore_header_writeprotect = FALSE;
 
 int SIO_Initialise(int *argc, char *argv[])
 {
-	int i;
+	int i, j;
 	for (i = 0; i < SIO_MAX_DRIVES; i++) {
 		strcpy(SIO_filename[i], "Off");
 		SIO_drive_status[i] = SIO_OFF;
@@ -195,6 +211,36 @@ int SIO_Initialise(int *argc, char *argv[])
 	}
 	TransferStatus = SIO_NoFrame;
 
+	for (i = j = 1; i < *argc; i++) {
+		int i_a = (i + 1 < *argc);		/* is argument available? */
+		int a_m = FALSE;			/* error, argument missing! */
+
+		if (strcmp(argv[i], "-disk-writeback") == 0) {
+			if (i_a) {
+				SIO_writeback_delay = Util_sscandec(argv[++i]);
+				if (SIO_writeback_delay < 0) {
+					Log_print("Invalid disk write-back delay, using 0.");
+					SIO_writeback_delay = 0;
+				}
+			}
+			else a_m = TRUE;
+		}
+		else {
+			if (strcmp(argv[i], "-help") == 0) {
+				Log_print("\t-disk-writeback <sec>");
+				Log_print("\t                 Write changes back to disk images after <sec> seconds");
+				Log_print("\t                 without disk writes (0 = only when the disk is removed)");
+			}
+			argv[j++] = argv[i];
+		}
+
+		if (a_m) {
+			Log_print("Missing argument for '%s'", argv[i]);
+			return FALSE;
+		}
+	}
+	*argc = j;
+
 	return TRUE;
 }
 
@@ -204,6 +250,224 @@ void SIO_Exit(void)
 	int i;
 	for (i = 1; i <= SIO_MAX_DRIVES; i++)
 		SIO_Dismount(i);
+	/* the cartridges have been removed by now, so this frees the images
+	   kept for mounting again */
+	IMGCACHE_Clear();
+}
+
+static void FreeAdditionalInfo(int unit)
+{
+	if (additional_info[unit] == NULL)
+		return;
+	if (image_type[unit] == IMAGE_TYPE_PRO) {
+		free(((pro_additional_info_t *)additional_info[unit])->count);
+	}
+	else if (image_type[unit] == IMAGE_TYPE_VAPI) {
+		free(((vapi_additional_info_t *)additional_info[unit])->sectors);
+	}
+	free(additional_info[unit]);
+	additional_info[unit] = NULL;
+}
+
+/* Reads the whole file F into a new buffer, and stores its length at
+   *length. */
+static UBYTE *ReadFile(FILE *f, ULONG *length)
+{
+	int file_length = Util_flen(f);
+	UBYTE *data;
+
+	if (file_length < 0)
+		return NULL;
+	data = (UBYTE *) Util_malloc(file_length > 0 ? file_length : 1);
+	Util_rewind(f);
+	if (fread(data, 1, file_length, f) != (size_t) file_length) {
+		free(data);
+		return NULL;
+	}
+	*length = file_length;
+	return data;
+}
+
+/* Reads the image in F, opened from FILENAME. DCM and gzipped images are
+   decompressed. The image is looked up in the image cache by the contents of
+   F, so an image that has been loaded before is shared instead of
+   decompressed again. Stores at *compressed whether F is a compressed
+   image. */
+static UBYTE *ReadImage(int unit, FILE *f, const char *filename, ULONG *length, int *compressed)
+{
+	ULONG file_length;
+	UBYTE *file = ReadFile(f, &file_length);
+	UBYTE *data;
+	int magic;
+
+	if (file == NULL)
+		return NULL;
+	magic = file_length >= 2 ? file[0] : 0;
+	if (magic == 0x1f && file[1] != 0x8b)
+		magic = 0;
+	*compressed = magic == 0xf9 || magic == 0xfa || magic == 0x1f;
+	data = IMGCACHE_Find(file, file_length, length);
+	if (data != NULL) {
+		free(file);
+		return data;
+	}
+	if (*compressed) {
+		FILE *f2 = Util_tmpopen(sio_tmpbuf[unit]);
+		int ok;
+		if (f2 == NULL) {
+			free(file);
+			return NULL;
+		}
+		if (magic == 0x1f)
+			ok = CompFile_ExtractGZ(filename, f2);
+		else {
+			Util_rewind(f);
+			ok = CompFile_DCMtoATR(f, f2);
+		}
+		data = ok ? ReadFile(f2, length) : NULL;
+		Util_fclose(f2, sio_tmpbuf[unit]);
+		if (data == NULL) {
+			free(file);
+			return NULL;
+		}
+	}
+	else {
+		data = file;
+		*length = file_length;
+	}
+	IMGCACHE_Add(file, file_length, data, *length);
+	return data;
+}
+
+/* Puts the image in F, opened from FILENAME, into memory. SIO_StateRead
+   mounts the disks again every time a state is loaded, so an image whose
+   file hasn't changed since it was loaded is taken from the image cache
+   without reading F. Stores at *compressed whether F is a compressed
+   image. */
+static int LoadImage(int unit, FILE *f, const char *filename, int *compressed)
+{
+	ULONG length;
+
+	image[unit] = IMGCACHE_FindFile(filename, &length, compressed);
+	if (image[unit] == NULL) {
+		image[unit] = ReadImage(unit, f, filename, &length, compressed);
+		if (image[unit] == NULL)
+			return FALSE;
+		IMGCACHE_SetFile(image[unit], filename);
+	}
+	image_length[unit] = length;
+	image_pos[unit] = 0;
+	dirty[unit] = (UBYTE *) Util_malloc(length / DIRTY_BLOCK + 1);
+	memset(dirty[unit], 0, length / DIRTY_BLOCK + 1);
+	dirty_frames[unit] = -1;
+	return TRUE;
+}
+
+static void FreeImage(int unit)
+{
+	IMGCACHE_Release(image[unit]);
+	image[unit] = NULL;
+	free(dirty[unit]);
+	dirty[unit] = NULL;
+}
+
+/* Releases what SIO_Mount has set up for UNIT, and returns FALSE. */
+static int MountFailed(int unit, FILE *f)
+{
+	if (f != NULL)
+		Util_fclose(f, sio_tmpbuf[unit]);
+	FreeImage(unit);
+	FreeAdditionalInfo(unit);
+	return FALSE;
+}
+
+static ULONG ImageRead(int unit, UBYTE *buffer, ULONG size)
+{
+	ULONG pos = image_pos[unit];
+	if (pos >= image_length[unit])
+		size = 0;
+	else if (size > image_length[unit] - pos)
+		size = image_length[unit] - pos;
+	memcpy(buffer, image[unit] + pos, size);
+	image_pos[unit] = pos + size;
+	return size;
+}
+
+static void ImageWrite(int unit, const UBYTE *buffer, ULONG size)
+{
+	ULONG pos = image_pos[unit];
+	ULONG block;
+	if (IMGCACHE_IsCached(image[unit])) {
+		/* the first write gets this drive its own copy of the image */
+		UBYTE *copy = (UBYTE *) Util_malloc(image_length[unit] > 0 ? image_length[unit] : 1);
+		memcpy(copy, image[unit], image_length[unit]);
+		IMGCACHE_Release(image[unit]);
+		image[unit] = copy;
+	}
+	if (pos + size > image_length[unit]) {
+		/* writing past the end of a short image extends it, as a write
+		   to the file would */
+		image[unit] = (UBYTE *) Util_realloc(image[unit], pos + size);
+		memset(image[unit] + image_length[unit], 0, pos + size - image_length[unit]);
+		dirty[unit] = (UBYTE *) Util_realloc(dirty[unit], (pos + size) / DIRTY_BLOCK + 1);
+		memset(dirty[unit] + image_length[unit] / DIRTY_BLOCK + 1, 0,
+		       (pos + size) / DIRTY_BLOCK - image_length[unit] / DIRTY_BLOCK);
+		image_length[unit] = pos + size;
+	}
+	memcpy(image[unit] + pos, buffer, size);
+	image_pos[unit] = pos + size;
+	for (block = pos / DIRTY_BLOCK; block * DIRTY_BLOCK < pos + size; block++)
+		dirty[unit][block] = TRUE;
+	dirty_frames[unit] = 0;
+}
+
+/* Writes the changed blocks of the image back to the file. */
+static void FlushImage(int unit)
+{
+	ULONG block;
+	ULONG nblocks;
+
+	if (dirty_frames[unit] < 0 || disk[unit] == NULL)
+		return;
+	IMGCACHE_ForgetFile(SIO_filename[unit]);
+	nblocks = (image_length[unit] + DIRTY_BLOCK - 1) / DIRTY_BLOCK;
+	for (block = 0; block < nblocks; block++) {
+		ULONG start;
+		ULONG end;
+		if (!dirty[unit][block])
+			continue;
+		start = block * DIRTY_BLOCK;
+		while (block < nblocks && dirty[unit][block])
+			dirty[unit][block++] = FALSE;
+		end = block * DIRTY_BLOCK;
+		if (end > image_length[unit])
+			end = image_length[unit];
+		if (fseek(disk[unit], start, SEEK_SET) != 0
+		 || fwrite(image[unit] + start, 1, end - start, disk[unit]) != end - start)
+			Log_print("Error writing to disk image %s", SIO_filename[unit]);
+	}
+	fflush(disk[unit]);
+	dirty_frames[unit] = -1;
+}
+
+void SIO_FlushDisks(void)
+{
+	int i;
+	for (i = 0; i < SIO_MAX_DRIVES; i++)
+		if (image[i] != NULL)
+			FlushImage(i);
+}
+
+void SIO_Frame(void)
+{
+	int i;
+	if (SIO_writeback_delay <= 0)
+		return;
+	for (i = 0; i < SIO_MAX_DRIVES; i++) {
+		if (dirty_frames[i] >= 0 && image[i] != NULL
+		 && ++dirty_frames[i] >= SIO_writeback_delay * (Atari800_tv_mode == Atari800_TV_PAL ? 50 : 60))
+			FlushImage(i);
+	}
 }
 
 int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
@@ -211,6 +475,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 	FILE *f = NULL;
 	SIO_UnitStatus status = SIO_READ_WRITE;
 	struct AFILE_ATR_Header header;
+	int compressed;
 
 	/* avoid overruns in SIO_filename[] */
 	if (strlen(filename) >= FILENAME_MAX)
@@ -229,62 +494,19 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		status = SIO_READ_ONLY;
 	}
 
-	/* read header */
-	if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
+	if (!LoadImage(diskno - 1, f, filename, &compressed)) {
 		fclose(f);
 		return FALSE;
 	}
-
-	/* detect compressed image and uncompress */
-	switch (header.magic1) {
-	case 0xf9:
-	case 0xfa:
-		/* DCM */
-		{
-			FILE *f2 = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f2 == NULL)
-				return FALSE;
-			Util_rewind(f);
-			if (!CompFile_DCMtoATR(f, f2)) {
-				Util_fclose(f2, sio_tmpbuf[diskno - 1]);
-				fclose(f);
-				return FALSE;
-			}
-			fclose(f);
-			f = f2;
-		}
-		Util_rewind(f);
-		if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
-			return FALSE;
-		}
+	if (compressed) {
 		status = SIO_READ_ONLY;
 		/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
-		break;
-	case 0x1f:
-		if (header.magic2 == 0x8b) {
-			/* ATZ/ATR.GZ, XFZ/XFD.GZ */
-			fclose(f);
-			f = Util_tmpopen(sio_tmpbuf[diskno - 1]);
-			if (f == NULL)
-				return FALSE;
-			if (!CompFile_ExtractGZ(filename, f)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
-				return FALSE;
-			}
-			Util_rewind(f);
-			if (fread(&header, 1, sizeof(struct AFILE_ATR_Header), f) != sizeof(struct AFILE_ATR_Header)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
-				return FALSE;
-			}
-			status = SIO_READ_ONLY;
-			/* XXX: status = b_open_readonly ? SIO_READ_ONLY : SIO_READ_WRITE; */
-		}
-		break;
-	default:
-		break;
 	}
 
+	/* read header */
+	if (ImageRead(diskno - 1, (UBYTE *) &header, sizeof(struct AFILE_ATR_Header)) != sizeof(struct AFILE_ATR_Header))
+		return MountFailed(diskno - 1, f);
+
 	boot_sectors_type[diskno - 1] = BOOT_SECTORS_LOGICAL;
 
 	if (header.magic1 == AFILE_ATR_MAGIC1 && header.magic2 == AFILE_ATR_MAGIC2) {
@@ -292,10 +514,8 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		image_type[diskno - 1] = IMAGE_TYPE_ATR;
 
 		sectorsize[diskno - 1] = (header.secsizehi << 8) + header.secsizelo;
-		if (sectorsize[diskno - 1] != 128 && sectorsize[diskno - 1] != 256) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
-			return FALSE;
-		}
+		if (sectorsize[diskno - 1] != 128 && sectorsize[diskno - 1] != 256)
+			return MountFailed(diskno - 1, f);
 
 		if (header.writeprotect != 0 && !ignore_header_writeprotect)
 			status = SIO_READ_ONLY;
@@ -319,11 +539,9 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 				   a non-zero byte in bytes 0x190-0x30f of the ATR file */
 				UBYTE buffer[0x180];
 				int i;
-				fseek(f, 0x190, SEEK_SET);
-				if (fread(buffer, 1, 0x180, f) != 0x180) {
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
-					return FALSE;
-				}
+				image_pos[diskno - 1] = 0x190;
+				if (ImageRead(diskno - 1, buffer, 0x180) != 0x180)
+					return MountFailed(diskno - 1, f);
 				boot_sectors_type[diskno - 1] = BOOT_SECTORS_SIO2PC;
 				for (i = 0; i < 0x180; i++)
 					if (buffer[i] != 0) {
@@ -336,7 +554,7 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 	}
 	else if (header.magic1 == 'A' && header.magic2 == 'T' && header.seccountlo == '8' &&
 		 header.seccounthi == 'X') {
-		int file_length = Util_flen(f);
+		int file_length = (int) image_length[diskno - 1];
 		vapi_additional_info_t *info;
 		vapi_file_header_t fileheader;
 		vapi_track_header_t trackheader;
@@ -344,29 +562,21 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 
 		/* .atx is read only for now */
 #ifndef VAPI_WRITE_ENABLE
-		if (!b_open_readonly) {
-			fclose(f);
-			f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-			if (f == NULL)
-				return FALSE;
-			status = SIO_READ_ONLY;
-		}
+		status = SIO_READ_ONLY;
 #endif
 		
 		image_type[diskno - 1] = IMAGE_TYPE_VAPI;
 		sectorsize[diskno - 1] = 128;
 		sectorcount[diskno - 1] = 720;
-		fseek(f,0,SEEK_SET);
-		if (fread(&fileheader,1,sizeof(fileheader),f) != sizeof(fileheader)) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
+		image_pos[diskno - 1] = 0;
+		if (ImageRead(diskno - 1, (UBYTE *) &fileheader, sizeof(fileheader)) != sizeof(fileheader)) {
 			Log_print("VAPI: Bad File Header");
-			return(FALSE);
+			return MountFailed(diskno - 1, f);
 			}
 		trackoffset = VAPI_32(fileheader.startdata);	
 		if (trackoffset > file_length) {
-			Util_fclose(f, sio_tmpbuf[diskno - 1]);
 			Log_print("VAPI: Bad Track Offset");
-			return(FALSE);
+			return MountFailed(diskno - 1, f);
 			}
 #ifdef DEBUG_VAPI
 		Log_print("VAPI File Version %d.%d",fileheader.majorver,fileheader.minorver);
@@ -377,11 +587,10 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			ULONG next;
 			UWORD tracktype;
 
-			fseek(f,trackoffset,SEEK_SET);
-			if (fread(&trackheader,1,sizeof(trackheader),f) != sizeof(trackheader)) {
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
+			image_pos[diskno - 1] = trackoffset;
+			if (ImageRead(diskno - 1, (UBYTE *) &trackheader, sizeof(trackheader)) != sizeof(trackheader)) {
 				Log_print("VAPI: Bad Track Header");
-				return(FALSE);
+				return MountFailed(diskno - 1, f);
 				}
 			next = VAPI_32(trackheader.next);
 			tracktype = VAPI_16(trackheader.type);
@@ -408,13 +617,10 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 			UWORD tracktype;
 			int j;
 
-			fseek(f,trackoffset,SEEK_SET);
-			if (fread(&trackheader,1,sizeof(trackheader),f) != sizeof(trackheader)) {
-				free(info->sectors);
-				free(info);
-				Util_fclose(f, sio_tmpbuf[diskno - 1]);
+			image_pos[diskno - 1] = trackoffset;
+			if (ImageRead(diskno - 1, (UBYTE *) &trackheader, sizeof(trackheader)) != sizeof(trackheader)) {
 				Log_print("VAPI: Bad Track Header while reading sectors");
-				return(FALSE);
+				return MountFailed(diskno - 1, f);
 				}
 			next = VAPI_32(trackheader.next);
 			sectorcnt = VAPI_16(trackheader.sectorcnt);
@@ -426,19 +632,13 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 #endif
 			if (tracktype == 0) {
 				if (seclistdata > file_length) {
-					free(info->sectors);
-					free(info);
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
 					Log_print("VAPI: Bad Sector List Offset");
-					return(FALSE);
+					return MountFailed(diskno - 1, f);
 					}
-				fseek(f,seclistdata,SEEK_SET);
-				if (fread(&sectorlist,1,sizeof(sectorlist),f) != sizeof(sectorlist)) {
-					free(info->sectors);
-					free(info);
-					Util_fclose(f, sio_tmpbuf[diskno - 1]);
+				image_pos[diskno - 1] = seclistdata;
+				if (ImageRead(diskno - 1, (UBYTE *) &sectorlist, sizeof(sectorlist)) != sizeof(sectorlist)) {
 					Log_print("VAPI: Bad Sector List");
-					return(FALSE);
+					return MountFailed(diskno - 1, f);
 					}
 #ifdef DEBUG_VAPI
 				Log_print("Size sec list %x type %d",VAPI_32(sectorlist.sizelist),sectorlist.type);
@@ -446,18 +646,14 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 				for (j=0;j<sectorcnt;j++) {
 					double percent_rot;
 
-					if (fread(&sectorheader,1,sizeof(sectorheader),f) != sizeof(sectorheader)) {
-						free(info->sectors);
-						free(info);
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
+					if (ImageRead(diskno - 1, (UBYTE *) &sectorheader, sizeof(sectorheader)) != sizeof(sectorheader)) {
 						Log_print("VAPI: Bad Sector Header");
-						return(FALSE);
+						return MountFailed(diskno - 1, f);
 						}
 					if (sectorheader.sectornum > 18)  {
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
 						Log_print("VAPI: Bad Sector Index: Track %d Sec Num %d Index %d",
 								trackheader.tracknum,j,sectorheader.sectornum);
-						return(FALSE);
+						return MountFailed(diskno - 1, f);
 						}
 					sector = &info->sectors[trackheader.tracknum * 18 + sectorheader.sectornum - 1];
 
@@ -467,11 +663,8 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 					sector->sec_status[sector->sec_count] = ~sectorheader.sectorstatus;
 					sector->sec_count++;
 					if (sector->sec_count > MAX_VAPI_PHANTOM_SEC) {
-						free(info->sectors);
-						free(info);
-						Util_fclose(f, sio_tmpbuf[diskno - 1]);
 						Log_print("VAPI: Too many Phantom Sectors");
-						return(FALSE);
+						return MountFailed(diskno - 1, f);
 						}
 #ifdef DEBUG_VAPI
 					Log_print("Sector %d status %x position %f %d %d data %x",sectorheader.sectornum,
@@ -491,20 +684,14 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 		}			
 	}
 	else {
-		int file_length = Util_flen(f);
+		int file_length = (int) image_length[diskno - 1];
 		/* check for PRO */
 		if ((file_length-16)%(128+12) == 0 &&
 				(header.magic1*256 + header.magic2 == (file_length-16)/(128+12)) &&
 				header.seccountlo == 'P') {
 			pro_additional_info_t *info;
 			/* .pro is read only for now */
-			if (!b_open_readonly) {
-				fclose(f);
-				f = Util_fopen(filename, "rb", sio_tmpbuf[diskno - 1]);
-				if (f == NULL)
-					return FALSE;
-				status = SIO_READ_ONLY;
-			}
+			status = SIO_READ_ONLY;
 			image_type[diskno - 1] = IMAGE_TYPE_PRO;
 			sectorsize[diskno - 1] = 128;
 			if (file_length >= 1040*(128+12)+16) {
@@ -549,6 +736,11 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 	Log_print("sectorcount = %d, sectorsize = %d",
 		   sectorcount[diskno - 1], sectorsize[diskno - 1]);
 #endif
+	/* the file of a read-only image is not needed any more */
+	if (status == SIO_READ_ONLY) {
+		fclose(f);
+		f = NULL;
+	}
 	SIO_format_sectorsize[diskno - 1] = sectorsize[diskno - 1];
 	SIO_format_sectorcount[diskno - 1] = sectorcount[diskno - 1];
 	strcpy(SIO_filename[diskno - 1], filename);
@@ -559,19 +751,16 @@ int SIO_Mount(int diskno, const char *filename, int b_open_readonly)
 
 void SIO_Dismount(int diskno)
 {
-	if (disk[diskno - 1] != NULL) {
-		Util_fclose(disk[diskno - 1], sio_tmpbuf[diskno - 1]);
-		disk[diskno - 1] = NULL;
+	if (image[diskno - 1] != NULL) {
+		if (disk[diskno - 1] != NULL) {
+			FlushImage(diskno - 1);
+			Util_fclose(disk[diskno - 1], sio_tmpbuf[diskno - 1]);
+			disk[diskno - 1] = NULL;
+		}
+		FreeImage(diskno - 1);
 		SIO_drive_status[diskno - 1] = SIO_NO_DISK;
 		strcpy(SIO_filename[diskno - 1], "Empty");
-		if (image_type[diskno - 1] == IMAGE_TYPE_PRO) {
-			free(((pro_additional_info_t *)additional_info[diskno-1])->count);
-		}
-		else if (image_type[diskno - 1] == IMAGE_TYPE_VAPI) {
-			free(((vapi_additional_info_t *)additional_info[diskno-1])->sectors);
-		}
-		free(additional_info[diskno - 1]);
-		additional_info[diskno - 1] = 0;
+		FreeAdditionalInfo(diskno - 1);
 	}
 }
 
@@ -643,7 +832,7 @@ static int SeekSector(int unit, int sector)
 	SIO_last_sector = sector;
 	snprintf(SIO_status, sizeof(SIO_status), "%d: %d", unit + 1, sector);
 	SIO_SizeOfSector((UBYTE) unit, sector, &size, &offset);
-	fseek(disk[unit], offset, SEEK_SET);
+	image_pos[unit] = offset;
 
 	return size;
 }
@@ -658,7 +847,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (image[unit] == NULL)
 		return 'N';
 	if (sector <= 0 || sector > sectorcount[unit])
 		return 'E';
@@ -672,7 +861,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		unsigned char *count;
 		info = (pro_additional_info_t *)additional_info[unit];
 		count = info->count;
-		if (fread(buffer, 1, 12, disk[unit]) < 12) {
+		if (ImageRead(unit, buffer, 12) < 12) {
 			Log_print("Error in header of .pro image: sector:%d", sector);
 			return 'E';
 		}
@@ -692,7 +881,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 				}
 				size = SeekSector(unit, sector);
 				/* read sector header */
-				if (fread(buffer, 1, 12, disk[unit]) < 12) {
+				if (ImageRead(unit, buffer, 12) < 12) {
 					Log_print("Error in header2 of .pro image: sector:%d dupnum:%d", sector, dupnum);
 					return 'E';
 				}
@@ -700,7 +889,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		}
 		/* bad sector */
 		if (buffer[1] != 0xff) {
-			if (fread(buffer, 1, size, disk[unit]) < size) {
+			if (ImageRead(unit, buffer, size) < size) {
 				Log_print("Error in bad sector of .pro image: sector:%d", sector);
 			}
 			io_success[unit] = sector;
@@ -792,13 +981,13 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		if (secinfo->sec_count > 1)
 			Log_print("duplicate sector:%d dupnum:%d delay:%d",sector, secindex,info->vapi_delay_time);
 #endif
-		fseek(disk[unit],secinfo->sec_offset[secindex],SEEK_SET);
+		image_pos[unit] = secinfo->sec_offset[secindex];
 		info->sec_stat_buff[0] = 0x8 | ((secinfo->sec_status[secindex] == 0xFF) ? 0 : 0x04);
 		info->sec_stat_buff[1] = secinfo->sec_status[secindex];
 		info->sec_stat_buff[2] = 0xe0;
 		info->sec_stat_buff[3] = 0;
 		if (secinfo->sec_status[secindex] != 0xFF) {
-			if (fread(buffer, 1, size, disk[unit]) < size) {
+			if (ImageRead(unit, buffer, size) < size) {
 				Log_print("error reading sector:%d", sector);
 			}
 			io_success[unit] = sector;
@@ -822,7 +1011,7 @@ int SIO_ReadSector(int unit, int sector, UBYTE *buffer)
 		Log_flushlog();
 #endif		
 	}
-	if (fread(buffer, 1, size, disk[unit]) < size) {
+	if (ImageRead(unit, buffer, size) < size) {
 		Log_print("incomplete sector num:%d", sector);
 	}
 	io_success[unit] = 0;
@@ -835,7 +1024,7 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (image[unit] == NULL)
 		return 'N';
 	if (SIO_drive_status[unit] != SIO_READ_WRITE || sector <= 0 || sector > sectorcount[unit])
 		return 'E';
@@ -861,8 +1050,8 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 		}
 		
 		size = SeekSector(unit, sector);
-		fseek(disk[unit],secinfo->sec_offset[0],SEEK_SET);
-		fwrite(buffer, 1, size, disk[unit]);
+		image_pos[unit] = secinfo->sec_offset[0];
+		ImageWrite(unit, buffer, size);
 		io_success[unit] = 0;
 		return 'C';
 #if 0		
@@ -884,7 +1073,7 @@ int SIO_WriteSector(int unit, int sector, const UBYTE *buffer)
 	} 
 #endif
 	size = SeekSector(unit, sector);
-	fwrite(buffer, 1, size, disk[unit]);
+	ImageWrite(unit, buffer, size);
 	io_success[unit] = 0;
 	return 'C';
 }
@@ -901,7 +1090,7 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	io_success[unit] = -1;
 	if (SIO_drive_status[unit] == SIO_OFF)
 		return 0;
-	if (disk[unit] == NULL)
+	if (image[unit] == NULL)
 		return 'N';
 	if (SIO_drive_status[unit] != SIO_READ_WRITE)
 		return 'E';
@@ -919,6 +1108,7 @@ int SIO_FormatDisk(int unit, UBYTE *buffer, int sectsize, int sectcount)
 	bootsectcount = sectcount < 3 ? sectcount : 3;
 	/* Umount the file and open it in "wb" mode (it will truncate the file) */
 	SIO_Dismount(unit + 1);
+	IMGCACHE_ForgetFile(fname);
 	f = fopen(fname, "wb");
 	if (f == NULL) {
 		Log_print("SIO_FormatDisk: failed to open %s for writing", fname);
@@ -1073,7 +1263,7 @@ int SIO_DriveStatus(int unit, UBYTE *buffer)
 	if (io_success[unit] != 0  && image_type[unit] == IMAGE_TYPE_PRO) {
 		int sector = io_success[unit];
 		SeekSector(unit, sector);
-		if (fread(buffer, 1, 4, disk[unit]) < 4) {
+		if (ImageRead(unit, buffer, 4) < 4) {
 			Log_print("SIO_DriveStatus: failed to read sector header");
 		}
 		return 'C';
@@ -1090,7 +1280,7 @@ int SIO_DriveStatus(int unit, UBYTE *buffer)
 		return 'C';
 	}	
 	buffer[0] = 16;         /* drive active */
-	buffer[1] = disk[unit] != NULL ? 255 /* WD 177x OK */ : 127 /* no disk */;
+	buffer[1] = image[unit] != NULL ? 255 /* WD 177x OK */ : 127 /* no disk */;
 	if (io_success[unit] != 0)
 		buffer[0] |= 4;     /* failed RW-operation */
 	if (SIO_drive_status[unit] == SIO_READ_ONLY)
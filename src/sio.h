@@ -27,6 +27,10 @@ extern int SIO_last_op_time;
 extern int SIO_last_drive; /* 1 .. 8 */
 extern int SIO_last_sector;
 
+/* seconds without disk writes after which changes are written back to the
+   image files, 0 = only when the disk is dismounted */
+extern int SIO_writeback_delay;
+
 int SIO_Mount(int diskno, const char *filename, int b_open_readonly);
 void SIO_Dismount(int diskno);
 void SIO_DisableDrive(int diskno);
@@ -42,6 +46,8 @@ void SIO_PutByte(int byte);
 int SIO_GetByte(void);
 int SIO_Initialise(int *argc, char *argv[]);
 void SIO_Exit(void);
+void SIO_FlushDisks(void);
+void SIO_Frame(void);
 
 /* Some defines about the serial I/O timing. Currently fixed! */
 #define SIO_XMTDONE_INTERVAL  15
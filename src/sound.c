@@ -55,14 +55,47 @@ static unsigned int process_buffer_size;
 
 static UBYTE *sync_buffer = NULL;
 static unsigned int sync_buffer_size;
-/* Two invariants are held:
-   a) 0 <= sync_read_pos < sync_buffer_size
-   b) sync_read_pos <= sync_write_pos <= sync_buffer_size + sync_read_pos
-   sync_write_pos may be >= sync_buffer_size. In such case the actual write
-   position is sync_write_pos % sync_buffer_size. */
+/* sync_buffer is a ring written by the emulation and read by the audio
+   output, which may run in a callback on another thread. Each side changes
+   only its own position, so with atomic loads and stores of the positions
+   no lock is needed. The positions count modulo 2 * sync_buffer_size, which
+   tells a full buffer from an empty one; the index into sync_buffer is
+   SYNC_INDEX(pos). */
 static unsigned int sync_write_pos;
 static unsigned int sync_read_pos;
 
+#ifdef __ATOMIC_ACQUIRE
+/* GCC 4.7+ and clang atomic builtins */
+#define SYNC_LOAD(pos)          __atomic_load_n(&(pos), __ATOMIC_ACQUIRE)
+#define SYNC_STORE(pos, value)  __atomic_store_n(&(pos), (value), __ATOMIC_RELEASE)
+#define SYNC_LOCK()
+#define SYNC_UNLOCK()
+#else
+/* No atomics - guard the positions with the audio lock. */
+#define SYNC_LOAD(pos)          (pos)
+#define SYNC_STORE(pos, value)  ((pos) = (value))
+#define SYNC_LOCK()             PLATFORM_SoundLock()
+#define SYNC_UNLOCK()           PLATFORM_SoundUnlock()
+#endif
+
+#define SYNC_INDEX(pos) ((pos) >= sync_buffer_size ? (pos) - sync_buffer_size : (pos))
+
+/* Returns the number of bytes between READ_POS and WRITE_POS. */
+static unsigned int SyncFill(unsigned int write_pos, unsigned int read_pos)
+{
+	if (write_pos >= read_pos)
+		return write_pos - read_pos;
+	return write_pos + 2 * sync_buffer_size - read_pos;
+}
+
+static unsigned int SyncAdvance(unsigned int pos, unsigned int size)
+{
+	pos += size;
+	if (pos >= 2 * sync_buffer_size)
+		pos -= 2 * sync_buffer_size;
+	return pos;
+}
+
 unsigned int Sound_latency = 20;
 /* Cumulative audio difference. */
 static double avg_fill;
@@ -77,6 +110,24 @@ static unsigned int sync_max_fill;
    WriteOut). */
 double last_audio_write_time;
 
+/* No audio device; samples are only generated for recording. */
+int Sound_offline = FALSE;
+
+/* Dynamic rate control: instead of changing the speed of the emulation to
+   keep sync_buffer filled right, the emulation runs at the exact Atari
+   frame rate and its sound output is resampled by drc_ratio output frames
+   per input frame, which follows the fill of sync_buffer. */
+int Sound_drc = FALSE;
+/* Maximum deviation of drc_ratio from 1. A pitch change of 0.5% can't be
+   heard, and it is far more than the clocks of audio devices differ by. */
+#define DRC_MAX_ADJUST 0.005
+static double drc_ratio = 1.0;
+/* Position of the next output frame in 1/65536 frames, counted from
+   drc_last_frame (the last input frame of the previous call). */
+static ULONG drc_pos;
+static int drc_last_frame[2];
+static UBYTE *drc_buffer = NULL;
+
 enum { MAX_SAMPLE_SIZE = 2, /* for 16-bit */
 #ifdef STEREO_SOUND
        MAX_CHANNELS = 2,
@@ -86,6 +137,49 @@ enum { MAX_SAMPLE_SIZE = 2, /* for 16-bit */
        MAX_FRAME_SIZE = MAX_SAMPLE_SIZE * MAX_CHANNELS
 };
 
+/* Resamples IN_FRAMES frames from IN by drc_ratio into OUT, with linear
+   interpolation. Returns the number of frames written to OUT. */
+static unsigned int Resample(const UBYTE *in, unsigned int in_frames, UBYTE *out)
+{
+	unsigned int channels = Sound_out.channels;
+	ULONG step = (ULONG) (65536.0 / drc_ratio + 0.5);
+	ULONG end = (ULONG) in_frames << 16;
+	unsigned int out_frames = 0;
+	unsigned int c;
+
+	if (in_frames == 0)
+		return 0;
+	while (drc_pos < end) {
+		unsigned int i = drc_pos >> 16;
+		int f = (drc_pos & 0xffff) >> 1;
+		for (c = 0; c < channels; c++) {
+			int a, b, v;
+			if (Sound_out.sample_size == 2) {
+				a = i == 0 ? drc_last_frame[c] : ((const SWORD *) in)[(i - 1) * channels + c];
+				b = ((const SWORD *) in)[i * channels + c];
+				v = a + (((b - a) * f) >> 15);
+				((SWORD *) out)[out_frames * channels + c] = (SWORD) v;
+			}
+			else {
+				a = i == 0 ? drc_last_frame[c] : in[(i - 1) * channels + c];
+				b = in[i * channels + c];
+				v = a + (((b - a) * f) >> 15);
+				out[out_frames * channels + c] = (UBYTE) v;
+			}
+		}
+		out_frames++;
+		drc_pos += step;
+	}
+	drc_pos -= end;
+	for (c = 0; c < channels; c++) {
+		if (Sound_out.sample_size == 2)
+			drc_last_frame[c] = ((const SWORD *) in)[(in_frames - 1) * channels + c];
+		else
+			drc_last_frame[c] = in[(in_frames - 1) * channels + c];
+	}
+	return out_frames;
+}
+
 int Sound_ReadConfig(char *option, char *ptr)
 {
 	if (strcmp(option, "SOUND_ENABLED") == 0)
@@ -106,6 +200,8 @@ int Sound_ReadConfig(char *option, char *ptr)
 	}
 	else if (strcmp(option, "SOUND_LATENCY") == 0)
 		return (Sound_latency = Util_sscandec(ptr)) != -1;
+	else if (strcmp(option, "SOUND_DRC") == 0)
+		return (Sound_drc = Util_sscanbool(ptr)) != -1;
 	else
 		return FALSE;
 	return TRUE;
@@ -118,6 +214,7 @@ void Sound_WriteConfig(FILE *fp)
 	fprintf(fp, "SOUND_BITS=%u\n", Sound_desired.sample_size * 8);
 	fprintf(fp, "SOUND_BUFFER_MS=%u\n", Sound_desired.buffer_ms);
 	fprintf(fp, "SOUND_LATENCY=%u\n", Sound_latency);
+	fprintf(fp, "SOUND_DRC=%d\n", Sound_drc);
 }
 
 int Sound_Initialise(int *argc, char *argv[])
@@ -167,6 +264,10 @@ int Sound_Initialise(int *argc, char *argv[])
 			if (i_a)
 				Sound_latency = Util_sscandec(argv[++i]);
 			else a_m = TRUE;
+		else if (strcmp(argv[i], "-snd-drc") == 0)
+			Sound_drc = TRUE;
+		else if (strcmp(argv[i], "-nosnd-drc") == 0)
+			Sound_drc = FALSE;
 		else {
 			if (strcmp(argv[i], "-help") == 0) {
 				help_only = TRUE;
@@ -178,6 +279,9 @@ int Sound_Initialise(int *argc, char *argv[])
 				Log_print("\t-audio8              Set sound output format to 8-bit");
 				Log_print("\t-snd-buflen <ms>     Set length of the hardware sound buffer in milliseconds");
 				Log_print("\t-snddelay <ms>       Set sound latency in milliseconds");
+				Log_print("\t-snd-drc             Keep sound in sync by resampling it, not by");
+				Log_print("\t                     changing the emulation speed");
+				Log_print("\t-nosnd-drc           Keep sound in sync by changing the emulation speed");
 			}
 			argv[j++] = argv[i];
 		}
@@ -214,7 +318,10 @@ int Sound_Setup(void)
 	Sound_desired.buffer_frames = Sound_desired.freq * Sound_desired.buffer_ms / 1000;
 
 	Sound_out = Sound_desired;
-	if (!(Sound_enabled = PLATFORM_SoundSetup(&Sound_out)))
+	if (Sound_offline)
+		/* No audio device - the desired settings are used as they are. */
+		Sound_enabled = TRUE;
+	else if (!(Sound_enabled = PLATFORM_SoundSetup(&Sound_out)))
 		return FALSE;
 
 	Sound_out.buffer_ms = (unsigned int)(Sound_out.buffer_frames * 1000.0f / Sound_out.freq + 0.5f);
@@ -241,6 +348,12 @@ int Sound_Setup(void)
 
 	POKEYSND_Init(POKEYSND_FREQ_17_EXACT, Sound_out.freq, Sound_out.channels, Sound_out.sample_size == 2 ? POKEYSND_BIT16 : 0);
 
+	free(drc_buffer);
+	drc_buffer = Util_malloc(POKEYSND_process_buffer_length + POKEYSND_process_buffer_length / 64 + 2 * MAX_FRAME_SIZE);
+	drc_ratio = 1.0;
+	drc_pos = 0;
+	drc_last_frame[0] = drc_last_frame[1] = Sound_out.sample_size == 2 ? 0 : 0x80;
+
 	Sound_SetLatency(Sound_latency);
 
 	Sound_desired.freq = Sound_out.freq;
@@ -259,7 +372,8 @@ int Sound_Setup(void)
 void Sound_Exit(void)
 {
 	if (Sound_enabled) {
-		PLATFORM_SoundExit();
+		if (!Sound_offline)
+			PLATFORM_SoundExit();
 		Sound_enabled = FALSE;
 #ifndef SOUND_CALLBACK
 		free(process_buffer);
@@ -267,6 +381,8 @@ void Sound_Exit(void)
 #endif /* !SOUND_CALLBACK */
 		free(sync_buffer);
 		sync_buffer = NULL;
+		free(drc_buffer);
+		drc_buffer = NULL;
 	}
 }
 
@@ -274,7 +390,8 @@ void Sound_Pause(void)
 {
 	if (Sound_enabled && !paused) {
 		/* stop audio output */
-		PLATFORM_SoundPause();
+		if (!Sound_offline)
+			PLATFORM_SoundPause();
 		paused = TRUE;
 	}
 }
@@ -286,7 +403,8 @@ void Sound_Continue(void)
 /*		sync_write_pos = sync_read_pos + sync_min_fill;
 		avg_fill = sync_min_fill;*/
 		last_audio_write_time = Util_time();
-		PLATFORM_SoundContinue();
+		if (!Sound_offline)
+			PLATFORM_SoundContinue();
 		paused = FALSE;
 	}
 }
@@ -294,32 +412,27 @@ void Sound_Continue(void)
 /* Fills buffer BUFFER with SIZE bytes of audio samples. */
 static void FillBuffer(UBYTE *buffer, unsigned int size)
 {
-	unsigned int new_read_pos;
 	static UBYTE last_frame[MAX_FRAME_SIZE];
 	unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
-	unsigned int to_write = sync_write_pos - sync_read_pos;
+	unsigned int read_pos = sync_read_pos;
+	unsigned int to_write = SyncFill(SYNC_LOAD(sync_write_pos), read_pos);
 
 	if (to_write > 0) {
+		unsigned int index = SYNC_INDEX(read_pos);
 		if (to_write > size)
 			to_write = size;
 
-		new_read_pos = sync_read_pos + to_write;
-
-		if (new_read_pos <= sync_buffer_size)
+		if (index + to_write <= sync_buffer_size)
 			/* no wrap */
-			memcpy(buffer, sync_buffer + sync_read_pos, to_write);
+			memcpy(buffer, sync_buffer + index, to_write);
 		else {
 			/* wraps */
-			unsigned int first_part_size = sync_buffer_size - sync_read_pos;
-			memcpy(buffer, sync_buffer + sync_read_pos, first_part_size);
+			unsigned int first_part_size = sync_buffer_size - index;
+			memcpy(buffer, sync_buffer + index, first_part_size);
 			memcpy(buffer + first_part_size, sync_buffer, to_write - first_part_size);
 		}
 
-		sync_read_pos = new_read_pos;
-		if (sync_read_pos > sync_buffer_size) {
-			sync_read_pos -= sync_buffer_size;
-			sync_write_pos -= sync_buffer_size;
-		}
+		SYNC_STORE(sync_read_pos, SyncAdvance(read_pos, to_write));
 		/* Save the last frame as we may need it to fill underflow. */
 		memcpy(last_frame, buffer + to_write - bytes_per_frame, bytes_per_frame);
 	}
@@ -344,7 +457,7 @@ void Sound_Callback(UBYTE *buffer, unsigned int size)
 {
 #if DEBUG >= 2
 		Log_print("Callback: fill %u, needed %u",
-		          (sync_write_pos - sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
+		          SyncFill(SYNC_LOAD(sync_write_pos), sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
 		          size / Sound_out.channels / Sound_out.sample_size);
 #endif
 	FillBuffer(buffer, size);
@@ -359,7 +472,7 @@ static void WriteOut(void)
 	if (avail > 0) {
 #if DEBUG >= 2
 		Log_print("WriteOut: fill %u, needed %u",
-		          (sync_write_pos - sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
+		          SyncFill(sync_write_pos, sync_read_pos) / Sound_out.channels / Sound_out.sample_size,
 		          avail / Sound_out.channels / Sound_out.sample_size);
 #endif
 		/* On some platforms (eg. NestedVM) avail may be larger than process_buffer_size. */
@@ -379,11 +492,13 @@ static void UpdateSyncBuffer(void)
 	unsigned int bytes_written;
 	unsigned int samples_written;
 	unsigned int fill;
-	unsigned int new_write_pos;
+	unsigned int write_pos = sync_write_pos;
+	unsigned int index;
+	UBYTE const *source = POKEYSND_process_buffer;
 
-	PLATFORM_SoundLock();
+	SYNC_LOCK();
 	/* Current fill of the audio buffer. */
-	fill = sync_write_pos - sync_read_pos;
+	fill = SyncFill(write_pos, SYNC_LOAD(sync_read_pos));
 
 	/* Update sync_est_fill. */
 	{
@@ -396,13 +511,18 @@ static void UpdateSyncBuffer(void)
 	}
 
 	if (Atari800_turbo && sync_est_fill > sync_max_fill) {
-		PLATFORM_SoundUnlock();
+		SYNC_UNLOCK();
 		return;
 	}
 
 	/* produce samples from the sound emulation */
 	samples_written = POKEYSND_UpdateProcessBuffer();
 	bytes_written = Sound_out.sample_size * samples_written;
+	if (Sound_drc) {
+		unsigned int frame_size = Sound_out.channels * Sound_out.sample_size;
+		bytes_written = Resample(POKEYSND_process_buffer, bytes_written / frame_size, drc_buffer) * frame_size;
+		source = drc_buffer;
+	}
 
 	/* if there isn't enough room... */
 	if (bytes_written > sync_buffer_size - fill) {
@@ -415,19 +535,21 @@ static void UpdateSyncBuffer(void)
 		/* Wait until hardware buffer can be filled, or wait until callback
 		   makes place in the buffer. */
 		do {
-			PLATFORM_SoundUnlock();
+			SYNC_UNLOCK();
 #ifndef __MINT__	/* this does more harm than good on Atari */
-			/* Sleep for the duration of one full HW buffer. */
-			Util_sleep((double)Sound_out.buffer_frames / Sound_out.freq);
+			/* Sleep for as long as the output needs to play the bytes that
+			   don't fit, instead of a whole HW buffer. */
+			Util_sleep((double)(bytes_written - (sync_buffer_size - fill))
+			           / (Sound_out.freq * Sound_out.channels * Sound_out.sample_size));
 #endif
-			PLATFORM_SoundLock();
+			SYNC_LOCK();
 #ifndef SOUND_CALLBACK
 			WriteOut(); /* Write to audio buffer as much as possible. */
 #endif /* SOUND_CALLBACK */
-			fill = sync_write_pos - sync_read_pos;
+			fill = SyncFill(write_pos, SYNC_LOAD(sync_read_pos));
 		} while (bytes_written > sync_buffer_size - fill);
 	}
-	/* Now bytes_written <= audio_buffer_size + dsp_read_pos - dsp_write_pos) */
+	/* Now bytes_written <= sync_buffer_size - fill */
 
 #if DEBUG >= 2
 	Log_print("UpdateSyncBuffer: est_gap: %f, fill %u, write %u",
@@ -435,28 +557,31 @@ static void UpdateSyncBuffer(void)
 	          fill / Sound_out.channels/Sound_out.sample_size,
 	          bytes_written / Sound_out.channels/Sound_out.sample_size);
 #endif
-	/* now we copy the data into the buffer and adjust the positions */
-	new_write_pos = sync_write_pos + bytes_written;
-	if (new_write_pos/sync_buffer_size == sync_write_pos/sync_buffer_size)
+	/* now we copy the data into the buffer and publish the new position */
+	index = SYNC_INDEX(write_pos);
+	if (index + bytes_written <= sync_buffer_size)
 		/* no wrap */
-		memcpy(sync_buffer + sync_write_pos%sync_buffer_size, POKEYSND_process_buffer, bytes_written);
+		memcpy(sync_buffer + index, source, bytes_written);
 	else {
 		/* wraps */
-		int first_part_size = sync_buffer_size - sync_write_pos%sync_buffer_size;
-		memcpy(sync_buffer + sync_write_pos%sync_buffer_size, POKEYSND_process_buffer, first_part_size);
-		memcpy(sync_buffer, POKEYSND_process_buffer + first_part_size, bytes_written - first_part_size);
+		unsigned int first_part_size = sync_buffer_size - index;
+		memcpy(sync_buffer + index, source, first_part_size);
+		memcpy(sync_buffer, source + first_part_size, bytes_written - first_part_size);
 	}
 
-	sync_write_pos = new_write_pos;
-	if (sync_write_pos > sync_read_pos + sync_buffer_size)
-		sync_write_pos -= sync_buffer_size;
-	PLATFORM_SoundUnlock();
+	SYNC_STORE(sync_write_pos, SyncAdvance(write_pos, bytes_written));
+	SYNC_UNLOCK();
 }
 
 void Sound_Update(void)
 {
 	if (!Sound_enabled || paused)
 		return;
+	if (Sound_offline) {
+		/* Generate the samples of the frame only for the recording. */
+		POKEYSND_UpdateProcessBuffer();
+		return;
+	}
 	UpdateSyncBuffer();
 #ifndef SOUND_CALLBACK
 	WriteOut();
@@ -466,7 +591,7 @@ void Sound_Update(void)
 void Sound_SetLatency(unsigned int latency)
 {
 	Sound_latency = latency;
-	if (Sound_enabled) {
+	if (Sound_enabled && !Sound_offline) {
 		/* how many fragments in the audio buffer */
 		enum { SYNC_BUFFER_FRAGS = 5 };
 		unsigned int bytes_per_frame = Sound_out.channels * Sound_out.sample_size;
@@ -493,7 +618,17 @@ double Sound_AdjustSpeed(void)
 	if (Sound_enabled && !paused) {
 #if 1
 		avg_fill = avg_fill + alpha * (sync_est_fill - avg_fill);
-		if (avg_fill < sync_min_fill)
+		if (Sound_drc) {
+			/* Keep the speed and steer the fill towards the middle of
+			   sync_min_fill..sync_max_fill by resampling. */
+			double error = (avg_fill - (sync_min_fill + sync_max_fill) / 2.0) / (sync_max_fill - sync_min_fill);
+			if (error > 1.0)
+				error = 1.0;
+			else if (error < -1.0)
+				error = -1.0;
+			drc_ratio = 1.0 - DRC_MAX_ADJUST * error;
+		}
+		else if (avg_fill < sync_min_fill)
 			delay_mult = 0.95;
 		else if (avg_fill > sync_max_fill)
 			delay_mult = 1.05;
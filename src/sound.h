@@ -80,9 +80,21 @@ extern unsigned int Sound_latency;
 
 void Sound_SetLatency(unsigned int latency);
 
+/* If TRUE, the emulation runs at the exact Atari frame rate and the sound
+   is kept in sync with the output by resampling it by a slightly varying
+   ratio (dynamic rate control). Otherwise the emulation speed is adjusted. */
+extern int Sound_drc;
+
+/* If TRUE, no audio device is opened. Sound_Update only generates the
+   samples of each frame so that they can be recorded, independent of the
+   speed of the emulation. Must be set before Sound_Setup. */
+extern int Sound_offline;
+
 /* Returns a factor (1.0 by default) to adjust the speed of the emulation
  * so that if the sound buffer is too full or too empty. The emulation
- * slows down or speeds up to match the actual speed of sound output. */
+ * slows down or speeds up to match the actual speed of sound output.
+ * With Sound_drc the factor is always 1.0, and the resampling ratio is
+ * adjusted instead. */
 double Sound_AdjustSpeed(void);
 
 /* Helper function for use when hardware audio buffer size is required to
@@ -101,13 +101,40 @@ static size_t mem_write(const void *buf, size_t len, gzFile stream);
 #define Z_OK    0
 #endif
 
+#if defined(STATESAV_MEMORY) && !defined(MEMCOMPR) && !defined(LIBATARI800)
+/* Rewind and event recording keyframes keep state saves in memory. While
+   mem_state is set, the state is written to and read from it instead of a
+   file. */
+static UBYTE *mem_state = NULL;
+static ULONG mem_state_off;
+static size_t mem_state_read(void *buf, size_t len);
+static size_t mem_state_write(const void *buf, size_t len);
+#define STATE_OPEN(X, Y)     (mem_state != NULL ? (gzFile) &mem_state : GZOPEN(X, Y))
+#define STATE_CLOSE(X)       (mem_state != NULL ? 0 : GZCLOSE(X))
+#define STATE_READ(X, Y, Z)  (mem_state != NULL ? mem_state_read(Y, Z) : GZREAD(X, Y, Z))
+#define STATE_WRITE(X, Y, Z) (mem_state != NULL ? mem_state_write(Y, Z) : GZWRITE(X, Y, Z))
+#else
+#define STATE_OPEN(X, Y)     GZOPEN(X, Y)
+#define STATE_CLOSE(X)       GZCLOSE(X)
+#define STATE_READ(X, Y, Z)  GZREAD(X, Y, Z)
+#define STATE_WRITE(X, Y, Z) GZWRITE(X, Y, Z)
+#endif
+
 static gzFile StateFile = NULL;
 static int nFileError = Z_OK;
 
 static void GetGZErrorText(void)
 {
 #ifdef GZERROR
-	const char *error = GZERROR(StateFile, &nFileError);
+	const char *error;
+#if defined(STATESAV_MEMORY) && !defined(MEMCOMPR) && !defined(LIBATARI800)
+	/* StateFile is not a real gzFile then, so don't pass it to GZERROR */
+	if (mem_state != NULL) {
+		Log_print("State save buffer full.");
+		return;
+	}
+#endif
+	error = GZERROR(StateFile, &nFileError);
 	if (nFileError == Z_ERRNO) {
 #ifdef HAVE_STRERROR
 		Log_print("The following general file I/O error occurred:");
@@ -132,7 +159,7 @@ void StateSav_SaveUBYTE(const UBYTE *data, int num)
 	   directly to the active bits if in a padded location. If not (unlikely)
 	   you'll have to redefine this to save appropriately for cross-platform
 	   compatibility */
-	if (GZWRITE(StateFile, data, num) == 0)
+	if (STATE_WRITE(StateFile, data, num) == 0)
 		GetGZErrorText();
 }
 
@@ -142,7 +169,7 @@ void StateSav_ReadUBYTE(UBYTE *data, int num)
 	if (!StateFile || nFileError != Z_OK)
 		return;
 
-	if (GZREAD(StateFile, data, num) == 0)
+	if (STATE_READ(StateFile, data, num) == 0)
 		GetGZErrorText();
 }
 
@@ -162,14 +189,14 @@ void StateSav_SaveUWORD(const UWORD *data, int num)
 
 		temp = *data++;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -186,12 +213,12 @@ void StateSav_ReadUWORD(UWORD *data, int num)
 	while (num > 0) {
 		UBYTE byte1, byte2;
 
-		if (GZREAD(StateFile, &byte1, 1) == 0) {
+		if (STATE_READ(StateFile, &byte1, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte2, 1) == 0) {
+		if (STATE_READ(StateFile, &byte2, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -224,28 +251,28 @@ void StateSav_SaveINT(const int *data, int num)
 		temp = (unsigned int) temp0;
 
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = temp & 0xff;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
 		temp >>= 8;
 		byte = (temp & 0x7f) | signbit;
-		if (GZWRITE(StateFile, &byte, 1) == 0) {
+		if (STATE_WRITE(StateFile, &byte, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -264,22 +291,22 @@ void StateSav_ReadINT(int *data, int num)
 		int temp;
 		UBYTE byte1, byte2, byte3, byte4;
 
-		if (GZREAD(StateFile, &byte1, 1) == 0) {
+		if (STATE_READ(StateFile, &byte1, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte2, 1) == 0) {
+		if (STATE_READ(StateFile, &byte2, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte3, 1) == 0) {
+		if (STATE_READ(StateFile, &byte3, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
 
-		if (GZREAD(StateFile, &byte4, 1) == 0) {
+		if (STATE_READ(StateFile, &byte4, 1) == 0) {
 			GetGZErrorText();
 			break;
 		}
@@ -333,20 +360,20 @@ int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVe
 	UBYTE StateVersion = SAVE_VERSION_NUMBER;
 
 	if (StateFile != NULL) {
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 	}
 	nFileError = Z_OK;
 
-	StateFile = GZOPEN(filename, mode);
+	StateFile = STATE_OPEN(filename, mode);
 	if (StateFile == NULL) {
 		Log_print("Could not open %s for state save.", filename);
 		GetGZErrorText();
 		return FALSE;
 	}
-	if (GZWRITE(StateFile, "ATARI800", 8) == 0) {
+	if (STATE_WRITE(StateFile, "ATARI800", 8) == 0) {
 		GetGZErrorText();
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
@@ -402,7 +429,7 @@ int StateSav_SaveAtariState(const char *filename, const char *mode, UBYTE SaveVe
 #endif
 
 	STATESAV_TAG(size);
-	if (GZCLOSE(StateFile) != 0) {
+	if (STATE_CLOSE(StateFile) != 0) {
 		StateFile = NULL;
 		return FALSE;
 	}
@@ -421,43 +448,43 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 	UBYTE SaveVerbose = 0;   /* Verbose mode means save basic, OS if patched */
 
 	if (StateFile != NULL) {
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 	}
 	nFileError = Z_OK;
 
-	StateFile = GZOPEN(filename, mode);
+	StateFile = STATE_OPEN(filename, mode);
 	if (StateFile == NULL) {
 		Log_print("Could not open %s for state read.", filename);
 		GetGZErrorText();
 		return FALSE;
 	}
 
-	if (GZREAD(StateFile, header_string, 8) == 0) {
+	if (STATE_READ(StateFile, header_string, 8) == 0) {
 		GetGZErrorText();
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
 	if (memcmp(header_string, "ATARI800", 8) != 0) {
 		Log_print("This is not an Atari800 state save file.");
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
 
-	if (GZREAD(StateFile, &StateVersion, 1) == 0
-	 || GZREAD(StateFile, &SaveVerbose, 1) == 0) {
+	if (STATE_READ(StateFile, &StateVersion, 1) == 0
+	 || STATE_READ(StateFile, &SaveVerbose, 1) == 0) {
 		Log_print("Failed read from Atari state file.");
 		GetGZErrorText();
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
 
 	if (StateVersion > SAVE_VERSION_NUMBER || StateVersion < 3) {
 		Log_print("Cannot read this state file because it is an incompatible version.");
-		GZCLOSE(StateFile);
+		STATE_CLOSE(StateFile);
 		StateFile = NULL;
 		return FALSE;
 	}
@@ -480,7 +507,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 		StateSav_ReadINT(&local_xep80_enabled,1);
 		if (local_xep80_enabled) {
 			Log_print("Cannot read this state file because this version does not support XEP80.");
-			GZCLOSE(StateFile);
+			STATE_CLOSE(StateFile);
 			StateFile = NULL;
 			return FALSE;
 		}
@@ -494,7 +521,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_mio_enabled,1);
 			if (local_mio_enabled) {
 				Log_print("Cannot read this state file because this version does not support MIO.");
-				GZCLOSE(StateFile);
+				STATE_CLOSE(StateFile);
 				StateFile = NULL;
 				return FALSE;
 			}
@@ -508,7 +535,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_bb_enabled,1);
 			if (local_bb_enabled) {
 				Log_print("Cannot read this state file because this version does not support the Black Box.");
-				GZCLOSE(StateFile);
+				STATE_CLOSE(StateFile);
 				StateFile = NULL;
 				return FALSE;
 			}
@@ -522,7 +549,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 			StateSav_ReadINT(&local_xld_enabled,1);
 			if (local_xld_enabled) {
 				Log_print("Cannot read this state file because this version does not support the 1400XL/1450XLD.");
-				GZCLOSE(StateFile);
+				STATE_CLOSE(StateFile);
 				StateFile = NULL;
 				return FALSE;
 			}
@@ -533,7 +560,7 @@ int StateSav_ReadAtariState(const char *filename, const char *mode)
 	DCStateRead();
 #endif
 
-	GZCLOSE(StateFile);
+	STATE_CLOSE(StateFile);
 	StateFile = NULL;
 
 	if (nFileError != Z_OK)
@@ -690,6 +717,78 @@ static size_t mem_write(const void *buf, size_t len, gzFile stream)
 
 #endif /* defined(MEMCOMPR) || defined(LIBATARI800) */
 
+#ifdef STATESAV_MEMORY
+#ifdef LIBATARI800
+
+ULONG StateSav_SaveAtariStateToMemory(UBYTE *buffer)
+{
+	UBYTE *old_buffer = LIBATARI800_StateSav_buffer;
+	statesav_tags_t *old_tags = LIBATARI800_StateSav_tags;
+	statesav_tags_t tags;
+	int result;
+
+	LIBATARI800_StateSav_buffer = buffer;
+	LIBATARI800_StateSav_tags = &tags;
+	result = StateSav_SaveAtariState(NULL, NULL, 0);
+	LIBATARI800_StateSav_buffer = old_buffer;
+	LIBATARI800_StateSav_tags = old_tags;
+	return result ? tags.size : 0;
+}
+
+int StateSav_ReadAtariStateFromMemory(UBYTE *buffer)
+{
+	UBYTE *old_buffer = LIBATARI800_StateSav_buffer;
+	int result;
+
+	LIBATARI800_StateSav_buffer = buffer;
+	result = StateSav_ReadAtariState(NULL, NULL);
+	LIBATARI800_StateSav_buffer = old_buffer;
+	return result;
+}
+
+#elif !defined(MEMCOMPR)
+
+static size_t mem_state_read(void *buf, size_t len)
+{
+	if (mem_state_off + len > STATESAV_MAX_SIZE) return 0;
+	memcpy(buf, mem_state + mem_state_off, len);
+	mem_state_off += len;
+	return len;
+}
+
+static size_t mem_state_write(const void *buf, size_t len)
+{
+	if (mem_state_off + len > STATESAV_MAX_SIZE) return 0;
+	memcpy(mem_state + mem_state_off, buf, len);
+	mem_state_off += len;
+	return len;
+}
+
+ULONG StateSav_SaveAtariStateToMemory(UBYTE *buffer)
+{
+	int result;
+
+	mem_state = buffer;
+	mem_state_off = 0;
+	result = StateSav_SaveAtariState(NULL, "wb", 0);
+	mem_state = NULL;
+	return result ? mem_state_off : 0;
+}
+
+int StateSav_ReadAtariStateFromMemory(UBYTE *buffer)
+{
+	int result;
+
+	mem_state = buffer;
+	mem_state_off = 0;
+	result = StateSav_ReadAtariState(NULL, "rb");
+	mem_state = NULL;
+	return result;
+}
+
+#endif /* LIBATARI800 */
+#endif /* STATESAV_MEMORY */
+
 /*
 vim:ts=4:sw=4:
 */
@@ -17,6 +17,19 @@ void StateSav_ReadUWORD(UWORD *data, int num);
 void StateSav_ReadINT(int *data, int num);
 void StateSav_ReadFNAME(char *filename);
 
+#if defined(REWIND) || defined(EVENT_RECORDING)
+/* used by the rewind history and by the keyframes of event recordings */
+#define STATESAV_MEMORY
+#endif
+
+#ifdef STATESAV_MEMORY
+/* Save and restore the state using a buffer of STATESAV_MAX_SIZE bytes
+   instead of a file. StateSav_SaveAtariStateToMemory returns the number of
+   bytes used, or 0 on error. */
+ULONG StateSav_SaveAtariStateToMemory(UBYTE *buffer);
+int StateSav_ReadAtariStateFromMemory(UBYTE *buffer);
+#endif
+
 #ifdef LIBATARI800
 ULONG StateSav_Tell(void);
 #include "libatari800/statesav.h"
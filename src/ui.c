@@ -4015,6 +4015,7 @@ static int SoundSettings(void)
 		UI_MENU_ACTION(2, "Bit depth:"),
 		UI_MENU_SUBMENU_SUFFIX(3, "Hardware buffer length:", hw_buflen_string),
 		UI_MENU_SUBMENU_SUFFIX(4, "Latency:", latency_string),
+		UI_MENU_CHECK(10, "Sync by resampling:"),
 #ifdef DREAMCAST
 		UI_MENU_CHECK(0, "Enable sound:"),
 #endif
@@ -4051,6 +4052,7 @@ static int SoundSettings(void)
 #endif /* STEREO_SOUND */
 		}
 		snprintf(latency_string, sizeof(latency_string), "%u ms", Sound_latency);
+		SetItemChecked(menu_array, 10, Sound_drc);
 		SetItemChecked(menu_array, 6, POKEYSND_enable_new_pokey);
 #ifdef CONSOLE_SOUND
 		SetItemChecked(menu_array, 7, POKEYSND_console_sound_enabled);
@@ -4126,6 +4128,9 @@ static int SoundSettings(void)
 			if (UI_driver->fEditString("Enter sound latency", latency_string, sizeof(latency_string)-3))
 				Sound_SetLatency(atoi(latency_string));
 			break;
+		case 10:
+			Sound_drc = !Sound_drc;
+			break;
 #ifdef STEREO_SOUND
 		case 5:
 			setup.channels = 3 - setup.channels; /* Toggle 1<->2 */
@@ -4454,6 +4459,8 @@ void UI_Run(void)
 
 	/* Sound_Active(TRUE); */
 	UI_is_active = FALSE;
+	/* the menus were drawn over the emulated screen */
+	Screen_EntireDirty();
 	
 	/* flush keypresses */
 	while (PLATFORM_Keyboard() != AKEY_NONE)
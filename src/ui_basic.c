@@ -80,6 +80,13 @@ const unsigned char UI_BASIC_key_to_ascii[256] =
 #define KB_DELAY       20
 #define KB_AUTOREPEAT  3
 
+/* The menus are drawn over Screen_atari, so show all of it. */
+static void DisplayScreen(void)
+{
+	Screen_EntireDirty();
+	PLATFORM_DisplayScreen();
+}
+
 static int GetKeyPress(void)
 {
 	int keycode;
@@ -87,7 +94,7 @@ static int GetKeyPress(void)
 	if (UI_alt_function >= 0)
 		return 0x1b; /* escape - go to Main Menu */
 
-	PLATFORM_DisplayScreen();
+	DisplayScreen();
 
 	for (;;) {  
 		static int rep = KB_DELAY;
@@ -251,7 +258,7 @@ static void BasicUIMessage(const char *msg, int waitforkey)
 	if (waitforkey)
 		GetKeyPress();
 	else
-		PLATFORM_DisplayScreen();
+		DisplayScreen();
 }
 
 #ifdef GUI_SDL
@@ -260,7 +267,7 @@ int GetRawKey(void)
 	ClearRectangle(0x94, 13, 11, 25, 13);
 	Box(0x9a, 0x94, 13, 11, 25, 13);
 	CenterPrint(0x94, 0x9a, "Press a key", 12);
-	PLATFORM_DisplayScreen();
+	DisplayScreen();
 	return PLATFORM_GetRawKey();
 }
 #endif /* GUI_SDL */
@@ -976,7 +983,7 @@ static int FileSelector(char *path, int select_dir, char pDirectories[][FILENAME
 		   files in the directory. */
 		/* The extra spaces are needed to clear the previous window title. */
 		TitleScreen("            Please wait...            ");
-		PLATFORM_DisplayScreen();
+		DisplayScreen();
 
 		for (;;) {
 			GetDirectory(current_dir);